@@ -0,0 +1,203 @@
+# 0 "libnethack/include/artilist.h"
+# 0 "<built-in>"
+# 0 "<command-line>"
+# 1 "/usr/include/stdc-predef.h" 1 3 4
+# 0 "<command-line>" 2
+# 1 "./dumbmake/dumbmake.h" 1
+
+
+
+
+
+
+
+extern const char *aimake_get_option(const char *);
+# 0 "<command-line>" 2
+# 1 "libnethack/include/artilist.h"
+# 11 "libnethack/include/artilist.h"
+static const char *artifact_names[] = {
+# 57 "libnethack/include/artilist.h"
+    ""
+                                                                        ,
+# 83 "libnethack/include/artilist.h"
+    "Excalibur"
+
+
+                                                                              ,
+
+
+
+
+    "Stormbringer"
+
+
+                                                                           ,
+
+
+
+
+    "Mjollnir"
+
+                                                                             ,
+
+    "Cleaver"
+
+                                                                              ,
+
+    "Grimtooth"
+
+                                                                         ,
+
+
+
+    "Orcrist"
+
+                                                                        ,
+
+
+
+
+
+
+
+    "Sting"
+
+                                                                       ,
+
+
+
+
+    "Magicbane"
+
+
+            ,
+
+    "Valerian"
+
+                                                                              ,
+
+    "Frost Brand"
+
+                                                                        ,
+
+    "Fire Brand"
+
+                                                                        ,
+
+    "Dragonbane"
+
+                                                                         ,
+
+    "Demonbane"
+
+                                                                       ,
+
+    "Werebane"
+
+                                                                           ,
+
+    "Grayswandir"
+
+                                                                       ,
+
+    "Quickpick"
+
+
+           ,
+
+    "Giantslayer"
+
+                                                                       ,
+
+    "Trollsbane"
+
+                                                                    ,
+
+
+
+
+
+    "Vorpal Blade"
+
+                                                                        ,
+# 191 "libnethack/include/artilist.h"
+    "Snickersnee"
+
+                                                                           ,
+# 205 "libnethack/include/artilist.h"
+    "The Orb of Detection"
+
+
+                                                      ,
+
+    "The Heart of Ahriman"
+
+
+
+                                                           ,
+
+    "Big Stick"
+
+
+                                                     ,
+
+    "The Sceptre of Might"
+
+
+                                                       ,
+
+    "The Staff of Aesculapius"
+
+
+
+                                                   ,
+
+    "The Magic Mirror of Merlin"
+
+
+                                            ,
+
+    "The Eyes of the Overworld"
+
+
+                                                      ,
+# 249 "libnethack/include/artilist.h"
+    "The Longbow of Diana"
+
+
+                                                       ,
+
+    "The Master Key of Thievery"
+
+
+
+                                                 ,
+
+    "The Tsurugi of Muramasa"
+
+
+                                             ,
+
+    "The Platinum Yendorian Express Card"
+
+
+
+                                                       ,
+
+    "The Orb of Fate"
+
+
+
+                                                     ,
+
+    "The Eye of the Aethiopica"
+
+
+                                                         ,
+
+
+
+
+    0
+
+};
@@ -0,0 +1,43 @@
+/* vim:set cin ft=c sw=4 sts=4 ts=8 et ai cino=Ls\:0t0(0 : -*- mode:c;fill-column:80;tab-width:8;c-basic-offset:4;indent-tabs-mode:nil;c-file-style:"k&r" -*-*/
+/* Last modified by agent, 2026-10-17 */
+/* Copyright (c) NetHack Fourk DevTeam, 2026. */
+/* NetHack may be freely redistributed.  See license for details. */
+
+#ifndef BASE64_H
+# define BASE64_H
+
+/* Block-level base 64 codec used by the save file code in log.c. A "block" is
+   3 bytes of binary data, or the 4 characters that encode them; the framing
+   (compression headers, padding) is log.c's job.
+
+   The functions here pick the fastest implementation the CPU supports the
+   first time they're called. All the implementations produce identical
+   results. */
+
+enum base64_kernel {
+    B64K_AUTO,          /* fastest supported kernel */
+    B64K_SCALAR,
+    B64K_SSSE3,
+    B64K_AVX2,
+    B64K_COUNT
+};
+
+extern const unsigned char b64e[64];
+extern const char b64d[256];
+
+/* Encodes nblocks blocks from in to out. Doesn't NUL-terminate out. */
+extern void base64_encode_blocks(const unsigned char *in, char *out,
+                                 int nblocks);
+
+/* Decodes up to nblocks blocks from in to out, stopping early before the first
+   block that contains a character outside the base 64 alphabet (including
+   padding). Returns the number of blocks decoded. */
+extern int base64_decode_blocks(const char *in, unsigned char *out,
+                                int nblocks);
+
+/* Forces the use of a particular kernel (for benchmarking). Returns 0 if the
+   CPU (or compiler) doesn't support it, in which case nothing changes. */
+extern int base64_set_kernel(enum base64_kernel kernel);
+extern const char *base64_kernel_name(enum base64_kernel kernel);
+
+#endif
@@ -33,6 +33,7 @@ struct flag;
 struct level;
 struct memfile;
 struct mkroom;
+struct mon_index;
 struct monst;
 struct musable;
 struct newgame_options;
@@ -197,6 +198,7 @@ extern void bot(void);
 extern void max_rank_sz(void);
 extern const char *rank_of(int, short, boolean);
 extern int describe_level(char *);
+extern void make_player_info(struct nh_player_info *);
 
 /* ### cmd.c ### */
 
@@ -835,6 +837,8 @@ extern void log_backup_save(void);
 extern void log_sync(long, enum target_location_units, boolean);
 
 extern void log_revert_command(const char *);
+extern void log_save_stats(const struct memfile *mf, const char *kind);
+extern void log_run_deferred_save_verification(struct nh_cmd_and_arg *);
 extern void log_recover_core(long, boolean, const char *, const char *, int);
 extern noreturn void log_recover_noreturn(
     long, const char *, const char *, int);
@@ -860,6 +864,7 @@ extern void log_init(int fd);
 extern void log_uninit(void);
 extern void log_game_over(const char *death);
 extern void log_game_state(void);
+extern boolean analysis_is_open(void);
 
 /* ### mail.c ### */
 
@@ -917,6 +922,8 @@ extern void mwrite64(struct memfile *mf, int64_t value);
 extern void store_mf(int fd, struct memfile *mf);
 extern void mtag(struct memfile *mf, long tagdata,
                  enum memfile_tagtype tagtype);
+extern const char *mtag_name(int tagtype);
+extern void maccount(const struct memfile *mf, struct memfile_usage *usage);
 extern void mhint_mon_coordinates(struct memfile *mf);
 extern void mdiffflush(struct memfile *mf, boolean eof);
 extern void mdiffapply(char *diff, long difflen, struct memfile *diff_base,
@@ -1093,6 +1100,9 @@ extern struct obj *add_to_container(struct obj *, struct obj *);
 extern void add_to_buried(struct obj *obj);
 extern struct obj *newobj(int, struct obj *);
 extern void dealloc_obj(struct obj *);
+extern struct obj *oid_index_find(unsigned, unsigned *);
+extern void set_obj_id(struct obj *, unsigned);
+extern void free_oid_index(void);
 extern void obj_ice_effects(struct level *, int, int, boolean);
 extern long peek_at_iced_corpse_age(struct obj *);
 extern void set_obj_level(struct level *lev, struct obj *obj);
@@ -1142,6 +1152,13 @@ extern int mcalcmove(struct monst *);
 extern void mcalcdistress(void);
 extern void replmon(struct monst *, struct monst *);
 extern void relmon(struct monst *);
+extern void mon_index_add(struct mon_index *, struct monst *);
+extern void mon_index_remove(struct mon_index *, struct monst *);
+extern struct monst *mon_index_find(const struct mon_index *, unsigned,
+                                    boolean);
+extern void mon_index_rebuild(struct mon_index *, struct monst *);
+extern void mon_index_free(struct mon_index *);
+extern struct mon_index *migrating_mon_index(void);
 extern struct obj *mlifesaver(struct monst *);
 extern boolean corpse_chance(struct monst *, struct monst *, boolean);
 extern void mondead(struct monst *);
@@ -1289,6 +1306,12 @@ enum rng rng_for_level(const d_level *);
 int mklev_rn2(int, struct level *);
 int rat_rne(int, int, enum rng);
 extern long gameseed_long(void);
+extern boolean rng_benchmark_kernel(int, const char **, long *);
+extern void rng_profile_init(void);
+extern void rng_profile_start(void);
+extern boolean rng_profile_active(void);
+extern void rng_profile_report(struct nh_menulist *);
+extern void rng_profile_uninit(void);
 
 /* ### o_init.c ### */
 
@@ -1486,6 +1509,9 @@ extern unsigned u_have_property(enum youprop, unsigned, boolean);
 extern boolean m_helpless(const struct monst *, enum helpless_mask mask);
 extern boolean u_helpless(enum helpless_mask mask);
 extern unsigned msensem(const struct monst *, const struct monst *);
+extern void msensem_memo_begin(void);
+extern void msensem_memo_end(void);
+extern void msensem_memo_report(struct nh_menulist *);
 extern void enlightenment(int);
 extern void unspoilered_intrinsics(void);
 extern void show_conduct(int);
@@ -1799,6 +1825,7 @@ extern boolean start_timer(struct level *lev, long when, short kind,
                            short func_index, void *arg);
 extern long stop_timer(struct level *lev, short func_index, void *arg);
 extern long report_timer(struct level *lev, short func_index, const void *arg);
+extern int count_timers_with_arg(struct level *lev, const void *arg);
 extern void run_timers(void);
 extern void obj_move_timers(struct obj *, struct obj *);
 extern void obj_split_timers(struct obj *, struct obj *);
@@ -1868,6 +1895,8 @@ extern boolean chest_trap(struct obj *, int, boolean);
 extern void deltrap(struct level *, struct trap *);
 extern boolean delfloortrap(struct level *, struct trap *);
 extern struct trap *t_at(struct level *lev, int x, int y);
+extern void move_trap(struct level *lev, struct trap *trap, int x, int y);
+extern void index_traps(struct level *lev);
 extern void b_trapped(const char *, int);
 extern boolean lava_effects(void);
 extern void blow_up_landmine(struct trap *);
@@ -2048,7 +2077,9 @@ extern void setnotworn(struct obj *);
 extern boolean obj_worn_on(struct obj *, enum objslot);
 extern long mworn_extrinsic(const struct monst *, int);
 extern boolean mworn_blocked(const struct monst *, int);
+extern long mworn_extrinsic_blocked(const struct monst *, int, boolean *);
 extern int mworn_warntype(const struct monst *);
+extern void extrinsic_cache_init(void);
 
 extern void mon_set_minvis(struct monst *);
 extern void mon_adjust_speed(struct monst *, int, struct obj *);
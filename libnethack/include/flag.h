@@ -225,7 +225,8 @@ struct flag {
     enum {
         saveenc_unencoded = 0,  /* relative to 0 */
         saveenc_moverel = 1,    /* relative to moves */
-        saveenc_levelrel = 2    /* relative to level->lastmoves */
+        saveenc_levelrel = 2,   /* relative to level->lastmoves */
+        saveenc_planar = 3      /* levelrel, locations stored field by field */
     } save_encoding;    /* allows safe conversion of old saves */
 
 # define DISCLOSE_PROMPT_DEFAULT_YES    'y'
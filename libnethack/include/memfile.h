@@ -6,8 +6,6 @@
 #ifndef MEMFILE_H
 # define MEMFILE_H
 
-# define MEMFILE_HASHTABLE_SIZE 1009
-
 /* Save diff format magic numbers. */
 # define MDIFF_HEADER_0       0x01
 # define MDIFF_HEADER_1_BETA2 0x40 /* SAVEBREAK (4.3-beta2 -> 4.3-beta3) */
@@ -112,13 +110,41 @@ enum memfile_tagtype {
     MTAG_AUTOPICKUP_RULES,  /* 40 */
     MTAG_DUNGEON_TOPOLOGY,
     MTAG_SPELLBOOK,
+    MTAG_LOCPLANE,          /* one field of a level's locations */
+    MTAG_ANCHOR,            /* content-based, for diffing saves offline */
+    MTAG_COUNT              /* fencepost, comes last; not a real tag type */
+};
+/* With saveenc_planar, a level's locations are saved in two runs of COLNO *
+   ROWNO records (in x-major order), split by how often the fields change; the
+   MTAG_LOCPLANE tag before each run has levnum * LOCPLANE_COUNT + plane as its
+   tagdata. */
+enum locplane {
+    LOCPLANE_MEMORY,        /* 32-bit remembered display, 8-bit seenv */
+    LOCPLANE_TERRAIN,       /* 8-bit typ, 16-bit flags */
+    LOCPLANE_COUNT
 };
+
 struct memfile_tag {
-    struct memfile_tag *next;
     long tagdata;
     enum memfile_tagtype tagtype;
     int pos;
 };
+
+/* How much of a save is taken up by each tag type, and by each level. Data
+   belongs to the most recent tag before it (or to "untagged", index MTAG_COUNT,
+   if there isn't one), and to the level whose MTAG_LEVELS tag it follows
+   (index 0 if it isn't part of any level). "changed" counts the bytes that a
+   save diff has to edit rather than copy; for a save that isn't relative to
+   another save, every byte counts as changed. */
+struct memfile_usage_count {
+    long written;
+    long changed;
+};
+struct memfile_usage {
+    struct memfile_usage_count bytype[MTAG_COUNT + 1];
+    struct memfile_usage_count bylevel[MAXDUNGEON * MAXLEVEL + 1];
+};
+
 struct memfile {
     /* The basic information: the buffer, its length, and the file position */
     char *buf;
@@ -168,14 +194,21 @@ struct memfile {
        coordinate is in the byte afterwards). */
     int mon_coord_hint;
 
-    /* Tags to help in diffing. This is a hashtable for efficiency, using
-       chaining in the case of collisions. */
-    struct memfile_tag *tags[MEMFILE_HASHTABLE_SIZE];
-
-    /* Where we are "semantically", for debug purposes. (It's possible this
-       could someday be used to construct better error messages, too, but so
-       far it isn't.) */
-    struct memfile_tag *last_tag;
+    /* Tags to help in diffing. These are stored in a single array, in the
+       order they were created (and thus in order of pos); the last one tells
+       us where we are "semantically", for debug purposes. tagtable is an
+       open-addressing hashtable (with a power-of-2 size) that indexes the
+       array; each entry is an index into tags plus 1, or 0 if empty. */
+    struct memfile_tag *tags;
+    int ntags;
+    int maxtags;
+    int *tagtable;
+    int tagtable_size;
+
+    /* Identifies which savegame() call produced the contents of this memfile
+       (0 if none did); levels use it to check whether their record of where
+       they were last serialized refers to this memfile. */
+    unsigned long save_serial;
 };
 
 #endif
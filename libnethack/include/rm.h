@@ -514,6 +514,34 @@ enum tracked_levelsound {
 #define LAST_TRACKED_LEVELSOUND levsound_unused_10
 #define NUM_OF_TRACKED_LEVELSOUNDS (1 + (int) levsound_unused_10)
 
+/* Where a level was serialized the last time the game was saved. If the level
+   hasn't changed since, savegame() can copy those bytes instead of walking the
+   level again. None of this is itself saved. */
+struct level_save_tag {
+    long tagdata;
+    int tagtype;                /* enum memfile_tagtype */
+    int offset;                 /* relative to the start of the level's bytes */
+};
+struct level_save_cache {
+    unsigned long serial;       /* save_serial of the memfile; 0 if none */
+    int start;                  /* position of the level's bytes in it */
+    int len;
+    int encoding;               /* flags.save_encoding the bytes were made with */
+    int mon_coord_hint;         /* relative to start; -1 if not in the level */
+    int ntags;                  /* tags created while saving the level */
+    int maxtags;
+    struct level_save_tag *tags;
+    boolean dirty;              /* changed since it was last serialized */
+};
+
+/* A hash table from m_id to the monsters on one monster list (see
+   mon_index_find() in mon.c). */
+struct mon_index {
+    struct monst **slots;       /* open addressing; NULL means empty */
+    unsigned size;              /* 0, or a power of 2 */
+    unsigned count;
+};
+
 struct ls_t;
 struct level {
     char struct_type;  /* Should always be 'L' for this struct.
@@ -526,14 +554,17 @@ struct level {
     struct obj *buriedobjlist;
     struct obj *billobjs;       /* objects not yet paid for */
     struct monst *monlist;
+    struct mon_index monindex;  /* the monsters on monlist, by m_id */
     struct damage *damagelist;
     struct levelflags flags;
     boolean heardsound[NUM_OF_TRACKED_LEVELSOUNDS];
 
-    timer_element *lev_timers;
+    struct timer_queue lev_timers;
     struct ls_t *lev_lights;
     struct trap *lev_traps;
     struct engr *lev_engr;
+    struct trap *traps[COLNO][ROWNO];           /* lev_traps, by location */
+    struct engr *engravings[COLNO][ROWNO];      /* lev_engr, by location */
     struct region **regions;
 
     coord doors[DOORMAX];
@@ -556,6 +587,8 @@ struct level {
     int max_regions;
 
     d_level z;
+
+    struct level_save_cache save_cache;
 };
 
 extern struct level *levels[MAXLINFO];  /* structure describing all levels */
@@ -574,6 +607,10 @@ extern struct level *level;             /* pointer to an entry in levels */
              (level->monsters[x][y] != NULL && level->monsters[x][y]->mburied)
 # define place_worm_seg(m,x,y)   (m)->dlevel->monsters[x][y] = m
 # define remove_monster(lev,x,y) (lev)->monsters[x][y] = NULL
+
+/* Must be called when changing anything about a level that savelev() writes,
+   unless the level is the current level (which is always saved in full). */
+# define mark_level_dirty(lev)   ((lev)->save_cache.dirty = TRUE)
 # define m_at(lev,x,y) \
              (MON_AT(lev,x,y) ? (lev)->monsters[x][y] : NULL)
 # define m_buried_at(x,y) \
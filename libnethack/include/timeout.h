@@ -34,14 +34,26 @@ typedef void (*timeout_proc) (void *, long);
 
 /* used in timeout.c */
 typedef struct timer_element {
-    struct timer_element *next; /* next item in chain */
     void *arg;  /* pointer to timeout argument */
     unsigned int timeout;       /* when we time out */
     unsigned int tid;   /* timer ID */
+    unsigned int seq;   /* when it was added to its level's queue */
+    unsigned int heap_pos;      /* where it is in the queue's heap */
     short kind; /* kind of use */
     uchar func_index;   /* what to call when we time out */
     unsigned needs_fixup:1;     /* does arg need to be patched? */
 } timer_element;
 
+/* A level's timers. These are kept in a binary heap, ordered by timeout; of
+   timers with the same timeout, the one added to the queue most recently
+   comes first. There's also a hash table that finds timers by their arg. */
+struct timer_queue {
+    timer_element **heap;
+    unsigned int count, size;
+    unsigned int seq;   /* seq for the next timer to be added */
+    timer_element **byarg;      /* open addressing, NULL means empty */
+    unsigned int byarg_size;    /* 0, or a power of 2 */
+};
+
 #endif /* TIMEOUT_H */
 
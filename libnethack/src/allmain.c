@@ -289,6 +289,12 @@ nh_create_game(int fd, struct nh_option_desc *opts_orig)
         return NHCREATE_INVALID;
     }
 
+    if (analysis_is_open()) {
+        raw_print("Cannot create a game while a game is open for analysis");
+        API_EXIT();
+        return NHCREATE_FAIL;
+    }
+
     program_state.suppress_screen_updates = TRUE;
     program_state.followmode = FM_PLAY;
 
@@ -380,6 +386,11 @@ nh_play_game(int fd, enum nh_followmode followmode)
     if (fd < 0)
         return ERR_BAD_ARGS;
 
+    if (analysis_is_open()) {
+        raw_print("Cannot play a game while a game is open for analysis");
+        return ERR_IN_PROGRESS;
+    }
+
     switch (nh_get_savegame_status(fd, NULL)) {
     case LS_INVALID:
         return ERR_BAD_FILE;
@@ -532,6 +543,11 @@ just_reloaded_save:
             cmdidx = get_command_idx(cmd.cmd);
         }
 
+        /* The previous turn's output has been shown by now, and nothing has
+           acted on the new command yet, so this is where a deferred check of
+           the last save goes. */
+        log_run_deferred_save_verification(&cmd);
+
         if (cmdidx < 0) {
             pline(msgc_mispaste, "Unrecognised command '%s'", cmd.cmd);
             continue;
@@ -564,7 +580,7 @@ just_reloaded_save:
                 case DIR_W:
                 case DIR_N:
                     /* Move backwards one command. */
-                    log_sync(min(program_state.binary_save_location-1, 1),
+                    log_sync(max(program_state.binary_save_location-1, 1),
                              TLU_BYTES, FALSE);
                     goto just_reloaded_save;
                 case DIR_NW:
@@ -577,7 +593,7 @@ just_reloaded_save:
                     goto just_reloaded_save;
                 case DIR_NE:
                     /* Move backwards 50 turns. */
-                    log_sync(min(moves - 50, 1), TLU_TURNS, FALSE);
+                    log_sync(max(moves - 50, 1), TLU_TURNS, FALSE);
                     goto just_reloaded_save;
                 case DIR_SE:
                     /* Move forwards 50 turns. */
@@ -1190,7 +1206,7 @@ you_moved(void)
 
     /* We can only port to a new version of the save code when the player takes
        time (otherwise, the desync detector rightly gets confused). */
-    flags.save_encoding = saveenc_levelrel;
+    flags.save_encoding = saveenc_planar;
 }
 
 
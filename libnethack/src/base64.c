@@ -0,0 +1,378 @@
+/* vim:set cin ft=c sw=4 sts=4 ts=8 et ai cino=Ls\:0t0(0 : -*- mode:c;fill-column:80;tab-width:8;c-basic-offset:4;indent-tabs-mode:nil;c-file-style:"k&r" -*-*/
+/* Last modified by agent, 2026-10-17 */
+/* Copyright (c) NetHack Fourk DevTeam, 2026. */
+/* NetHack may be freely redistributed.  See license for details. */
+
+/* Base 64 block codec. Save backups and save diffs are several hundred KB of
+   base 64 apiece, and decoding them dominates loading and replaying games, so
+   on x86 we have SSSE3 and AVX2 versions of the inner loops as well as the
+   portable one, chosen at runtime. (The vectorized algorithms are those of
+   Wojciech Muła and Daniel Lemire.) */
+
+#include "base64.h"
+#include <stddef.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define BASE64_X86_KERNELS
+# include <immintrin.h>
+#endif
+
+const unsigned char b64e[64] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+const char b64d[256] = {
+    /* 32 control chars */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* ' ' - '/' */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 62, 0, 0, 0, 63,
+    /* '0' - '9' */ 52, 53, 54, 55, 56, 57, 58, 59, 60, 61,
+    /* ':' - '@' */ 0, 0, 0, 0, 0, 0, 0,
+    /* 'A' - 'Z' */ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16,
+    17, 18, 19, 20, 21, 22, 23, 24, 25,
+    /* '[' - '\'' */ 0, 0, 0, 0, 0, 0,
+    /* 'a' - 'z' */ 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51
+};
+
+/***** Portable kernels *****/
+
+static int
+encode_scalar(const unsigned char *in, char *out, int nblocks)
+{
+    int i;
+
+    for (i = 0; i < nblocks; i++, in += 3, out += 4) {
+        out[0] = b64e[in[0] >> 2];
+        out[1] = b64e[(in[0] & 0x03) << 4 | (in[1] & 0xf0) >> 4];
+        out[2] = b64e[(in[1] & 0x0f) << 2 | (in[2] & 0xc0) >> 6];
+        out[3] = b64e[in[2] & 0x3f];
+    }
+
+    return nblocks;
+}
+
+/* b64d maps both 'A' and invalid characters to 0, so we need to distinguish
+   them separately. */
+#define b64_valid(c) (b64d[(unsigned char)(c)] || (c) == 'A')
+
+static int
+decode_scalar(const char *in, unsigned char *out, int nblocks)
+{
+    int i;
+
+    for (i = 0; i < nblocks; i++, in += 4, out += 3) {
+        if (!b64_valid(in[0]) || !b64_valid(in[1]) ||
+            !b64_valid(in[2]) || !b64_valid(in[3]))
+            break;
+
+        out[0] = b64d[(unsigned char)in[0]] << 2 |
+            b64d[(unsigned char)in[1]] >> 4;
+        out[1] = b64d[(unsigned char)in[1]] << 4 |
+            b64d[(unsigned char)in[2]] >> 2;
+        out[2] = ((b64d[(unsigned char)in[2]] << 6) & 0xc0) |
+            b64d[(unsigned char)in[3]];
+    }
+
+    return i;
+}
+
+/***** x86 kernels *****/
+
+/* Each of these handles as many blocks as it can in whole vectors, and returns
+   the number of blocks it handled; the caller uses the portable kernel for the
+   rest. They never read or write outside the nblocks given, which means that
+   they have to stop a little early, because the loads and stores are slightly
+   wider than the data actually used. */
+
+#ifdef BASE64_X86_KERNELS
+
+# define SSSE3 __attribute__((target("ssse3")))
+# define AVX2 __attribute__((target("avx2")))
+
+/* Encoding: spread 12 bytes of input to 16 bytes with one 6-bit value each
+   (Muła's multiply-shift trick), then map the values to characters by adding
+   an offset depending on which range of the alphabet they fall into. */
+static inline SSSE3 __m128i
+encode_unpack_ssse3(__m128i in)
+{
+    in = _mm_shuffle_epi8(in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4,
+                                            7, 6, 8, 7, 10, 9, 11, 10));
+    __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t1, t3);
+}
+
+static inline SSSE3 __m128i
+encode_translate_ssse3(__m128i v)
+{
+    /* 0..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12; then 0..25 -> 13 */
+    __m128i r = _mm_subs_epu8(v, _mm_set1_epi8(51));
+    __m128i lt26 = _mm_cmpgt_epi8(_mm_set1_epi8(26), v);
+    r = _mm_or_si128(r, _mm_and_si128(lt26, _mm_set1_epi8(13)));
+    r = _mm_shuffle_epi8(_mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52,
+                                       '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                       '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                       '/' - 63, 'A', 0, 0), r);
+    return _mm_add_epi8(r, v);
+}
+
+static SSSE3 int
+encode_ssse3(const unsigned char *in, char *out, int nblocks)
+{
+    int i;
+
+    /* 16-byte loads, of which 12 bytes are used. */
+    for (i = 0; i + 6 <= nblocks; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + i * 3));
+        v = encode_translate_ssse3(encode_unpack_ssse3(v));
+        _mm_storeu_si128((__m128i *)(out + i * 4), v);
+    }
+
+    return i;
+}
+
+/* Decoding: check that every character is in the alphabet, and work out the
+   offset that maps it to its 6-bit value, by comparing against the ranges of
+   the alphabet; then pack four 6-bit values into three bytes with a pair of
+   multiply-adds. */
+static inline SSSE3 __m128i
+decode_range_ssse3(__m128i v, char lo, char hi)
+{
+    return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)),
+                         _mm_cmpgt_epi8(_mm_set1_epi8(hi + 1), v));
+}
+
+static SSSE3 int
+decode_ssse3(const char *in, unsigned char *out, int nblocks)
+{
+    int i;
+
+    /* 16-byte stores, of which 12 bytes are used. */
+    for (i = 0; i + 6 <= nblocks; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + i * 4));
+
+        __m128i upper = decode_range_ssse3(v, 'A', 'Z');
+        __m128i lower = decode_range_ssse3(v, 'a', 'z');
+        __m128i digit = decode_range_ssse3(v, '0', '9');
+        __m128i plus = _mm_cmpeq_epi8(v, _mm_set1_epi8('+'));
+        __m128i slash = _mm_cmpeq_epi8(v, _mm_set1_epi8('/'));
+        __m128i valid = _mm_or_si128(_mm_or_si128(upper, lower),
+                                     _mm_or_si128(digit,
+                                                  _mm_or_si128(plus, slash)));
+        if (_mm_movemask_epi8(valid) != 0xffff)
+            break;
+
+        __m128i shift = _mm_or_si128(
+            _mm_or_si128(_mm_and_si128(upper, _mm_set1_epi8(-65)),
+                         _mm_and_si128(lower, _mm_set1_epi8(-71))),
+            _mm_or_si128(_mm_and_si128(digit, _mm_set1_epi8(4)),
+                         _mm_or_si128(_mm_and_si128(plus, _mm_set1_epi8(19)),
+                                      _mm_and_si128(slash,
+                                                    _mm_set1_epi8(16)))));
+        v = _mm_add_epi8(v, shift);
+
+        v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+        v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+        v = _mm_shuffle_epi8(v, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8,
+                                              14, 13, 12, -1, -1, -1, -1));
+        _mm_storeu_si128((__m128i *)(out + i * 3), v);
+    }
+
+    return i;
+}
+
+/* The AVX2 versions are the same algorithms, on two 128-bit lanes at once. */
+static AVX2 int
+encode_avx2(const unsigned char *in, char *out, int nblocks)
+{
+    int i;
+
+    /* Two 16-byte loads, at offsets 0 and 12. */
+    for (i = 0; i + 10 <= nblocks; i += 8) {
+        __m256i v = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(
+                _mm_loadu_si128((const __m128i *)(in + i * 3))),
+            _mm_loadu_si128((const __m128i *)(in + i * 3 + 12)), 1);
+
+        v = _mm256_shuffle_epi8(v, _mm256_setr_epi8(
+                                    1, 0, 2, 1, 4, 3, 5, 4,
+                                    7, 6, 8, 7, 10, 9, 11, 10,
+                                    1, 0, 2, 1, 4, 3, 5, 4,
+                                    7, 6, 8, 7, 10, 9, 11, 10));
+        __m256i t0 = _mm256_and_si256(v, _mm256_set1_epi32(0x0fc0fc00));
+        __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+        __m256i t2 = _mm256_and_si256(v, _mm256_set1_epi32(0x003f03f0));
+        __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+        v = _mm256_or_si256(t1, t3);
+
+        __m256i r = _mm256_subs_epu8(v, _mm256_set1_epi8(51));
+        __m256i lt26 = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), v);
+        r = _mm256_or_si256(r, _mm256_and_si256(lt26, _mm256_set1_epi8(13)));
+        r = _mm256_shuffle_epi8(_mm256_setr_epi8(
+                                    'a' - 26, '0' - 52, '0' - 52, '0' - 52,
+                                    '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                    '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                    '/' - 63, 'A', 0, 0,
+                                    'a' - 26, '0' - 52, '0' - 52, '0' - 52,
+                                    '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                    '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                    '/' - 63, 'A', 0, 0), r);
+        v = _mm256_add_epi8(r, v);
+
+        _mm256_storeu_si256((__m256i *)(out + i * 4), v);
+    }
+
+    return i;
+}
+
+static inline AVX2 __m256i
+decode_range_avx2(__m256i v, char lo, char hi)
+{
+    return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(lo - 1)),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), v));
+}
+
+static AVX2 int
+decode_avx2(const char *in, unsigned char *out, int nblocks)
+{
+    int i;
+
+    /* 32-byte stores, of which 24 bytes are used. */
+    for (i = 0; i + 11 <= nblocks; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(in + i * 4));
+
+        __m256i upper = decode_range_avx2(v, 'A', 'Z');
+        __m256i lower = decode_range_avx2(v, 'a', 'z');
+        __m256i digit = decode_range_avx2(v, '0', '9');
+        __m256i plus = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('+'));
+        __m256i slash = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('/'));
+        __m256i valid = _mm256_or_si256(
+            _mm256_or_si256(upper, lower),
+            _mm256_or_si256(digit, _mm256_or_si256(plus, slash)));
+        if ((unsigned)_mm256_movemask_epi8(valid) != 0xffffffffU)
+            break;
+
+        __m256i shift = _mm256_or_si256(
+            _mm256_or_si256(_mm256_and_si256(upper, _mm256_set1_epi8(-65)),
+                            _mm256_and_si256(lower, _mm256_set1_epi8(-71))),
+            _mm256_or_si256(
+                _mm256_and_si256(digit, _mm256_set1_epi8(4)),
+                _mm256_or_si256(_mm256_and_si256(plus, _mm256_set1_epi8(19)),
+                                _mm256_and_si256(slash,
+                                                 _mm256_set1_epi8(16)))));
+        v = _mm256_add_epi8(v, shift);
+
+        v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+        v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+        v = _mm256_shuffle_epi8(v, _mm256_setr_epi8(
+                                    2, 1, 0, 6, 5, 4, 10, 9, 8,
+                                    14, 13, 12, -1, -1, -1, -1,
+                                    2, 1, 0, 6, 5, 4, 10, 9, 8,
+                                    14, 13, 12, -1, -1, -1, -1));
+        /* Each lane now has 12 bytes at the bottom; make them contiguous. */
+        v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 1, 2, 4, 5, 6,
+                                                             3, 7));
+        _mm256_storeu_si256((__m256i *)(out + i * 3), v);
+    }
+
+    return i;
+}
+
+#endif /* BASE64_X86_KERNELS */
+
+/***** Dispatch *****/
+
+struct base64_kernel_info {
+    const char *name;
+    int (*encode)(const unsigned char *, char *, int);
+    int (*decode)(const char *, unsigned char *, int);
+};
+
+static const struct base64_kernel_info kernels[B64K_COUNT] = {
+    [B64K_AUTO] = {"auto", NULL, NULL},
+    [B64K_SCALAR] = {"scalar", encode_scalar, decode_scalar},
+#ifdef BASE64_X86_KERNELS
+    [B64K_SSSE3] = {"ssse3", encode_ssse3, decode_ssse3},
+    [B64K_AVX2] = {"avx2", encode_avx2, decode_avx2},
+#else
+    [B64K_SSSE3] = {"ssse3", NULL, NULL},
+    [B64K_AVX2] = {"avx2", NULL, NULL},
+#endif
+};
+
+/* The kernel in use; B64K_AUTO until the first call works out which one that
+   should be. This only ever changes from one correct kernel to another, so it
+   doesn't need to be saved or reset along with the game state. */
+static enum base64_kernel current_kernel = B64K_AUTO;
+
+static int
+kernel_supported(enum base64_kernel kernel)
+{
+    switch (kernel) {
+    case B64K_SCALAR:
+        return 1;
+#ifdef BASE64_X86_KERNELS
+    case B64K_SSSE3:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("ssse3");
+    case B64K_AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return 0;
+    }
+}
+
+static const struct base64_kernel_info *
+get_kernel(void)
+{
+    if (current_kernel == B64K_AUTO) {
+        if (kernel_supported(B64K_AVX2))
+            current_kernel = B64K_AVX2;
+        else if (kernel_supported(B64K_SSSE3))
+            current_kernel = B64K_SSSE3;
+        else
+            current_kernel = B64K_SCALAR;
+    }
+    return &kernels[current_kernel];
+}
+
+int
+base64_set_kernel(enum base64_kernel kernel)
+{
+    if (kernel == B64K_AUTO) {
+        current_kernel = B64K_AUTO;
+        return 1;
+    }
+    if (kernel < 0 || kernel >= B64K_COUNT || !kernel_supported(kernel))
+        return 0;
+    current_kernel = kernel;
+    return 1;
+}
+
+const char *
+base64_kernel_name(enum base64_kernel kernel)
+{
+    if (kernel == B64K_AUTO)
+        kernel = get_kernel() - kernels;
+    if (kernel < 0 || kernel >= B64K_COUNT)
+        return "unknown";
+    return kernels[kernel].name;
+}
+
+void
+base64_encode_blocks(const unsigned char *in, char *out, int nblocks)
+{
+    int done = get_kernel()->encode(in, out, nblocks);
+
+    encode_scalar(in + done * 3, out + done * 4, nblocks - done);
+}
+
+int
+base64_decode_blocks(const char *in, unsigned char *out, int nblocks)
+{
+    int done = get_kernel()->decode(in, out, nblocks);
+
+    return done + decode_scalar(in + done * 4, out + done * 3, nblocks - done);
+}
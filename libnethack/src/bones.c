@@ -6,6 +6,12 @@
 #include "hack.h"
 #include "lev.h"
 
+/* The level in a bones file is laid out according to the save encoding of the
+   game that wrote it, so the encoding is stored after the version, with this
+   bit set to distinguish it from the length of the bones id that comes next
+   (older bones files start there). */
+#define BONES_ENCODING_FLAG 0x80
+
 static boolean no_bones_level(d_level *);
 static void goodfruit(int);
 static void resetobjs(struct obj *, boolean);
@@ -400,6 +406,7 @@ make_bones:
     store_version(&mf);
     /* no tagging is useful here, as the tags in bones memfiles aren't used for 
        anything anyway */
+    mwrite8(&mf, BONES_ENCODING_FLAG | flags.save_encoding);
     mwrite8(&mf, c);
     mwrite(&mf, bonesid, (unsigned)c);  /* DD.nnn */
     savefruitchn(&mf);
@@ -416,7 +423,7 @@ make_bones:
 int
 getbones(d_level *levnum)
 {
-    int ok;
+    int ok, encoding = 0, save_encoding;
     char c, bonesid[13], oldbonesid[13];
     struct memfile mf;
     boolean from_file = FALSE;
@@ -470,7 +477,22 @@ getbones(d_level *levnum)
     log_record_bones(&mf);
 
     bonesfn = bones_filename(bonesid);
-    if ((ok = uptodate(&mf, bonesfn)) == 0) {
+    if ((ok = uptodate(&mf, bonesfn)) != 0) {
+        c = mread8(&mf);       /* encoding, or length incl. '\0' */
+        if ((unsigned char)c & BONES_ENCODING_FLAG) {
+            encoding = (unsigned char)c & ~BONES_ENCODING_FLAG;
+            if (encoding > saveenc_planar)
+                ok = FALSE;     /* from a later version */
+            c = mread8(&mf);
+        } else {
+            /* Written before the encoding was recorded, when a bones file was
+               read with the loading game's encoding; the interleaved location
+               layout was the only one. */
+            encoding = min(flags.save_encoding, saveenc_levelrel);
+        }
+    }
+
+    if (!ok) {
         if (!wizard)
             pline(msgc_saveload,
                   "Discarding unuseable bones; no need to panic...");
@@ -479,7 +501,6 @@ getbones(d_level *levnum)
         if (wizard && yn("Get bones?") == 'n')
             goto fail;
 
-        c = mread8(&mf);       /* length incl. '\0' */
         mread(&mf, oldbonesid, (unsigned)c);    /* DD.nnn */
         if (strcmp(bonesid, oldbonesid) != 0) {
             const char *errbuf;
@@ -495,7 +516,12 @@ getbones(d_level *levnum)
             trickery(errbuf);
         } else {
             struct monst *mtmp;
-            struct level *lev = getlev(&mf, ledger_no(levnum), TRUE);
+            struct level *lev;
+
+            save_encoding = flags.save_encoding;
+            flags.save_encoding = encoding;
+            lev = getlev(&mf, ledger_no(levnum), TRUE);
+            flags.save_encoding = save_encoding;
 
             /* Note that getlev() now keeps tabs on unique monsters such as
                demon lords, and tracks the birth counts of all species just as
@@ -118,7 +118,7 @@ describe_level(char *buf)
     return ret;
 }
 
-static void
+void
 make_player_info(struct nh_player_info *pi)
 {
     int cap, advskills, i;
@@ -49,6 +49,10 @@ static int wiz_mon_polycontrol(const struct nh_cmd_arg *);
 static int wiz_togglegen(const struct nh_cmd_arg *);
 static int wiz_show_wmodes(const struct nh_cmd_arg *);
 static int wiz_show_stats(const struct nh_cmd_arg *);
+static int wiz_save_stats(const struct nh_cmd_arg *);
+static int wiz_rng_speed(const struct nh_cmd_arg *);
+static int wiz_rng_profile(const struct nh_cmd_arg *);
+static int wiz_sense_stats(const struct nh_cmd_arg *);
 static void count_obj(struct obj *, long *, long *, boolean, boolean);
 static void obj_chain(struct nh_menulist *, const char *, struct obj *, long *,
                       long *);
@@ -273,8 +277,16 @@ const struct cmd_desc cmdlist[] = {
      CMD_DEBUG | CMD_NOTIME | CMD_EXT},
     {"rewind", "(DEBUG) permanently undo gamestate changes", 0, 0, TRUE,
      wiz_rewind, CMD_DEBUG | CMD_NOTIME | CMD_EXT},
+    {"rngprofile", "(DEBUG) show which code uses random numbers", 0, 0, TRUE,
+     wiz_rng_profile, CMD_DEBUG | CMD_EXT | CMD_NOTIME},
+    {"rngspeed", "(DEBUG) measure the speed of the random number generator", 0,
+     0, TRUE, wiz_rng_speed, CMD_DEBUG | CMD_EXT | CMD_NOTIME},
+    {"savestats", "(DEBUG) show what takes up space in the save", 0, 0, TRUE,
+     wiz_save_stats, CMD_DEBUG | CMD_EXT | CMD_NOTIME},
     {"seenv", "(DEBUG) show seen vectors", 0, 0, TRUE, wiz_show_seenv,
      CMD_DEBUG | CMD_EXT | CMD_NOTIME},
+    {"sensestats", "(DEBUG) show how well monster sensing is cached", 0, 0,
+     TRUE, wiz_sense_stats, CMD_DEBUG | CMD_EXT | CMD_NOTIME},
     {"showmap", "(DEBUG) reveal the entire map", 0, 0, TRUE, wiz_map,
      CMD_DEBUG | CMD_EXT},
     {"stats", "(DEBUG) show memory statistics", 0, 0, TRUE, wiz_show_stats,
@@ -1507,6 +1519,126 @@ wiz_show_stats(const struct nh_cmd_arg *arg)
     return 0;
 }
 
+/*
+ * Display how much of the save file each tag type and level accounts for, and
+ * how much of it has changed since the last save.
+ */
+static int
+wiz_save_stats(const struct nh_cmd_arg *arg)
+{
+    struct nh_menulist menu;
+    struct memfile mf;
+    struct memfile_usage usage;
+    int i;
+
+    (void) arg;
+
+    if (!program_state.binary_save_allocated) {
+        pline(msgc_cancelled, "There is no save to compare against yet.");
+        return 0;
+    }
+
+    mnew(&mf, &program_state.binary_save);
+    savegame(&mf);
+    mdiffflush(&mf, 1);
+    maccount(&mf, &usage);
+    log_save_stats(&mf, "request");
+
+    init_menulist(&menu);
+    add_menutext(&menu, msgprintf("Save size %d bytes, diff %d bytes:",
+                                  mf.pos, mf.diffpos));
+    add_menutext(&menu, "");
+    add_menutext(&menu, "                       written  changed");
+    for (i = 0; i <= MTAG_COUNT; i++)
+        if (usage.bytype[i].written)
+            add_menutext(&menu, msgprintf(
+                             "%-22s %7ld  %7ld", mtag_name(i),
+                             usage.bytype[i].written, usage.bytype[i].changed));
+    add_menutext(&menu, "");
+    for (i = 0; i < ARRAY_SIZE(usage.bylevel); i++)
+        if (usage.bylevel[i].written)
+            add_menutext(&menu, msgprintf(
+                             "%-22s %7ld  %7ld",
+                             i ? msgprintf("level %d", i) : "not in a level",
+                             usage.bylevel[i].written, usage.bylevel[i].changed));
+
+    mfree(&mf);
+
+    display_menu(&menu, NULL, PICK_NONE, PLHINT_ANYWHERE, NULL);
+    return 0;
+}
+
+static int
+wiz_rng_speed(const struct nh_cmd_arg *arg)
+{
+    struct nh_menulist menu;
+    const char *name;
+    long per_second;
+    boolean usable;
+    int i;
+
+    (void) arg;
+
+    init_menulist(&menu);
+    add_menutext(&menu, "Random numbers per second, by SHA-256 kernel:");
+    add_menutext(&menu, "");
+    for (i = 0; ; i++) {
+        usable = rng_benchmark_kernel(i, &name, &per_second);
+        if (!name)
+            break;
+        if (usable)
+            add_menutext(&menu, msgprintf("%-12s %10ld", name, per_second));
+        else
+            add_menutext(&menu, msgprintf("%-12s (not supported here)", name));
+    }
+
+    display_menu(&menu, NULL, PICK_NONE, PLHINT_ANYWHERE, NULL);
+    return 0;
+}
+
+/*
+ * Show how many random numbers each RNG and each caller has used (see
+ * rng_profile_report()). If profiling wasn't on, this turns it on instead.
+ */
+static int
+wiz_rng_profile(const struct nh_cmd_arg *arg)
+{
+    struct nh_menulist menu;
+
+    (void) arg;
+
+    if (!rng_profile_active()) {
+        rng_profile_start();
+        pline(msgc_actionok,
+              "RNG profiling is now on; use this command again for a report.");
+        return 0;
+    }
+
+    init_menulist(&menu);
+    rng_profile_report(&menu);
+    display_menu(&menu, "Random number usage", PICK_NONE, PLHINT_ANYWHERE,
+                 NULL);
+    return 0;
+}
+
+/*
+ * Shows the hit rate of the msensem memo, and roughly how much time it has
+ * saved.
+ */
+static int
+wiz_sense_stats(const struct nh_cmd_arg *arg)
+{
+    struct nh_menulist menu;
+
+    (void) arg;
+
+    init_menulist(&menu);
+    msensem_memo_report(&menu);
+    display_menu(&menu, "Monster sensing memo", PICK_NONE, PLHINT_ANYWHERE,
+                 NULL);
+    return 0;
+}
+
 boolean
 dir_to_delta(enum nh_direction dir, schar * dx, schar * dy, schar * dz)
 {
@@ -355,6 +355,7 @@ init_data(boolean including_program_state)
     wailmsg = 0;
     bhitpos.x = bhitpos.y = 0;
     migrating_mons = NULL;
+    mon_index_free(migrating_mon_index());
     artilist = NULL;
     gamestate.unique_ids.branch = 0;
     histevents = NULL;
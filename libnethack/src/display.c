@@ -1148,6 +1148,9 @@ see_monsters(boolean reroll_hallucinated_appearances)
     if (!level)
         return; /* can be called during startup, before any level exists */
 
+    /* Redrawing doesn't change what anyone can sense, so msensem results can
+       be reused for the whole loop. */
+    msensem_memo_begin();
     for (mon = level->monlist; mon; mon = mon->nmon) {
         if (DEADMONSTER(mon))
             continue;
@@ -1159,6 +1162,7 @@ see_monsters(boolean reroll_hallucinated_appearances)
     /* when mounted, hero's location gets caught by monster loop */
     if (!u.usteed)
         newsym(u.ux, u.uy);
+    msensem_memo_end();
 }
 
 /*
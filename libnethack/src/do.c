@@ -1000,6 +1000,7 @@ goto_level(d_level * newlevel, boolean at_stairs, boolean falling,
     reset_rndmonst(NON_PM);     /* u.uz change affects monster generation */
 
     origlev = level;
+    mark_level_dirty(origlev);
     level = NULL;
 
     if (!levels[new_ledger]) {
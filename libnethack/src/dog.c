@@ -228,6 +228,7 @@ losedogs(void)
                 migrating_mons = mtmp->nmon;
             else
                 mtmp0->nmon = mtmp->nmon;
+            mon_index_remove(migrating_mon_index(), mtmp);
             mon_arrive(mtmp, FALSE);
         } else
             mtmp0 = mtmp;
@@ -246,6 +247,7 @@ mon_arrive(struct monst *mtmp, boolean with_you)
     mtmp->dlevel = level;
     mtmp->nmon = level->monlist;
     level->monlist = mtmp;
+    mon_index_add(&level->monindex, mtmp);
     if (mtmp->isshk)
         set_residency(mtmp, FALSE);
 
@@ -269,14 +271,10 @@ mon_arrive(struct monst *mtmp, boolean with_you)
 
     for (otmp = mtmp->minvent; otmp; otmp = otmp->nobj) {
         if (!otmp->olev && otmp->timed) {
-            struct timer_element *tmr;
-            int fixed = 0;
-            for (tmr = level->lev_timers; tmr; tmr = tmr->next) {
-                if (tmr->arg == (void *) otmp) {
-                    otmp->olev = level;
-                    fixed++;
-                }
-            }
+            int fixed = count_timers_with_arg(level, otmp);
+
+            if (fixed)
+                otmp->olev = level;
             if (otmp->timed > fixed) {
                 panic("Unhandled timed obj %s carried by %s, try again "
                       "later", killer_xname(otmp), k_monnam(mtmp));
@@ -670,6 +668,7 @@ migrate_to_level(struct monst *mtmp, xchar tolev,       /* destination level */
     relmon(mtmp);
     mtmp->nmon = migrating_mons;
     migrating_mons = mtmp;
+    mon_index_add(migrating_mon_index(), mtmp);
     if (mtmp->dlevel == level)
         newsym(mtmp->mx, mtmp->my);
 
@@ -271,14 +271,9 @@ ceiling(int x, int y)
 struct engr *
 engr_at(struct level *lev, xchar x, xchar y)
 {
-    struct engr *ep = lev->lev_engr;
-
-    while (ep) {
-        if (x == ep->engr_x && y == ep->engr_y)
-            return ep;
-        ep = ep->nxt_engr;
-    }
-    return NULL;
+    if (!isok(x, y))
+        return NULL;
+    return lev->engravings[x][y];
 }
 
 /* Decide whether a particular string is engraved at a specified
@@ -416,6 +411,7 @@ make_engr_at(struct level *lev, int x, int y, const char *s, long e_time,
 
     engr_len = strlen(s);
 
+    mark_level_dirty(lev);
     if ((ep = engr_at(lev, x, y)) != 0)
         del_engr(ep, lev);
     ep = newengr(engr_len + 1);
@@ -426,6 +422,7 @@ make_engr_at(struct level *lev, int x, int y, const char *s, long e_time,
     lev->lev_engr = ep;
     ep->engr_x = x;
     ep->engr_y = y;
+    lev->engravings[x][y] = ep;
     ep->engr_txt = (char *)(ep + 1);
     strncpy(ep->engr_txt, s, engr_len);
     ep->engr_txt[engr_len] = '\0';
@@ -1388,6 +1385,7 @@ free_engravings(struct level *lev)
         ep = ep2;
     }
     lev->lev_engr = NULL;
+    memset(lev->engravings, 0, sizeof lev->engravings);
 }
 
 
@@ -1437,11 +1435,18 @@ rest_engravings(struct memfile *mf, struct level *lev)
         ep = enext;
     }
     lev->lev_engr = eprev;
+
+    /* if there are several engravings on a square, engr_at finds the first */
+    memset(lev->engravings, 0, sizeof lev->engravings);
+    for (ep = lev->lev_engr; ep; ep = ep->nxt_engr)
+        if (!lev->engravings[ep->engr_x][ep->engr_y])
+            lev->engravings[ep->engr_x][ep->engr_y] = ep;
 }
 
 void
 del_engr(struct engr *ep, struct level *lev)
 {
+    mark_level_dirty(lev);
     if (ep == lev->lev_engr) {
         lev->lev_engr = ep->nxt_engr;
     } else {
@@ -1460,6 +1465,8 @@ del_engr(struct engr *ep, struct level *lev)
             return;
         }
     }
+    if (lev->engravings[ep->engr_x][ep->engr_y] == ep)
+        lev->engravings[ep->engr_x][ep->engr_y] = NULL;
     dealloc_engr(ep);
 }
 
@@ -1476,8 +1483,11 @@ rloc_engr(struct engr *ep)
         ty = rn2(ROWNO);
     } while (engr_at(level, tx, ty) || !goodpos(level, tx, ty, NULL, 0));
 
+    if (level->engravings[ep->engr_x][ep->engr_y] == ep)
+        level->engravings[ep->engr_x][ep->engr_y] = NULL;
     ep->engr_x = tx;
     ep->engr_y = ty;
+    level->engravings[tx][ty] = ep;
 }
 
 
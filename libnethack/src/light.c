@@ -65,6 +65,7 @@ new_light_source(struct level *lev, xchar x, xchar y, int range, int type,
     ls->id = id;
     ls->flags = 0;
     lev->lev_lights = ls;
+    mark_level_dirty(lev);
 
     turnstate.vision_full_recalc = TRUE;     /* make the source show up */
 }
@@ -106,6 +107,7 @@ del_light_source(struct level *lev, int type, void *id)
                 lev->lev_lights = curr->next;
 
             free(curr);
+            mark_level_dirty(lev);
             turnstate.vision_full_recalc = TRUE;
             return;
         }
@@ -193,13 +195,13 @@ find_mid(struct level *lev, unsigned nid, unsigned fmflags)
     if (!nid)
         return &youmonst;
     if (fmflags & FM_FMON)
-        for (mtmp = lev->monlist; mtmp; mtmp = mtmp->nmon)
-            if (!DEADMONSTER(mtmp) && mtmp->m_id == nid)
-                return mtmp;
+        if ((mtmp = mon_index_find(&lev->monindex, nid, TRUE)))
+            return mtmp;
     if (fmflags & FM_MIGRATE)
-        for (mtmp = migrating_mons; mtmp; mtmp = mtmp->nmon)
-            if (mtmp->m_id == nid)
-                return mtmp;
+        if ((mtmp = mon_index_find(migrating_mon_index(), nid, FALSE)))
+            return mtmp;
+    /* migrating_pets is only non-empty during a level change, and then holds
+       only the pets that came along, so it isn't worth indexing */
     if (fmflags & FM_MYDOGS)
         for (mtmp = turnstate.migrating_pets; mtmp; mtmp = mtmp->nmon)
             if (mtmp->m_id == nid)
@@ -217,6 +219,8 @@ transfer_lights(struct level *oldlev, struct level *newlev, unsigned int obj_id)
     if (newlev == oldlev)
         return;
 
+    mark_level_dirty(oldlev);
+    mark_level_dirty(newlev);
     for (prev = &oldlev->lev_lights; (curr = *prev) != 0;) {
         switch (curr->type) {
         case LS_OBJECT:
@@ -434,6 +438,7 @@ obj_move_light_source(struct obj *src, struct obj *dest)
 {
     light_source *ls;
 
+    mark_level_dirty(src->olev);
     for (ls = src->olev->lev_lights; ls; ls = ls->next)
         if (ls->type == LS_OBJECT && ls->id == src)
             ls->id = dest;
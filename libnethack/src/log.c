@@ -6,6 +6,7 @@
 #include "hack.h"
 #include "patchlevel.h"
 #include "iomodes.h"
+#include "base64.h"
 #include <zlib.h>
 /* stdint.h, inttypes.h let us printf long longs portably */
 #define __STDC_FORMAT_MACROS
@@ -14,6 +15,9 @@
 #include <limits.h>
 #include <errno.h>
 #include <time.h>
+#ifndef AIMAKE_BUILDOS_MSWin32
+# include <sys/uio.h>
+#endif
 
 /* #define DEBUG */
 
@@ -21,15 +25,31 @@
 
 static void log_reset(void);
 static void log_binary(const char *buf, int buflen);
+static void log_flush(void);
+static void log_discard_queue(void);
 static long get_log_offset(void);
 static long get_log_last_newline(int);
-static char *lgetline_malloc(int);
+static char *lgetline(int);
+static void lgetline_sync(void);
+static long log_lseek(int, long, int);
 
 static enum nh_log_status read_log_header(
     int fd, struct nh_game_info *si, int *recovery_count, boolean do_locking);
 
 static void load_gamestate_from_binary_save(boolean maybe_old_version);
 static void log_replay_save_line(void);
+static void save_index_reset(void);
+static void read_save_verify_policy(void);
+static void read_save_compression_level(void);
+static void read_log_durability_policy(void);
+static void log_commit(boolean turn_boundary);
+static boolean want_save_verification(boolean is_backup);
+static void verify_save_diff(struct memfile *diff_base);
+static void skip_save_verification(long end_of_save_line);
+static void defer_save_verification(struct memfile *diff_base,
+                                    long recover_location,
+                                    long end_of_save_line);
+static void discard_deferred_save_verification(void);
 
 static boolean full_read(int fd, void *buffer, int len);
 static boolean full_write(int fd, const void *buffer, int len);
@@ -179,6 +199,10 @@ log_recover_core(long offset, boolean canreturn, const char *message,
 
     program_state.emergency_recover_location = 0;
 
+    /* If we're partway through updating the log, write what we have so far, so
+       that the file looks the way the recovery code expects. */
+    log_flush();
+
     if (program_state.followmode != FM_PLAY && message) {
         program_state.in_zero_time_command = TRUE; /* so menus work */
 
@@ -206,7 +230,7 @@ log_recover_core(long offset, boolean canreturn, const char *message,
        If it isn't, the recover will have to be done manually. */
 
     if (offset > 0) {
-        lseek(program_state.logfile, offset - 1, SEEK_SET);
+        log_lseek(program_state.logfile, offset - 1, SEEK_SET);
         ok = full_read(program_state.logfile, newline_check, 1);
         if (ok && *newline_check != '\n')
             ok = FALSE;
@@ -221,7 +245,7 @@ log_recover_core(long offset, boolean canreturn, const char *message,
         terminate(ERR_IN_PROGRESS); /* cannot panic */
     }
 
-    if (offset * 9 < lseek(program_state.logfile, 0, SEEK_END)) {
+    if (offset * 9 < log_lseek(program_state.logfile, 0, SEEK_END)) {
         log_reset();
         /* the location to recover to has probably been calculated incorrectly;
            force a manual recover rather than losing data */
@@ -247,7 +271,7 @@ log_recover_core(long offset, boolean canreturn, const char *message,
                      "The game can be recovered from a backup save.");
         buf = msgprintf("This will lose about %.4g%% of your progress.",
                         100.0 * (1.0 - ((float)offset /
-                                        lseek(program_state.logfile, 0,
+                                        log_lseek(program_state.logfile, 0,
                                               SEEK_END))));
         add_menutext(&menu, buf);
 
@@ -312,7 +336,7 @@ log_recover_core(long offset, boolean canreturn, const char *message,
                         program_state.expected_recovery_count,
                         VERSION_MAJOR, VERSION_MINOR, PATCHLEVEL);
 
-        lseek(program_state.logfile, 0, SEEK_SET);
+        log_lseek(program_state.logfile, 0, SEEK_SET);
         if (!full_write(program_state.logfile, buf, strlen(buf))) {
             /* This is bad enough to panic, but we can't panic, so... */
             raw_printf("Could not write to save file to recover it!\n");
@@ -320,6 +344,7 @@ log_recover_core(long offset, boolean canreturn, const char *message,
         }
 
         /* Truncate the file. */
+        lgetline_sync();
         if (ftruncate(program_state.logfile, offset) < 0) {
             raw_printf("Could not truncate save file during recovery!\n");
             terminate(ERR_RESTORE_FAILED);
@@ -376,14 +401,13 @@ log_maybe_undo_quit(void)
                     &program_state.expected_recovery_count, FALSE);
 
     lastline = get_log_last_newline(2);
-    lseek(program_state.logfile, lastline, SEEK_SET);
-    logline = lgetline_malloc(program_state.logfile);
+    log_lseek(program_state.logfile, lastline, SEEK_SET);
+    logline = lgetline(program_state.logfile);
     if (!logline) /* perhaps someone else didn't lock correctly? */
         error_reading_save("penultimate newline was past EOF");
 
     if (strcmp(logline, "Q") == 0)
         log_recover_core(lastline, FALSE, NULL, __FILE__, __LINE__);
-    free(logline);
 
     if (!change_fd_lock(program_state.logfile, TRUE, LT_MONITOR, 2))
         panic("Could not downgrade to monitor lock on logfile");
@@ -392,7 +416,7 @@ log_maybe_undo_quit(void)
 /* The save file was in a correct format, but referred to something that
    couldn't possibly happen in the gamestate. This should only be called if
    there have been no logfile operations (except change_fd_lock) since an
-   lgetline_malloc() of the offending line; start_replaying_logfile() leaves the
+   lgetline() of the offending line; start_replaying_logfile() leaves the
    logfile in the right state. */
 static noreturn void
 log_desync(char found, char expected)
@@ -434,19 +458,17 @@ log_desync(char found, char expected)
         panic("Could not upgrade to read lock on logfile");
 
     /* Can we find some future save point to restore to? */
-    while ((logline = lgetline_malloc(program_state.logfile))) {
+    while ((logline = lgetline(program_state.logfile))) {
 
         if (*logline == '~' || *logline == '*') {
 
             /* Yes. */
             if (!change_fd_lock(program_state.logfile, TRUE, LT_MONITOR, 2))
                 panic("Could not downgrade to monitor lock on logfile");
-            free(logline);
             /* TODO: get this to restart at the log offset, somehow */
             terminate(RESTART_PLAY);
         }
 
-        free(logline);
     }
 
     /* No. */
@@ -457,20 +479,29 @@ log_desync(char found, char expected)
 
 /***** Base 64 handling *****/
 
-static const unsigned char b64e[64] =
-    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-static const char b64d[256] = {
-    /* 32 control chars */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    /* ' ' - '/' */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 62, 0, 0, 0, 63,
-    /* '0' - '9' */ 52, 53, 54, 55, 56, 57, 58, 59, 60, 61,
-    /* ':' - '@' */ 0, 0, 0, 0, 0, 0, 0,
-    /* 'A' - 'Z' */ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16,
-    17, 18, 19, 20, 21, 22, 23, 24, 25,
-    /* '[' - '\'' */ 0, 0, 0, 0, 0, 0,
-    /* 'a' - 'z' */ 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
-    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51
-};
+/* The zlib compression level used for binary data in the log (mostly save
+   backups and save diffs), set from NH4SAVECOMPRESS. Any level produces data
+   in the same format, so this can be changed freely from one process to the
+   next; lower levels trade file size for CPU time. 0 turns compression off
+   entirely. */
+static int save_compression_level = Z_BEST_COMPRESSION;
+
+static void
+read_save_compression_level(void)
+{
+    const char *level = nh_getenv("NH4SAVECOMPRESS");
+
+    save_compression_level = Z_BEST_COMPRESSION;
+
+    if (!level || !*level)
+        return;
+
+    if (level[0] >= '0' && level[0] <= '9' && !level[1])
+        save_compression_level = level[0] - '0';
+    else
+        paniclog("save_compress",
+                 "NH4SAVECOMPRESS is not a digit; using maximum compression");
+}
 
 static int
 base64size(int n)
@@ -478,33 +509,34 @@ base64size(int n)
     return compressBound(n) * 4 / 3 + 4 + 12;   /* 12 for $4294967296$ */
 }
 
-static void
+/* Returns the length of the encoded string. */
+static int
 base64_encode_binary(const unsigned char *in, char *out, int len)
 {
     int i, pos, rem;
     unsigned long olen = compressBound(len);
-    unsigned char *o = malloc(olen);
+    unsigned char *o = NULL;
 
-    if (compress2(o, &olen, in, len, Z_BEST_COMPRESSION) != Z_OK) {
-        panic("Could not compress input data!");
-    }
-    MARK_INITIALIZED(o, olen);
+    pos = 0;
+    if (save_compression_level > 0) {
+        o = malloc(olen);
+        if (compress2(o, &olen, in, len, save_compression_level) != Z_OK) {
+            panic("Could not compress input data!");
+        }
+        MARK_INITIALIZED(o, olen);
 
-    pos = sprintf(out, "$%d$", len);
+        pos = sprintf(out, "$%d$", len);
+    }
 
-    if (pos + olen >= len) {
+    if (!o || pos + olen >= len) {
         pos = 0;
         olen = len;
     } else
         in = o;
 
-    for (i = 0; i < (olen / 3) * 3; i += 3) {
-        out[pos] = b64e[in[i] >> 2];
-        out[pos + 1] = b64e[(in[i] & 0x03) << 4 | (in[i + 1] & 0xf0) >> 4];
-        out[pos + 2] = b64e[(in[i + 1] & 0x0f) << 2 | (in[i + 2] & 0xc0) >> 6];
-        out[pos + 3] = b64e[in[i + 2] & 0x3f];
-        pos += 4;
-    }
+    base64_encode_blocks(in, out + pos, olen / 3);
+    i = (olen / 3) * 3;
+    pos += (olen / 3) * 4;
 
     rem = olen - i;
     if (rem > 0) {
@@ -520,6 +552,7 @@ base64_encode_binary(const unsigned char *in, char *out, int len)
     free(o);
 
     out[pos] = '\0';
+    return pos;
 }
 
 
@@ -543,7 +576,7 @@ base64_strlen(const char *in)
 static void
 base64_decode(const char *in, char *out, int outlen)
 {
-    int i, len = strlen(in), pos = 0, olen;
+    int i, n, len = strlen(in), pos = 0, olen;
     char *o = out;
 
     olen = outlen;
@@ -570,6 +603,17 @@ base64_decode(const char *in, char *out, int outlen)
                 ((b64d[(int)in[i + 2]] << 6) & 0xc0) | b64d[(int)in[i + 3]];
         pos += 3;
 
+        /* Decode as much of the rest as possible in bulk, leaving the last
+           block (which may have padding) for the code above. The bulk decoder
+           stops early if it sees anything unusual, such as a '$'. */
+        n = (len - i) / 4 - 2;
+        if (n > (olen - pos) / 3)
+            n = (olen - pos) / 3;
+        if (n > 0) {
+            n = base64_decode_blocks(in + i + 4, (unsigned char *)o + pos, n);
+            i += n * 4;
+            pos += n * 3;
+        }
     }
 
     i -= 4;
@@ -620,7 +664,10 @@ static boolean
 full_read(int fd, void *buffer, int len)
 {
     int rv;
-    long o = lseek(fd, 0, SEEK_CUR);
+    long o;
+
+    lgetline_sync();
+    o = lseek(fd, 0, SEEK_CUR);
     errno = 0;
     rv = read(fd, buffer, len);
     if (rv < 0 && errno == EINTR) {
@@ -637,7 +684,10 @@ static boolean
 full_write(int fd, const void *buffer, int len)
 {
     int rv;
-    long o = lseek(fd, 0, SEEK_CUR);
+    long o;
+
+    lgetline_sync();
+    o = lseek(fd, 0, SEEK_CUR);
     errno = 0;
     rv = write(fd, buffer, len);
     if (rv < 0 && errno == EINTR) {
@@ -652,6 +702,138 @@ full_write(int fd, const void *buffer, int len)
 }
 
 
+/* Writes to the log don't happen immediately. Instead, they're queued up until
+   the end of the log update (stop_updating_logfile), or until something needs
+   the file itself to be up to date, and then written with a single writev().
+   A line is typically built from several pieces (e.g. "~", base 64 data, and a
+   newline), so this saves system calls. Short pieces are copied into a staging
+   buffer; long ones are queued in place, and freed once they're written.
+
+   The queue must be empty whenever we don't have a write lock on the log;
+   other processes read it. get_log_offset() takes queued data into
+   account. */
+#define LOG_WRITER_IOVS 16
+#define LOG_WRITER_STAGING 4096
+
+static struct {
+    struct iovec iov[LOG_WRITER_IOVS];
+    char *owned[LOG_WRITER_IOVS];       /* to free after writing, or NULL */
+    int niov;
+    char staging[LOG_WRITER_STAGING];
+    int staginglen;
+    long queued;                        /* bytes in the queue */
+} log_writer;
+
+/* Drops anything in the queue without writing it. */
+static void
+log_discard_queue(void)
+{
+    int i;
+
+    for (i = 0; i < log_writer.niov; i++)
+        free(log_writer.owned[i]);
+    log_writer.niov = 0;
+    log_writer.staginglen = 0;
+    log_writer.queued = 0;
+}
+
+static void
+log_flush(void)
+{
+    struct iovec *iov = log_writer.iov;
+    int niov = log_writer.niov;
+    long rv;
+
+    if (niov > 0)
+        lgetline_sync();
+    while (niov > 0) {
+#ifdef AIMAKE_BUILDOS_MSWin32
+        rv = write(program_state.logfile, iov->iov_base, iov->iov_len);
+#else
+        rv = writev(program_state.logfile, iov, niov);
+#endif
+        if (rv < 0 && errno == EINTR)
+            continue;
+        if (rv <= 0)
+            panic("Could not write to the log.");
+
+        /* Skip over whatever was written; a short write leaves us partway
+           through an iovec. */
+        while (niov > 0 && rv >= (long)iov->iov_len) {
+            rv -= iov->iov_len;
+            iov++;
+            niov--;
+        }
+        if (niov > 0) {
+            iov->iov_base = (char *)iov->iov_base + rv;
+            iov->iov_len -= rv;
+        }
+    }
+
+    log_discard_queue();
+}
+
+/* Adds a new iovec to the queue, making room if necessary. */
+static void
+log_queue_iov(char *buf, int len, char *owned)
+{
+    if (log_writer.niov == LOG_WRITER_IOVS)
+        log_flush();
+
+    log_writer.iov[log_writer.niov].iov_base = buf;
+    log_writer.iov[log_writer.niov].iov_len = len;
+    log_writer.owned[log_writer.niov] = owned;
+    log_writer.niov++;
+    log_writer.queued += len;
+}
+
+/* Queues a copy of the given data. */
+static void
+log_queue(const char *buf, int len)
+{
+    char *dest;
+    struct iovec *last;
+
+    if (program_state.logfile == -1 || len <= 0)
+        return;
+
+    if (log_writer.staginglen + len > LOG_WRITER_STAGING ||
+        log_writer.niov == LOG_WRITER_IOVS)
+        log_flush();
+    if (len > LOG_WRITER_STAGING) {
+        char *copy = malloc(len);
+
+        memcpy(copy, buf, len);
+        log_queue_iov(copy, len, copy);
+        return;
+    }
+
+    dest = log_writer.staging + log_writer.staginglen;
+    memcpy(dest, buf, len);
+    log_writer.staginglen += len;
+
+    /* Extend the last iovec if it ends where this data starts. */
+    last = log_writer.niov ? &log_writer.iov[log_writer.niov - 1] : NULL;
+    if (last && (char *)last->iov_base + last->iov_len == dest) {
+        last->iov_len += len;
+        log_writer.queued += len;
+    } else {
+        log_queue_iov(dest, len, NULL);
+    }
+}
+
+/* Queues the given malloc'ed data, which will be freed once written. */
+static void
+log_queue_owned(char *buf, int len)
+{
+    if (len <= LOG_WRITER_STAGING / 4 || program_state.logfile == -1) {
+        log_queue(buf, len);
+        free(buf);
+    } else {
+        log_queue_iov(buf, len, buf);
+    }
+}
+
 /* TODO: Let's get rid of the hardcoded buffer length here some time.
 
    Warning to anyone attempting this: vsnprintf's return value is broken on
@@ -668,9 +850,7 @@ lvprintf(const char *fmt, va_list vargs)
     int size;
 
     size = vsnprintf(outbuf, sizeof (outbuf), fmt, vargs);
-
-    if (!full_write(program_state.logfile, outbuf, size))
-        panic("Could not write text content to the log.");
+    log_queue(outbuf, size);
 
     return size;
 }
@@ -692,85 +872,178 @@ static void
 log_binary(const char *buf, int buflen)
 {
     char *b64buf;
+    int b64len;
 
     if (program_state.logfile == -1)
         return;
 
     b64buf = malloc(base64size(buflen));
-    base64_encode_binary((const unsigned char *)buf, b64buf, buflen);
+    b64len = base64_encode_binary((const unsigned char *)buf, b64buf, buflen);
 
     /* don't use lprintf, b64buf might be too big for the buffer used by
        lprintf */
-    if (!full_write(program_state.logfile, b64buf, strlen(b64buf)))
-        panic("Could not write binary content to the log.");
+    log_queue_owned(b64buf, b64len);
+}
+
+/* lgetline() reads ahead, into a window over the file that's reused from line to
+   line, and grown as needed to fit the longest line seen so far (save backups
+   can be several megabytes long). Lines are returned from the window until it
+   runs out, so a short line normally costs no system calls at all. Refills
+   start small, because most lines are short, and double in size up to a limit
+   so that a long line only takes a few system calls to read.
+
+   While the window has bytes that haven't been returned yet, the file pointer
+   of its fd is past the position the rest of this file expects (the "cursor",
+   window.base + window.pos). So every other use of a log file's file pointer
+   in this file goes through log_lseek(), which just moves the cursor when the
+   target is inside the window, and otherwise calls lgetline_sync() first to
+   put the file pointer back where it belongs. Anything that reads or writes
+   through the file pointer must call lgetline_sync() first, too.
+
+   The window assumes that the file only changes by being appended to, apart
+   from changes we make ourselves (which go through lgetline_sync()). That's
+   true of other processes, which only append to a game they're playing. */
+#define LGETLINE_MIN_READ 4096
+#define LGETLINE_MAX_READ (1024 * 1024)
+
+static struct {
+    char *buf;
+    long size;          /* allocated size of buf */
+    int fd;             /* the file the window is over, or -1 for none */
+    long base;          /* file offset of buf[0] */
+    long len;           /* bytes of the file in buf */
+    long pos;           /* offset of the cursor from base */
+    long nul;           /* newline replaced by '\0' in buf, or -1 for none */
+} lgetline_window = {.fd = -1, .nul = -1};
+
+/* Drops lgetline's window, leaving the file pointer at the cursor. The last
+   line returned stays valid. */
+static void
+lgetline_sync(void)
+{
+    if (lgetline_window.fd == -1)
+        return;
+    if (lgetline_window.pos != lgetline_window.len)
+        lseek(lgetline_window.fd, lgetline_window.base + lgetline_window.pos,
+              SEEK_SET);
+    lgetline_window.fd = -1;
+    lgetline_window.nul = -1;
+}
+
+/* lseek() for log files, taking lgetline's window into account. */
+static long
+log_lseek(int fd, long offset, int whence)
+{
+    long target = -1;
+
+    if (fd == lgetline_window.fd) {
+        if (whence == SEEK_CUR)
+            target = lgetline_window.base + lgetline_window.pos + offset;
+        else if (whence == SEEK_SET)
+            target = offset;
+
+        if (target >= lgetline_window.base &&
+            target <= lgetline_window.base + lgetline_window.len) {
+            lgetline_window.pos = target - lgetline_window.base;
+            return target;
+        }
+    }
 
-    free(b64buf);
+    lgetline_sync();
+    return lseek(fd, offset, whence);
 }
 
-/* Reads a line starting from the current file pointer. Returns NULL if the line
-   is incomplete or spos is past EOF, otherwise mallocs enough space for the
-   line and returns it. The file pointer is left at the newline, or in an
-   unpredictable location in case of error. */
+/* Reads a line starting from the cursor. Returns NULL if the line is incomplete
+   or the cursor is at EOF, otherwise returns the line with its newline removed.
+   The return value points into a buffer owned by lgetline, so it must not be
+   freed, and is only valid until the next call to lgetline; a caller that needs
+   the line after that must copy it. The cursor is left just past the newline,
+   or in an unpredictable location in case of error. */
 static char *
-lgetline_malloc(int fd)
+lgetline(int fd)
 {
-    char *inbuf = NULL;
-    long inbuflen = 0;  /* number of bytes read */
-    long fpos = 0;      /* file pointer, relative to its original location */
-    void *nlloc = NULL;
-    boolean at_eof = FALSE;
+    long chunk = LGETLINE_MIN_READ;
+    long scanned, rv;
+    char *line, *nlloc = NULL;
+
+    if (lgetline_window.nul != -1)
+        lgetline_window.buf[lgetline_window.nul] = '\x0a';
+    lgetline_window.nul = -1;
+
+    if (fd != lgetline_window.fd) {
+        lgetline_sync();
+        lgetline_window.base = lseek(fd, 0, SEEK_CUR);
+        if (lgetline_window.base < 0)
+            return NULL;
+        lgetline_window.fd = fd;
+        lgetline_window.len = lgetline_window.pos = 0;
+    }
 
-    do {
-        inbuflen += 4;
-        inbuflen *= 3;
-        inbuflen /= 2;
-        inbuf = realloc(inbuf, inbuflen);
-        if (!inbuf)
-            panic("Out of memory in lgetline_malloc");
+    scanned = lgetline_window.pos;
+    while (scanned == lgetline_window.len ||
+           !(nlloc = memchr(lgetline_window.buf + scanned, '\x0a',
+                            lgetline_window.len - scanned))) {
+        /* We know there's no newline in the bytes we have, so only the newly
+           read bytes will need scanning. */
+        scanned = lgetline_window.len;
+
+        /* Discard the bytes before the cursor, to make room. */
+        if (lgetline_window.pos) {
+            memmove(lgetline_window.buf,
+                    lgetline_window.buf + lgetline_window.pos,
+                    lgetline_window.len - lgetline_window.pos);
+            lgetline_window.base += lgetline_window.pos;
+            lgetline_window.len -= lgetline_window.pos;
+            scanned -= lgetline_window.pos;
+            lgetline_window.pos = 0;
+        }
+
+        if (lgetline_window.len + chunk > lgetline_window.size) {
+            lgetline_window.size *= 2;
+            if (lgetline_window.size < lgetline_window.len + chunk)
+                lgetline_window.size = lgetline_window.len + chunk;
+            lgetline_window.buf = realloc(lgetline_window.buf,
+                                          lgetline_window.size);
+            if (!lgetline_window.buf)
+                panic("Out of memory in lgetline");
+        }
 
         /* Return values from read:
            negative return = error
            zero return = EOF
            positive return = success, even if it didn't return as many
-           bytes as expected (in which case we must rerun read) */
-        inbuflen = read(fd, inbuf + fpos, inbuflen - fpos) + fpos;
+           bytes as expected (in which case we must rerun read)
 
-        /* Most errors are a problem. However, if the read is interrupted with
+           Most errors are a problem. However, if the read is interrupted with
            zero bytes read, then this is reported as an "error" EINTR rather
-           than a count of zero, so as to distinguish it from EOF. (This API
-           could have been better designed, really, but we're stuck with it
-           now.) */
-        at_eof = inbuflen == fpos;
-
-        if (inbuflen < fpos) {
+           than a count of zero, so as to distinguish it from EOF. */
+        rv = read(fd, lgetline_window.buf + lgetline_window.len, chunk);
+        if (rv < 0) {
             if (errno != EINTR) {
-                free(inbuf);
+                lgetline_window.fd = -1;
                 return NULL;
             }
-            inbuflen = fpos; /* we successfully read 0 bytes */
+            continue;
         }
-
-        /* We want to break out of the loop if we're at EOF (inbuflen ==
-           fpos) or if a newline was found. */
-        nlloc = memchr(inbuf, '\x0a', fpos);
-        if (at_eof)
+        if (rv == 0)
             break;
 
-        fpos = inbuflen;
-    } while (!nlloc);
+        lgetline_window.len += rv;
+        if (chunk < LGETLINE_MAX_READ)
+            chunk *= 2;
+    }
 
-    if (!nlloc && fpos > 0) {
+    if (!nlloc && lgetline_window.len > lgetline_window.pos) {
         /* The save file ends with a partial line, something that should never
            happen in normal operation (it indicates that a process crashed in
-           the middle of a write). Get rid of the partial line. */
+           the middle of a write). Get rid of the partial line.
 
-        free(inbuf);
-
-        /* Note: this assumes that fd is never 0 or -1. -1 is definitely a safe
+           Note: this assumes that fd is never 0 or -1. -1 is definitely a safe
            assumption, we wouldn't reach here if the fd were invalid. TODO: 0
            is possibly an unsafe assumption, if we're ever run from a client
            that has no open FDs of its own and which has closed all the
            standard handles. */
+        lgetline_window.pos = lgetline_window.len;
         if (fd == program_state.logfile) {
             log_recover_noreturn(get_log_last_newline(1),
                                  "Save file ends with a partial line",
@@ -785,32 +1058,41 @@ lgetline_malloc(int fd)
                due to corruption in the first three lines of a file. The NULL
                return here treats this the same way as if one of the first three
                lines were missing, which is pretty much equivalent.) */
-            free(inbuf);
             return NULL;
         }
 
-    } else if (!nlloc && fpos == 0) {
+    } else if (!nlloc) {
         /* At EOF, which is at the start of the line. */
-        free(inbuf);
         return NULL;
     }
 
-    /* We could trim inbuf down to size, but there's not a lot of point,
-       especially as in most cases it's going to be free'd almost
-       immediately. We must, however, undo the excess read via seeking the
-       cursor backwards to just after the final newline. */
-    *(char *)nlloc = '\0';
-    lseek(fd, ((char *)nlloc - inbuf) + 1 - fpos, SEEK_CUR);
+    /* Hand out the line in place, remembering to put the newline back in case
+       the cursor is moved back over it. */
+    *nlloc = '\0';
+    line = lgetline_window.buf + lgetline_window.pos;
+    lgetline_window.nul = nlloc - lgetline_window.buf;
+    lgetline_window.pos = lgetline_window.nul + 1;
+
+    return line;
+}
 
-    return inbuf;
+/* Releases lgetline's buffer. */
+static void
+lgetline_free(void)
+{
+    lgetline_sync();
+    free(lgetline_window.buf);
+    lgetline_window.buf = NULL;
+    lgetline_window.size = 0;
 }
 
 
-/* Returns the offset to the current file pointer in the log. */
+/* Returns the offset to the current file pointer in the log, counting anything
+   that's queued to be written there. */
 static long
 get_log_offset(void)
 {
-    return lseek(program_state.logfile, 0, SEEK_CUR);
+    return log_lseek(program_state.logfile, 0, SEEK_CUR) + log_writer.queued;
 }
 
 /* Returns the offset just past the end of the last valid line in the log.  This
@@ -823,33 +1105,37 @@ static long
 get_log_last_newline(int nth)
 {
     long o = get_log_offset();
-    long rv;
-    char inchar[2] = {0, 0};
+    long blockstart, blocklen, i;
+    char block[4096];
 
     if (!change_fd_lock(program_state.logfile, TRUE, LT_READ, 2))
         panic("Could not upgrade to read lock on logfile");
 
-    lseek(program_state.logfile, -1, SEEK_END);
+    blockstart = log_lseek(program_state.logfile, 0, SEEK_END);
 
-    /* Run through the file backwards, reading one char at a time until we find
-       a newline. (This is rather less efficient than reading blocks at a time
-       and scanning them backwards, but the code is much simpler, and given that
-       this only runs in very exceptional circumstances and most lines are short
-       it's unlikely to be a performance bottleneck.) */
-    while (full_read(program_state.logfile, inchar, 1) &&
-           (*inchar != '\n' || --nth))
-        if (!lseek(program_state.logfile, -2, SEEK_CUR))
+    /* Run through the file backwards a block at a time, scanning each block
+       backwards for newlines. */
+    while (blockstart > 0) {
+        blocklen = blockstart < (long)sizeof block ?
+            blockstart : (long)sizeof block;
+        blockstart -= blocklen;
+
+        log_lseek(program_state.logfile, blockstart, SEEK_SET);
+        if (!full_read(program_state.logfile, block, blocklen))
             break;
 
-    if (*inchar == '\n') {
-        /* We found our newline. The file pointer is now just past it. */
-        rv = get_log_offset();
-        lseek(program_state.logfile, o, SEEK_SET);
+        for (i = blocklen - 1; i >= 0; i--) {
+            if (block[i] == '\n' && !--nth) {
+                /* We found our newline; the offset we want is just past it. */
+                log_lseek(program_state.logfile, o, SEEK_SET);
 
-        if (!change_fd_lock(program_state.logfile, TRUE, LT_MONITOR, 2))
-            panic("Could not downgrade to monitor lock on logfile");
+                if (!change_fd_lock(program_state.logfile, TRUE,
+                                    LT_MONITOR, 2))
+                    panic("Could not downgrade to monitor lock on logfile");
 
-        return rv;
+                return blockstart + i + 1;
+            }
+        }
     }
 
     /* We didn't find enough newlines in the file. This is pretty massively bad.
@@ -880,26 +1166,24 @@ get_log_start_of_turn_offset(void)
     if (program_state.emergency_recover_location)
         loc = program_state.emergency_recover_location;
 
-    lseek(program_state.logfile, loc, SEEK_SET);
+    log_lseek(program_state.logfile, loc, SEEK_SET);
 
     /* Move forwards one line. In the exceptional case that we have a binary save
        location without a matching binary save (which is probably impossible, but
        may as well handle it just in case it isn't), we treat it the same way as
        an incomplete line. */
 
-    save_diff_line = lgetline_malloc(program_state.logfile);
+    save_diff_line = lgetline(program_state.logfile);
 
     if (!save_diff_line)
         log_recover_noreturn(get_log_last_newline(1),
                              "No save diff in binary save location",
                              __FILE__, __LINE__);
 
-    free(save_diff_line);
-
     /* Now return the offset we found, taking care to restore the file
        pointer. */
     rv = get_log_offset();
-    lseek(program_state.logfile, o, SEEK_SET);
+    log_lseek(program_state.logfile, o, SEEK_SET);
 
     if (!change_fd_lock(program_state.logfile, TRUE, LT_MONITOR, 2))
         panic("Could not downgrade to monitor lock on logfile");
@@ -910,6 +1194,46 @@ get_log_start_of_turn_offset(void)
 
 /***** Locking *****/
 
+/* The fields of the log header that can change while a game is in progress,
+   the status and the recovery count, are at fixed offsets in the first line,
+   "NHGAME ssss rrrrrrrr ...". */
+#define HEADER_STATUS_OFFSET 7
+#define HEADER_RECOVERY_OFFSET (HEADER_STATUS_OFFSET + STATUS_LEN + 1)
+#define HEADER_PREFIX_LEN (HEADER_RECOVERY_OFFSET + 8)
+
+/* Reads just the status and recovery count from the header. This is what
+   start_updating_logfile needs to check before every update, and is much
+   cheaper than read_log_header (one system call, and no line splitting or
+   decoding). The caller must hold a lock on the file. */
+static enum nh_log_status
+read_log_status(int fd, int *recovery_count)
+{
+    char buf[HEADER_PREFIX_LEN + 1];
+    char statusbuf[STATUS_LEN + 1];
+    char *endptr;
+
+#ifdef AIMAKE_BUILDOS_MSWin32
+    if (log_lseek(fd, 0, SEEK_SET) < 0 || !full_read(fd, buf, HEADER_PREFIX_LEN))
+        return LS_INVALID;
+#else
+    if (pread(fd, buf, HEADER_PREFIX_LEN, 0) != HEADER_PREFIX_LEN)
+        return LS_INVALID;
+#endif
+    buf[HEADER_PREFIX_LEN] = '\0';
+
+    if (memcmp(buf, "NHGAME ", HEADER_STATUS_OFFSET) ||
+        buf[HEADER_RECOVERY_OFFSET - 1] != ' ')
+        return LS_INVALID;
+
+    *recovery_count = strtol(buf + HEADER_RECOVERY_OFFSET, &endptr, 16);
+    if (endptr != buf + HEADER_PREFIX_LEN)
+        return LS_INVALID;
+
+    memcpy(statusbuf, buf + HEADER_STATUS_OFFSET, STATUS_LEN);
+    statusbuf[STATUS_LEN] = '\0';
+    return status_from_string(statusbuf);
+}
+
 /*
  * To be able to update the logfile, we need to ensure the following:
  *
@@ -942,24 +1266,21 @@ start_updating_logfile(boolean ok_not_at_end)
     if (!change_fd_lock(program_state.logfile, TRUE, LT_WRITE, 2))
         panic("Could not upgrade to write lock on logfile");
 
-    struct nh_game_info si;
     int recovery_count;
-    int lstatus = read_log_header(program_state.logfile, &si,
-                                  &recovery_count, FALSE);
+    int lstatus = read_log_status(program_state.logfile, &recovery_count);
 
-    if (recovery_count != program_state.expected_recovery_count)
+    if (lstatus == LS_INVALID ||
+        recovery_count != program_state.expected_recovery_count)
         terminate(RESTART_PLAY);
 
     if (lstatus == LS_DONE)
         terminate(GAME_ALREADY_OVER);
 
-    lseek(program_state.logfile,
-          program_state.end_of_gamestate_location, SEEK_SET);
-
-    /* now the file pointer should be at EOF */
-    o = get_log_offset();
+    /* The file should end at the end of the gamestate line; this also leaves
+       the file pointer there, ready for writing. */
+    o = log_lseek(program_state.logfile, 0, SEEK_END);
 
-    if (o != lseek(program_state.logfile, 0, SEEK_END)) {
+    if (o != program_state.end_of_gamestate_location) {
         if (!change_fd_lock(program_state.logfile, TRUE, LT_MONITOR, 1))
             panic("Could not downgrade to monitor lock on logfile");
 
@@ -975,13 +1296,15 @@ start_updating_logfile(boolean ok_not_at_end)
 static void
 stop_updating_logfile(int lines_added)
 {
+    log_flush();
+
     if (lines_added == 1) {
 
         program_state.gamestate_location =
             program_state.end_of_gamestate_location;
 
         program_state.end_of_gamestate_location =
-            lseek(program_state.logfile, 0, SEEK_END);
+            log_lseek(program_state.logfile, 0, SEEK_END);
 
     } else if (lines_added > 1) {
         panic("logfile updates may add at most 1 line");
@@ -989,6 +1312,211 @@ stop_updating_logfile(int lines_added)
 
     if (!change_fd_lock(program_state.logfile, TRUE, LT_MONITOR, 1))
         panic("Could not downgrade to monitor lock on logfile");
+
+    log_commit(FALSE);
+}
+
+/***** Durability *****/
+
+/* Nothing written to the log is on disk until the OS gets round to it, so a
+   crash of the host (rather than the process) can lose any amount of recent
+   play. Servers can trade some I/O for safety via the NH4LOGDURABILITY
+   environment variable:
+
+   none:              never sync the log explicitly (the default)
+   turn:              sync after every save backup or save diff, i.e. at every
+                      neutral turnstate
+   group:MS:LINES     sync once MS milliseconds have passed since the last sync,
+                      or LINES lines have been written since then, whichever is
+                      first (both optional; 0 turns a limit off)
+
+   With group commit, the limits are checked when a line is written, so an idle
+   game may have unsynced lines for longer. In every mode but none, the log is
+   synced when the game is closed. */
+#define LOG_DURABILITY_DEFAULT_MS 1000
+#define LOG_DURABILITY_DEFAULT_LINES 64
+
+static struct {
+    enum {
+        ldp_none,
+        ldp_turn,
+        ldp_group,
+    } policy;
+    long interval_us;
+    int interval_lines;
+
+    int unsynced_lines;
+    boolean unsynced;
+    microseconds last_sync;
+} log_durability;
+
+static void
+read_log_durability_policy(void)
+{
+    const char *policy = nh_getenv("NH4LOGDURABILITY");
+    char *p;
+
+    log_durability.policy = ldp_none;
+    log_durability.interval_us = LOG_DURABILITY_DEFAULT_MS * 1000L;
+    log_durability.interval_lines = LOG_DURABILITY_DEFAULT_LINES;
+    log_durability.unsynced = FALSE;
+    log_durability.unsynced_lines = 0;
+    log_durability.last_sync = utc_time();
+
+    if (!policy || !strcmp(policy, "none"))
+        return;
+
+    if (!strcmp(policy, "turn")) {
+        log_durability.policy = ldp_turn;
+    } else if (!strncmp(policy, "group", 5) &&
+               (!policy[5] || policy[5] == ':')) {
+        log_durability.policy = ldp_group;
+        if (policy[5] == ':') {
+            log_durability.interval_us = strtol(policy + 6, &p, 10) * 1000L;
+            if (*p == ':')
+                log_durability.interval_lines = atoi(p + 1);
+        }
+    } else {
+        paniclog("log_durability",
+                 "unknown NH4LOGDURABILITY policy; using none");
+    }
+}
+
+/* Forces everything written to the log so far onto the disk. */
+static void
+log_sync_to_disk(void)
+{
+    int rv;
+
+#if defined(AIMAKE_BUILDOS_MSWin32)
+    rv = _commit(program_state.logfile);
+#elif defined(AIMAKE_BUILDOS_linux)
+    rv = fdatasync(program_state.logfile);
+#else
+    rv = fsync(program_state.logfile);
+#endif
+
+    /* There's not much we can do about a failure, but the server admin will
+       want to know. */
+    if (rv < 0)
+        paniclog("log_durability", "could not sync the log to disk");
+
+    log_durability.unsynced = FALSE;
+    log_durability.unsynced_lines = 0;
+    log_durability.last_sync = utc_time();
+}
+
+/* Called after each update of the log, and with turn_boundary set after each
+   save line. Syncs the log to disk if the durability policy calls for it. */
+static void
+log_commit(boolean turn_boundary)
+{
+    if (log_durability.policy == ldp_none || program_state.logfile == -1)
+        return;
+
+    if (!turn_boundary) {
+        log_durability.unsynced = TRUE;
+        log_durability.unsynced_lines++;
+    }
+
+    if (!log_durability.unsynced)
+        return;
+
+    switch (log_durability.policy) {
+    case ldp_none:
+        break;
+    case ldp_turn:
+        if (turn_boundary)
+            log_sync_to_disk();
+        break;
+    case ldp_group:
+        if ((log_durability.interval_lines &&
+             log_durability.unsynced_lines >= log_durability.interval_lines) ||
+            (log_durability.interval_us &&
+             utc_time() - log_durability.last_sync >=
+             log_durability.interval_us))
+            log_sync_to_disk();
+        break;
+    }
+}
+
+/***** Save size accounting *****/
+
+/* If the NH4SAVESTATS environment variable names a file, then a JSON object
+   describing what takes up space in each save (see maccount()) is appended to
+   it, one per line, every time a save backup or save diff is written (and when
+   requested via the #savestats debug command). For example:
+
+   {"turn":1234,"kind":"diff","size":...,"diffsize":...,
+    "tags":{"MTAG_LOCATIONS":{"written":...,"changed":...},...},
+    "levels":{"0":{"written":...,"changed":...},"1":...}}
+
+   "size" is the size of the binary save, and "diffsize" the size of the save
+   diff before compression. Levels are identified by ledger number, with 0 for
+   the parts of the save outside any level. Tag types and levels that occupy
+   no space are omitted. */
+static FILE *save_stats_file = NULL;
+
+static void
+read_save_stats_file(void)
+{
+    const char *path = nh_getenv("NH4SAVESTATS");
+
+    if (save_stats_file)
+        fclose(save_stats_file);
+    save_stats_file = NULL;
+
+    if (path && *path) {
+        save_stats_file = fopen(path, "a");
+        if (!save_stats_file)
+            paniclog("save_stats", "could not open the NH4SAVESTATS file");
+    }
+}
+
+static void
+write_save_stats_counts(const char *name, const struct memfile_usage_count *c,
+                        boolean *first)
+{
+    if (!c->written)
+        return;
+
+    fprintf(save_stats_file, "%s\"%s\":{\"written\":%ld,\"changed\":%ld}",
+            *first ? "" : ",", name, c->written, c->changed);
+    *first = FALSE;
+}
+
+/* Records the space usage of mf, which must still be relative to the save it
+   was diffed against (if any), in the NH4SAVESTATS file. kind describes why
+   the save was made. */
+void
+log_save_stats(const struct memfile *mf, const char *kind)
+{
+    struct memfile_usage usage;
+    boolean first;
+    int i;
+
+    if (!save_stats_file)
+        return;
+
+    maccount(mf, &usage);
+
+    fprintf(save_stats_file, "{\"turn\":%u,\"kind\":\"%s\",\"size\":%d",
+            moves, kind, mf->pos);
+    if (mf->relativeto)
+        fprintf(save_stats_file, ",\"diffsize\":%d", mf->diffpos);
+
+    fprintf(save_stats_file, ",\"tags\":{");
+    first = TRUE;
+    for (i = 0; i <= MTAG_COUNT; i++)
+        write_save_stats_counts(mtag_name(i), &usage.bytype[i], &first);
+
+    fprintf(save_stats_file, "},\"levels\":{");
+    first = TRUE;
+    for (i = 0; i < ARRAY_SIZE(usage.bylevel); i++)
+        write_save_stats_counts(msgprintf("%d", i), &usage.bylevel[i], &first);
+
+    fprintf(save_stats_file, "}}\n");
+    fflush(save_stats_file);
 }
 
 /***** Creating specific log entries *****/
@@ -1037,6 +1565,7 @@ log_newgame(microseconds start_time)
 
     program_state.expected_recovery_count = 1;
 
+    log_flush();
     if (!change_fd_lock(program_state.logfile, TRUE, LT_MONITOR, 2))
         panic("Could not downgrade to monitor lock on logfile");
 }
@@ -1045,7 +1574,8 @@ log_newgame(microseconds start_time)
 static void
 set_second_logline(const char *second_logline)
 {
-    lseek(program_state.logfile,
+    log_flush();
+    log_lseek(program_state.logfile,
           strlen("NHGAME  00000001 4.000.000\x0a") + STATUS_LEN, SEEK_SET);
     lprintf("%" SECOND_LOGLINE_LEN_STR "." SECOND_LOGLINE_LEN_STR "s",
             second_logline);
@@ -1055,8 +1585,7 @@ void
 log_game_over(const char *death)
 {
     start_updating_logfile(FALSE);
-    lseek(program_state.logfile,
-          strlen("NHGAME "), SEEK_SET);
+    log_lseek(program_state.logfile, HEADER_STATUS_OFFSET, SEEK_SET);
     lprintf("%" STATUS_LEN_STR "." STATUS_LEN_STR "s", status_string(LS_DONE));
 
     set_second_logline(death);
@@ -1092,12 +1621,192 @@ log_game_state(void)
     stop_updating_logfile(0);
 }
 
+/***** Save verification *****/
+
+/* Each save written to the log is normally checked twice: a save diff is
+   decoded again and compared with the save it should produce, then the save is
+   loaded and re-saved to make sure it round-trips. This is expensive (several
+   times the cost of the save itself), so servers can choose to do it less
+   often, via the NH4SAVEVERIFY environment variable:
+
+   always:     check every save, before the player sees the turn's results
+   sampled:N:  check every Nth save diff, plus every save backup and every save
+               written on a different level from the last checked save (N
+               defaults to SAVE_VERIFY_DEFAULT_INTERVAL if not given)
+   deferred:   check every save, but only once the turn's output has been sent
+               to the player (before the next command is acted on)
+
+   Whenever a check does run, it behaves the same way regardless of policy. */
+#define SAVE_VERIFY_DEFAULT_INTERVAL 16
+
+static enum {
+    svp_always,
+    svp_sampled,
+    svp_deferred,
+} save_verify_policy = svp_always;
+static int save_verify_interval = SAVE_VERIFY_DEFAULT_INTERVAL;
+static int saves_since_verification = 0;
+static xchar last_verified_ledger = 0;
+
+/* A check that was postponed by svp_deferred. */
+static struct {
+    boolean pending;
+    boolean has_diff_base;
+    struct memfile diff_base;   /* what the save diff is relative to */
+    long recover_location;      /* for emergency_recover_location */
+} deferred_verification;
+
+static void
+read_save_verify_policy(void)
+{
+    const char *policy = nh_getenv("NH4SAVEVERIFY");
+
+    save_verify_policy = svp_always;
+    save_verify_interval = SAVE_VERIFY_DEFAULT_INTERVAL;
+
+    if (!policy || !strcmp(policy, "always"))
+        return;
+
+    if (!strcmp(policy, "deferred")) {
+        save_verify_policy = svp_deferred;
+    } else if (!strncmp(policy, "sampled", 7) &&
+               (!policy[7] || policy[7] == ':')) {
+        save_verify_policy = svp_sampled;
+        if (policy[7] == ':' && atoi(policy + 8) > 0)
+            save_verify_interval = atoi(policy + 8);
+    } else {
+        paniclog("save_verify", "unknown NH4SAVEVERIFY policy; using always");
+    }
+}
+
+/* Should the save that was just written be checked (now or later)? Also
+   updates the bookkeeping for svp_sampled. */
+static boolean
+want_save_verification(boolean is_backup)
+{
+    xchar ledger = ledger_no(&u.uz);
+
+    if (save_verify_policy != svp_sampled)
+        return TRUE;
+
+    if (is_backup || ledger != last_verified_ledger ||
+        ++saves_since_verification >= save_verify_interval) {
+        saves_since_verification = 0;
+        last_verified_ledger = ledger;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static noreturn void
+diff_error_at_neutral_turnstate(const char *message, char *diff)
+{
+    (void) diff;
+    panic("Corrupted diff added to save file: %s", message);
+}
+
+/* Verify that the diffing algorithm is working correctly; we don't want to
+   corrupt the save in a way that can't be recovered. */
+static void
+verify_save_diff(struct memfile *diff_base)
+{
+    struct memfile checkmf;
+
+    mnew(&checkmf, NULL);
+    mdiffapply(program_state.binary_save.diffbuf,
+               program_state.binary_save.diffpos, diff_base,
+               &checkmf, diff_error_at_neutral_turnstate);
+    if (!mequal(&checkmf, &program_state.binary_save, NULL))
+        panic("Corrupted diff added to save file");
+    mfree(&checkmf);
+}
+
+/* Does the part of load_gamestate_from_binary_save() that isn't a check: the
+   gamestate in memory is already the one in the binary save, so all that needs
+   updating is where the log says it is. */
+static void
+skip_save_verification(long end_of_save_line)
+{
+    program_state.gamestate_location = program_state.binary_save_location;
+    program_state.end_of_gamestate_location = end_of_save_line;
+    program_state.ok_to_diff = TRUE;
+}
+
+static void
+defer_save_verification(struct memfile *diff_base, long recover_location,
+                        long end_of_save_line)
+{
+    discard_deferred_save_verification();
+
+    deferred_verification.pending = TRUE;
+    deferred_verification.has_diff_base = !!diff_base;
+    if (diff_base)
+        deferred_verification.diff_base = *diff_base;
+    deferred_verification.recover_location = recover_location;
+
+    skip_save_verification(end_of_save_line);
+}
+
+static void
+discard_deferred_save_verification(void)
+{
+    if (deferred_verification.has_diff_base)
+        mfree(&deferred_verification.diff_base);
+    deferred_verification.has_diff_base = FALSE;
+    deferred_verification.pending = FALSE;
+}
+
+/* Runs a check postponed by the "deferred" policy. This must be called only
+   when the gamestate hasn't changed since the save was written, because it
+   reloads the gamestate from that save. Reloading frees all messages, so cmd
+   (the command that's about to be run) is copied to new messages. */
+void
+log_run_deferred_save_verification(struct nh_cmd_and_arg *cmd)
+{
+    struct nh_cmd_and_arg saved_cmd;
+    char *saved_cmdname, *saved_str = NULL;
+
+    if (!deferred_verification.pending)
+        return;
+    deferred_verification.pending = FALSE;
+
+    saved_cmd = *cmd;
+    saved_cmdname = strcpy(malloc(strlen(cmd->cmd) + 1), cmd->cmd);
+    saved_cmd.cmd = saved_cmdname;
+    if (cmd->arg.argtype & CMD_ARG_STR) {
+        saved_str = strcpy(malloc(strlen(cmd->arg.str) + 1), cmd->arg.str);
+        saved_cmd.arg.str = saved_str;
+    }
+
+    program_state.emergency_recover_location =
+        deferred_verification.recover_location;
+
+    if (deferred_verification.has_diff_base) {
+        verify_save_diff(&deferred_verification.diff_base);
+        mfree(&deferred_verification.diff_base);
+        deferred_verification.has_diff_base = FALSE;
+    }
+
+    load_gamestate_from_binary_save(FALSE);
+
+    program_state.emergency_recover_location = 0;
+
+    msg_request_command_callback(&saved_cmd, cmd);
+    free(saved_cmdname);
+    free(saved_str);
+}
+
 void
 log_backup_save(void)
 {
+    long end_of_save_line;
+
     if (program_state.logfile == -1)
         panic("log_backup_save called with no logfile");
 
+    /* normally already done when the command was read */
+    discard_deferred_save_verification();
+
     if (!start_updating_logfile(TRUE)) {
         log_replay_save_line();
         return;
@@ -1109,6 +1818,7 @@ log_backup_save(void)
     mnew(&program_state.binary_save, NULL);
     program_state.binary_save_allocated = TRUE;
     savegame(&program_state.binary_save);
+    log_save_stats(&program_state.binary_save, "backup");
 
     long o = get_log_offset();
     boolean is_newgame = program_state.save_backup_location == 0;
@@ -1117,28 +1827,31 @@ log_backup_save(void)
     program_state.binary_save_location = o;
     log_binary(program_state.binary_save.buf, program_state.binary_save.pos);
     lprintf("\x0a");
+    end_of_save_line = get_log_offset();
 
     /* Once per backup save is about the right rate to refresh this. */
     log_game_state_inner();
 
     /* Record the location of this save backup in the appropriate place. */
-    lseek(program_state.logfile, is_newgame ? o + 1 :
+    log_flush();
+    log_lseek(program_state.logfile, is_newgame ? o + 1 :
           program_state.last_save_backup_location_location, SEEK_SET);
     lprintf("%08lx", o);
-    lseek(program_state.logfile, 0, SEEK_END);
+    log_flush();
+    log_lseek(program_state.logfile, 0, SEEK_END);
 
     stop_updating_logfile(1);
 
     /* Verify that the save file loads correctly; it's better to fail fast
        than end up with a corrupted save. */
-    load_gamestate_from_binary_save(FALSE);
-}
-
-static noreturn void
-diff_error_at_neutral_turnstate(const char *message, char *diff)
-{
-    (void) diff;
-    panic("Corrupted diff added to save file: %s", message);
+    if (!want_save_verification(TRUE))
+        skip_save_verification(end_of_save_line);
+    else if (save_verify_policy == svp_deferred)
+        defer_save_verification(NULL, 0, end_of_save_line);
+    else
+        load_gamestate_from_binary_save(FALSE);
+
+    log_commit(TRUE);
 }
 
 void
@@ -1164,6 +1877,10 @@ log_neutral_turnstate(void)
 
         /* We're generating a save diff line. */
         struct memfile mf = program_state.binary_save;
+        long end_of_save_line;
+
+        /* normally already done when the command was read */
+        discard_deferred_save_verification();
 
         /* start_updating_logfile can cause a turn restart, so place it
            outside the allocation of the new binary save */
@@ -1185,36 +1902,41 @@ log_neutral_turnstate(void)
         program_state.binary_save_location = get_log_offset();
 
         mdiffflush(&program_state.binary_save, 1);
+        log_save_stats(&program_state.binary_save, "diff");
 
         lprintf("~");
         log_binary(program_state.binary_save.diffbuf,
                    program_state.binary_save.diffpos);
         lprintf("\x0a");
-
-        /* Verify that the diffing algorithm is working correctly; we don't
-           want to corrupt the save in a way that can't be recovered. */
-        {
-            struct memfile checkmf;
-            mnew(&checkmf, NULL);
-            mdiffapply(program_state.binary_save.diffbuf,
-                       program_state.binary_save.diffpos, &mf,
-                       &checkmf, diff_error_at_neutral_turnstate);
-            if (!mequal(&checkmf, &program_state.binary_save, NULL))
-                panic("Corrupted diff added to save file");
-            mfree(&checkmf);
-        }
+        end_of_save_line = get_log_offset();
 
         /* Make the new binary save absolute rather than relative, so that
-           we can free the old one. */
+           we can free the old one (once nothing needs it for checking). */
         program_state.binary_save.relativeto = NULL;
-        mfree(&mf);
 
-        stop_updating_logfile(1);
+        if (!want_save_verification(FALSE)) {
+            mfree(&mf);
+            stop_updating_logfile(1);
+            skip_save_verification(end_of_save_line);
+        } else if (save_verify_policy == svp_deferred) {
+            stop_updating_logfile(1);
+            defer_save_verification(
+                &mf, program_state.emergency_recover_location,
+                end_of_save_line);
+        } else {
+            verify_save_diff(&mf);
+            mfree(&mf);
 
-        /* Check the gamestate, for the same reason as in log_backup_save(). */
-        load_gamestate_from_binary_save(FALSE);
+            stop_updating_logfile(1);
+
+            /* Check the gamestate, for the same reason as in
+               log_backup_save(). */
+            load_gamestate_from_binary_save(FALSE);
+        }
 
         program_state.emergency_recover_location = 0;
+
+        log_commit(TRUE);
     }
 }
 
@@ -1286,6 +2008,10 @@ log_revert_command(const char *cmd)
         terminate(RESTART_PLAY);
     }
 
+    /* The two saves are identical, so the levels' records of where they were
+       serialized (which now refer to mf) are equally valid for the binary
+       save; keep them usable by the next savegame(). */
+    program_state.binary_save.save_serial = mf.save_serial;
     mfree(&mf);
 }
 
@@ -1459,10 +2185,10 @@ start_replaying_logfile(char firstchar)
     if (!change_fd_lock(program_state.logfile, TRUE, LT_READ, 2))
         panic("Could not upgrade to read lock on logfile");
 
-    lseek(program_state.logfile,
+    log_lseek(program_state.logfile,
           program_state.end_of_gamestate_location, SEEK_SET);
 
-    logline = lgetline_malloc(program_state.logfile);
+    logline = lgetline(program_state.logfile);
 
     if (!change_fd_lock(program_state.logfile, TRUE, LT_MONITOR, 2))
         panic("Could not downgrade to monitor lock on logfile");
@@ -1477,7 +2203,6 @@ start_replaying_logfile(char firstchar)
         /* Desync: the log contains one sort of input, but the engine is
            requesting another. */
         char c = *logline;
-        free(logline);
         log_desync(c, firstchar);
     }
 
@@ -1491,10 +2216,8 @@ log_want_replay(char firstchar)
         return FALSE;         /* can happen while replaying */
 
     char *logline = start_replaying_logfile(firstchar);
-    if (logline) {
-        free(logline);
+    if (logline)
         return TRUE;
-    }
 
     if (program_state.followmode == FM_REPLAY) {
         /* We can't continue through the normal codepath. Let the client
@@ -1570,8 +2293,6 @@ log_replay_bones(struct memfile *mf)
 
     stop_replaying_logfile();
 
-    free(logline);
-
     return TRUE;
 }
 
@@ -1617,10 +2338,8 @@ log_replay_input(int count, const char *fmt, ...)
     /* Does the format line parse all the characters in logline? */
     actual_count = -1;
     sscanf(logline, fmtbuf, &actual_count);
-    if (strlen(logline) != actual_count) {
-        free(logline);
+    if (strlen(logline) != actual_count)
         return FALSE;
-    }
 
     /* OK, now make sure there's enough input in logline to assign to all
        the arguments. */
@@ -1628,8 +2347,6 @@ log_replay_input(int count, const char *fmt, ...)
     actual_count = vsscanf(logline, fmt, vargs);
     va_end(vargs);
 
-    free(logline);
-
     if (count != actual_count)
         return FALSE;
 
@@ -1652,8 +2369,6 @@ log_replay_line(const char **buf)
 
     stop_replaying_logfile();
 
-    free(logline);
-
     return TRUE;
 }
 
@@ -1698,19 +2413,15 @@ log_replay_menu(boolean isobjmenu, void *el)
 
         if (*lp == ',') {
 
-            if (!isobjmenu) {
-                free(logline);
+            if (!isobjmenu)
                 error_reading_save("non-obj menu has counts\n");
-            }
 
             lp++;
             count = parse_decimal_number(&lp);
         }
 
-        if (*lp != ':' && *lp) {
-            free(logline);
+        if (*lp != ':' && *lp)
             error_reading_save("bad number format in menu\n");
-        }
 
         if (isobjmenu) {
             orl = xrealloc(&turnstate.message_chain, orl,
@@ -1729,8 +2440,6 @@ log_replay_menu(boolean isobjmenu, void *el)
 
     stop_replaying_logfile();
 
-    free(logline);
-
     if (isobjmenu)
         *objresultlist = orl;
     else
@@ -1760,7 +2469,6 @@ log_replay_command(struct nh_cmd_and_arg *cmd)
 
         if (*logline < 'a' || *logline > 'z') {
             c = *logline;
-            free(logline);
             log_desync(c, 'a');
         }
     }
@@ -1790,10 +2498,8 @@ log_replay_command(struct nh_cmd_and_arg *cmd)
         case 'P':
             cmd->arg.argtype |= CMD_ARG_POS;
             cmd->arg.pos.x = parse_decimal_number(&lp);
-            if (*(lp++) != ',') {
-                free(logline);
+            if (*(lp++) != ',')
                 error_reading_save("No comma in position argument\n");
-            }
             cmd->arg.pos.y = parse_decimal_number(&lp);
             break;
 
@@ -1830,15 +2536,12 @@ log_replay_command(struct nh_cmd_and_arg *cmd)
             break;
 
         default:
-            free(logline);
             error_reading_save("Unrecognised command argument\n");
         }
     }
 
     stop_replaying_logfile();
 
-    free(logline);
-
     return TRUE;
 }
 
@@ -1868,8 +2571,8 @@ read_log_header(int fd, struct nh_game_info *si,
     if (do_locking && !change_fd_lock(fd, FALSE, LT_READ, 1))
         return LS_IN_PROGRESS;
 
-    lseek(fd, 0, SEEK_SET);
-    logline = lgetline_malloc(fd);
+    log_lseek(fd, 0, SEEK_SET);
+    logline = lgetline(fd);
     if (!logline)
         goto invalid_log;
 
@@ -1878,12 +2581,10 @@ read_log_header(int fd, struct nh_game_info *si,
                &version_patchlevel) != 5)
         goto invalid_logline;
 
-    free(logline);
-
     if ((result = status_from_string(statusbuf)) == LS_INVALID)
         goto invalid_log;
 
-    logline = lgetline_malloc(fd);
+    logline = lgetline(fd);
     if (!logline)
         goto invalid_log;
 
@@ -1895,9 +2596,7 @@ read_log_header(int fd, struct nh_game_info *si,
         p++;
     strcpy(si->game_state, p);
 
-    free(logline);
-
-    logline = lgetline_malloc(fd);
+    logline = lgetline(fd);
     if (!logline)
         goto invalid_log;
 
@@ -1910,18 +2609,18 @@ read_log_header(int fd, struct nh_game_info *si,
                si->plgend, si->plalign) != 6)
         goto invalid_logline;
 
-    free(logline);
-
     si->playmode = playmode;
     base64_decode(namebuf, si->name, sizeof (si->name));
 
+    /* fd may belong to the client, which needs its file pointer */
+    lgetline_sync();
     if (do_locking)
         change_fd_lock(fd, FALSE, LT_NONE, 0);
     return result;
 
 invalid_logline:
-    free(logline);
 invalid_log:
+    lgetline_sync();
     if (do_locking)
         change_fd_lock(fd, FALSE, LT_NONE, 0);
     return LS_INVALID;
@@ -1959,9 +2658,9 @@ load_gamestate_from_binary_save(boolean maybe_old_version)
 
     /* Load the saved game. */
     program_state.gamestate_location = program_state.binary_save_location;
-    lseek(program_state.logfile, program_state.binary_save_location,
+    log_lseek(program_state.logfile, program_state.binary_save_location,
           SEEK_SET);
-    free(lgetline_malloc(program_state.logfile));
+    lgetline(program_state.logfile);
     program_state.end_of_gamestate_location = get_log_offset();
 
     freedynamicdata();
@@ -1985,9 +2684,9 @@ load_gamestate_from_binary_save(boolean maybe_old_version)
         /* To recover from this, we need to go back to the binary save before
            the one we were trying to load. log_sync rounds down. */
         log_sync(program_state.binary_save_location - 1, TLU_BYTES, TRUE);
-        lseek(program_state.logfile, program_state.binary_save_location,
+        log_lseek(program_state.logfile, program_state.binary_save_location,
               SEEK_SET);
-        free(lgetline_malloc(program_state.logfile));
+        lgetline(program_state.logfile);
         log_recover_noreturn(get_log_offset(), mequal_message,
                              __FILE__, __LINE__);
     }
@@ -2007,6 +2706,28 @@ apply_save_diff_error(const char *s, char *buf)
     error_reading_save(s);
 }
 
+/* Decodes a save diff line against diff_base into the given (newly created)
+   memfile. errfunc is called if the diff doesn't fit diff_base, and must not
+   return. */
+static void
+decode_save_diff(char *s, struct memfile *diff_base, struct memfile *mf,
+                 void (*errfunc)(const char *, char *))
+{
+    char *buf;
+    long buflen;
+
+    /* The header of a save diff is one byte, '~'. */
+    s++;
+
+    buflen = base64_strlen(s);
+    buf = malloc(buflen + 2);
+    memset(buf, 0, buflen + 2);
+    base64_decode(s, buf, buflen);
+
+    mdiffapply(buf, buflen, diff_base, mf, errfunc);
+    free(buf);
+}
+
 /* Decodes the given save diff into program_state.binary_save. The caller should
    check that the string actually is a representation of a save diff, is
    responsible for fixing the invariants on program_state, and must move the
@@ -2014,9 +2735,6 @@ apply_save_diff_error(const char *s, char *buf)
 static void
 apply_save_diff(char *s, struct memfile *diff_base)
 {
-    char *buf;
-    long buflen;
-
     if (program_state.binary_save_allocated)
         panic("The caller of apply_save_diff must back up and deallocate "
               "the binary save");
@@ -2024,17 +2742,40 @@ apply_save_diff(char *s, struct memfile *diff_base)
     mnew(&program_state.binary_save, NULL);
     program_state.binary_save_allocated = TRUE;
 
-    /* The header of a save diff is one byte, '~'. */
-    s++;
+    decode_save_diff(s, diff_base, &program_state.binary_save,
+                     apply_save_diff_error);
+}
 
-    buflen = base64_strlen(s);
-    buf = malloc(buflen + 2);
-    memset(buf, 0, buflen + 2);
-    base64_decode(s, buf, buflen);
+/* Decodes a save backup line into the given (newly created) memfile. */
+static void
+decode_save_backup(char *s, struct memfile *mf)
+{
+    void *mp;
+    long len;
 
-    mdiffapply(buf, buflen, diff_base, &program_state.binary_save,
-               apply_save_diff_error);
-    free(buf);
+    /* The header is '*', an 8 digit hex number, and ' ', = 10 bytes. */
+    s += 10;
+    len = base64_strlen(s);
+
+    mp = mmmap(mf, len, 0);
+    base64_decode(s, mp, len);
+}
+
+/* Returns the turn counter stored in a binary save. */
+static long
+binary_save_turn(struct memfile *mf)
+{
+    long temp_pos = mf->pos;
+    long turn;
+
+    mf->pos = 0;
+    if (!uptodate(mf, NULL))
+        error_reading_save(
+            "binary save is from the wrong version of NetHack\n");
+
+    turn = mread32(mf);
+    mf->pos = temp_pos;
+    return turn;
 }
 
 /* Decodes the given string into program_state.binary_save. The caller should
@@ -2043,20 +2784,12 @@ apply_save_diff(char *s, struct memfile *diff_base)
 static void
 load_save_backup_from_string(char *s)
 {
-    void *mp;
-    long len;
-
     if (program_state.binary_save_allocated)
         mfree(&program_state.binary_save);
     mnew(&program_state.binary_save, NULL);
     program_state.binary_save_allocated = TRUE;
 
-    /* The header is '*', an 8 digit hex number, and ' ', = 10 bytes. */
-    s += 10;
-    len = base64_strlen(s);
-
-    mp = mmmap(&program_state.binary_save, len, 0);
-    base64_decode(s, mp, len);
+    decode_save_backup(s, &program_state.binary_save);
 }
 
 /* Sets the binary save and save backup locations from the argument (which
@@ -2072,14 +2805,13 @@ load_save_backup_from_offset(long offset)
     program_state.binary_save_location = offset;
     program_state.save_backup_location = offset;
 
-    lseek(program_state.logfile, offset, SEEK_SET);
-    logline = lgetline_malloc(program_state.logfile);
+    log_lseek(program_state.logfile, offset, SEEK_SET);
+    logline = lgetline(program_state.logfile);
 
     if (!logline)
         error_reading_save("EOF when reading save backup\n");
 
     load_save_backup_from_string(logline);
-    free(logline);
 }
 
 /* Checks to see if a save backup exists at a given file location. Returns -1 if
@@ -2097,7 +2829,7 @@ get_save_backup_offset(long offset)
     if (!change_fd_lock(program_state.logfile, TRUE, LT_READ, 2))
         panic("Could not upgrade to read lock on logfile");
 
-    if (lseek(program_state.logfile, offset, SEEK_SET) < 0)
+    if (log_lseek(program_state.logfile, offset, SEEK_SET) < 0)
         goto cleanup;
 
     /* Read the save backup header. */
@@ -2120,7 +2852,7 @@ get_save_backup_offset(long offset)
         rv = sbloc;
 
 cleanup:
-    lseek(program_state.logfile, oldoffset, SEEK_SET);
+    log_lseek(program_state.logfile, oldoffset, SEEK_SET);
 
     if (!change_fd_lock(program_state.logfile, TRUE, LT_MONITOR, 2))
         panic("Could not downgrade to monitor lock on logfile");
@@ -2128,6 +2860,453 @@ cleanup:
     return rv;
 }
 
+/***** Save line index *****/
+
+/* log_sync() needs to find save backups and save diffs in the log. Following
+   the back-links between save backups, and reading every line to find the
+   next save line, is slow for long games. So we keep an index of the save
+   backup and save diff lines in a contiguous section of the log (from a save
+   backup up to the last complete line we've seen), including the turn number
+   that each one saves, if we know it.
+
+   The index only caches information that's in the log itself; it's rebuilt
+   from the log if there's any sign that the log has been recovered since. */
+struct save_index_entry {
+    long offset;        /* of the start of the line */
+    long turn;          /* moves in the save; -1 if not known yet */
+    char type;          /* '*' or '~' */
+};
+
+static struct {
+    struct save_index_entry *entries;
+    int count, size;
+    int *backups;       /* indexes into entries of the save backups */
+    int backup_count, backup_size;
+    long start;         /* offset of the first line covered */
+    long end;           /* offset just past the last line covered */
+    int recovery_count;
+} save_index;
+
+static void
+save_index_reset(void)
+{
+    free(save_index.entries);
+    free(save_index.backups);
+    memset(&save_index, 0, sizeof save_index);
+}
+
+static void
+save_index_add(long offset, char type)
+{
+    struct save_index_entry *e;
+
+    if (save_index.count == save_index.size) {
+        save_index.size = save_index.size ? save_index.size * 2 : 256;
+        save_index.entries = realloc(save_index.entries, save_index.size *
+                                     sizeof *save_index.entries);
+        if (!save_index.entries)
+            panic("Out of memory indexing the log");
+    }
+    if (type == '*') {
+        if (save_index.backup_count == save_index.backup_size) {
+            save_index.backup_size = save_index.backup_size ?
+                save_index.backup_size * 2 : 32;
+            save_index.backups = realloc(save_index.backups,
+                                         save_index.backup_size *
+                                         sizeof *save_index.backups);
+            if (!save_index.backups)
+                panic("Out of memory indexing the log");
+        }
+        save_index.backups[save_index.backup_count++] = save_index.count;
+    }
+
+    e = &save_index.entries[save_index.count++];
+    e->offset = offset;
+    e->turn = -1;
+    e->type = type;
+}
+
+/* Returns the byte at the given offset in the log, or -1 on error. */
+static int
+log_byte_at(long offset)
+{
+    unsigned char c;
+
+    if (log_lseek(program_state.logfile, offset, SEEK_SET) < 0 ||
+        !full_read(program_state.logfile, &c, 1))
+        return -1;
+    return c;
+}
+
+/* Does the log still look the way it did when the index was built? */
+static boolean
+save_index_still_valid(void)
+{
+    if (save_index.recovery_count != program_state.expected_recovery_count)
+        return FALSE;
+    if (save_index.end > save_index.start &&
+        log_byte_at(save_index.end - 1) != '\x0a')
+        return FALSE;
+    if (save_index.count &&
+        log_byte_at(save_index.entries[save_index.count - 1].offset) !=
+        save_index.entries[save_index.count - 1].type)
+        return FALSE;
+    return TRUE;
+}
+
+/* Makes the index cover from the given offset (which must be the start of a
+   line) to the last complete line in the log. This reads only the part of the
+   log that isn't already indexed. The caller must hold a read lock. */
+static void
+save_index_update(long from)
+{
+    char buf[65536];
+    long oldoffset = get_log_offset();
+    long bufpos, linestart;
+    char linetype = 0;
+    boolean at_linestart = TRUE;
+    int n;
+
+    if (save_index.end == 0 || from < save_index.start ||
+        !save_index_still_valid()) {
+        save_index_reset();
+        save_index.start = save_index.end = from;
+        save_index.recovery_count = program_state.expected_recovery_count;
+    }
+
+    bufpos = linestart = save_index.end;
+    log_lseek(program_state.logfile, bufpos, SEEK_SET);
+    lgetline_sync();
+    while ((n = read(program_state.logfile, buf, sizeof buf)) != 0) {
+        char *p = buf, *nl;
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        while (p < buf + n) {
+            if (at_linestart) {
+                linetype = *p;
+                at_linestart = FALSE;
+            }
+            nl = memchr(p, '\x0a', buf + n - p);
+            if (!nl)
+                break;
+
+            if (linetype == '*' || linetype == '~')
+                save_index_add(linestart, linetype);
+            p = nl + 1;
+            linestart = bufpos + (p - buf);
+            save_index.end = linestart;
+            at_linestart = TRUE;
+        }
+        bufpos += n;
+    }
+
+    log_lseek(program_state.logfile, oldoffset, SEEK_SET);
+}
+
+/* Returns the position in save_index.entries of the save line at the given
+   offset, or -1 if it isn't indexed. */
+static int
+save_index_find(long offset)
+{
+    int lo = 0, hi = save_index.count - 1;
+
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+
+        if (save_index.entries[mid].offset == offset)
+            return mid;
+        if (save_index.entries[mid].offset < offset)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return -1;
+}
+
+/* Returns the offset of the first save line after the line at the given
+   offset, or -1 if the index doesn't know of one (it might be in a part of
+   the log that was written after the index was updated). */
+static long
+save_index_next(long offset)
+{
+    int lo = 0, hi = save_index.count;
+
+    if (offset < save_index.start || offset >= save_index.end)
+        return -1;
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+
+        if (save_index.entries[mid].offset <= offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo < save_index.count ? save_index.entries[lo].offset : -1;
+}
+
+/* Records that the binary save is the save on the line at the given offset. */
+static void
+save_index_note_turn(long offset)
+{
+    int i = save_index_find(offset);
+
+    if (i >= 0 && save_index.entries[i].turn < 0)
+        save_index.entries[i].turn =
+            binary_save_turn(&program_state.binary_save);
+}
+
+/* Returns the turn number of the nth save backup in the index, decoding the
+   backup if we haven't seen it before. */
+static long
+save_index_backup_turn(int n)
+{
+    struct save_index_entry *e = &save_index.entries[save_index.backups[n]];
+
+    if (e->turn < 0) {
+        long oldoffset = get_log_offset();
+        struct memfile mf;
+        char *logline;
+
+        log_lseek(program_state.logfile, e->offset, SEEK_SET);
+        logline = lgetline(program_state.logfile);
+        if (!logline)
+            error_reading_save("EOF when reading save backup\n");
+
+        mnew(&mf, NULL);
+        decode_save_backup(logline, &mf);
+        e->turn = binary_save_turn(&mf);
+        mfree(&mf);
+
+        log_lseek(program_state.logfile, oldoffset, SEEK_SET);
+    }
+
+    return e->turn;
+}
+
+/* Returns the offset of the last save backup in the index that isn't after
+   the target location (or the first one, if they all are), or -1 if the index
+   doesn't contain any save backups. */
+static long
+save_index_backup_before(long target, enum target_location_units tlu)
+{
+    int lo = 0, hi = save_index.backup_count - 1;
+
+    if (!save_index.backup_count)
+        return -1;
+
+    /* Binary search for the last backup that's no later than the target. */
+    while (lo < hi) {
+        int mid = hi - (hi - lo) / 2;
+        long value;
+
+        switch (tlu) {
+        case TLU_EOF:
+            value = LONG_MIN;
+            break;
+        case TLU_BYTES:
+            value = save_index.entries[save_index.backups[mid]].offset;
+            break;
+        case TLU_TURNS:
+            value = save_index_backup_turn(mid);
+            break;
+        default:
+            panic("Invalid target_location_units");
+        }
+
+        if (value <= target)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    return save_index.entries[save_index.backups[lo]].offset;
+}
+
+/***** Replay keyframe cache *****/
+
+/* When replaying, the user can seek backwards, which normally means going back
+   to a save backup on disk and applying every save diff from there. To make
+   that faster, we keep copies of the binary save at regular turn intervals
+   as we pass them, within a memory budget (set via NH4REPLAYCACHE, in
+   megabytes), discarding the least recently used ones when we go over. This
+   is only done in replay mode, where the part of the log we've seen can't
+   change underneath us except via recovery (which we check for). */
+#define KEYFRAME_INTERVAL_TURNS 20
+#define KEYFRAME_DEFAULT_BUDGET_MB 64
+
+struct keyframe {
+    struct memfile save;        /* an absolute binary save */
+    long location;              /* the binary save location it corresponds to */
+    long backup_location;       /* the save backup location at the time */
+    long turn;
+    unsigned long last_used;
+};
+
+static struct {
+    struct keyframe *frames;
+    int count, size;
+    long bytes;
+    long budget;
+    unsigned long clock;
+    int recovery_count;
+} keyframes = {.budget = KEYFRAME_DEFAULT_BUDGET_MB * 1024L * 1024L};
+
+static void
+read_keyframe_cache_budget(void)
+{
+    const char *budget = nh_getenv("NH4REPLAYCACHE");
+
+    keyframes.budget = KEYFRAME_DEFAULT_BUDGET_MB * 1024L * 1024L;
+    if (budget && *budget) {
+        if (digit(*budget))
+            keyframes.budget = atol(budget) * 1024L * 1024L;
+        else
+            paniclog("replay_cache",
+                     "NH4REPLAYCACHE is not a number; using the default");
+    }
+}
+
+static void
+keyframe_cache_reset(void)
+{
+    int i;
+
+    for (i = 0; i < keyframes.count; i++)
+        mfree(&keyframes.frames[i].save);
+    free(keyframes.frames);
+    keyframes.frames = NULL;
+    keyframes.count = keyframes.size = 0;
+    keyframes.bytes = 0;
+    keyframes.clock = 0;
+}
+
+/* Copies just the contents of a memfile (without tags or diff information),
+   which is all a binary save needs. */
+static void
+keyframe_copy(struct memfile *to, const struct memfile *from)
+{
+    mnew(to, NULL);
+    memcpy(mmmap(to, from->pos, 0), from->buf, from->pos);
+}
+
+static boolean
+keyframe_cache_usable(void)
+{
+    if (program_state.followmode != FM_REPLAY || keyframes.budget <= 0)
+        return FALSE;
+    if (keyframes.recovery_count != program_state.expected_recovery_count) {
+        keyframe_cache_reset();
+        keyframes.recovery_count = program_state.expected_recovery_count;
+    }
+    return TRUE;
+}
+
+static void
+keyframe_cache_evict(int n)
+{
+    keyframes.bytes -= keyframes.frames[n].save.pos;
+    mfree(&keyframes.frames[n].save);
+    keyframes.frames[n] = keyframes.frames[--keyframes.count];
+}
+
+/* Called by log_sync whenever it has just moved the binary save forwards to
+   the save line at location; keeps a copy if there isn't one nearby. */
+static void
+keyframe_cache_note(long location)
+{
+    struct keyframe *kf;
+    long turn, size;
+    int i, lru;
+
+    if (!keyframe_cache_usable())
+        return;
+
+    turn = binary_save_turn(&program_state.binary_save);
+    size = program_state.binary_save.pos;
+    if (size > keyframes.budget)
+        return;
+
+    for (i = 0; i < keyframes.count; i++)
+        if (keyframes.frames[i].turn / KEYFRAME_INTERVAL_TURNS ==
+            turn / KEYFRAME_INTERVAL_TURNS)
+            return;
+
+    while (keyframes.count && keyframes.bytes + size > keyframes.budget) {
+        lru = 0;
+        for (i = 1; i < keyframes.count; i++)
+            if (keyframes.frames[i].last_used <
+                keyframes.frames[lru].last_used)
+                lru = i;
+        keyframe_cache_evict(lru);
+    }
+
+    if (keyframes.count == keyframes.size) {
+        keyframes.size = keyframes.size ? keyframes.size * 2 : 64;
+        keyframes.frames = realloc(keyframes.frames,
+                                   keyframes.size * sizeof *keyframes.frames);
+        if (!keyframes.frames)
+            panic("Out of memory in keyframe_cache_note");
+    }
+
+    kf = &keyframes.frames[keyframes.count++];
+    keyframe_copy(&kf->save, &program_state.binary_save);
+    kf->location = location;
+    kf->backup_location = program_state.save_backup_location;
+    kf->turn = turn;
+    kf->last_used = ++keyframes.clock;
+    keyframes.bytes += size;
+}
+
+/* If there's a keyframe that log_sync can start from to reach the given
+   target, and it's later in the log than not_before, loads it into the binary
+   save (setting the binary save and save backup locations), and returns TRUE.
+
+   When seeking to a turn, log_sync stops at the first save for that turn, so
+   we can only use a keyframe from an earlier turn (the keyframe might not be
+   the first save for its turn). When seeking to a byte offset, any keyframe
+   at or before it will do. */
+static boolean
+keyframe_cache_load(long target, enum target_location_units tlu,
+                    long not_before)
+{
+    struct keyframe *best = NULL;
+    int i;
+
+    if (!keyframe_cache_usable())
+        return FALSE;
+
+    for (i = 0; i < keyframes.count; i++) {
+        struct keyframe *kf = &keyframes.frames[i];
+
+        if (kf->location <= not_before)
+            continue;
+        if (tlu == TLU_BYTES && kf->location > target)
+            continue;
+        if (tlu == TLU_TURNS && kf->turn >= target)
+            continue;
+        if (!best || kf->location > best->location)
+            best = kf;
+    }
+
+    if (!best)
+        return FALSE;
+
+    if (program_state.binary_save_allocated)
+        mfree(&program_state.binary_save);
+    keyframe_copy(&program_state.binary_save, &best->save);
+    program_state.binary_save_allocated = TRUE;
+    program_state.binary_save_location = best->location;
+    program_state.save_backup_location = best->backup_location;
+    best->last_used = ++keyframes.clock;
+    return TRUE;
+}
+
 /* Returns positive if the binary save is ahead of the target location, negative
    if the binary save is behind the target location, zero if they're the
    same. The argument is the binary save location; while the invariants hold,
@@ -2143,27 +3322,19 @@ cleanup:
 static long
 relative_to_target(long bsl, long targetpos, enum target_location_units tlu)
 {
-    long temp_pos = program_state.binary_save.pos;
     long curv;
 
     switch (tlu) {
 
     case TLU_EOF:
-        targetpos = lseek(program_state.logfile, 0, SEEK_END);
+        targetpos = log_lseek(program_state.logfile, 0, SEEK_END);
         /* fall through */
     case TLU_BYTES:
         curv = bsl;
         break;
 
     case TLU_TURNS:
-
-        program_state.binary_save.pos = 0;
-        if (!uptodate(&program_state.binary_save, NULL))
-            error_reading_save(
-                "binary save is from the wrong version of NetHack\n");
-
-        curv = mread32(&program_state.binary_save);
-        program_state.binary_save.pos = temp_pos;
+        curv = binary_save_turn(&program_state.binary_save);
         break;
 
     default:
@@ -2274,9 +3445,29 @@ log_sync(long target_location, enum target_location_units tlu,
 
     }
 
-    /* If we're ahead of the target, move back to the last save backup (because
-       we can't run save diffs backwards, our only choice is to move forwards
-       from the save backup location). */
+    /* If we're ahead of the target, move back to the last save backup that
+       isn't (because we can't run save diffs backwards, our only choice is to
+       move forwards from a save backup). The index finds it directly; the
+       back-links between save backups are a fallback in case it can't. */
+    if (program_state.last_save_backup_location_location > 0 &&
+        relative_to_target(program_state.binary_save_location,
+                           target_location, tlu) > 0) {
+        save_index_update(program_state.last_save_backup_location_location - 1);
+        sloc = save_index_backup_before(target_location, tlu);
+        if (keyframe_cache_load(target_location, tlu, sloc)) {
+            /* a cached save that's nearer the target than sloc */
+        } else if (sloc >= 0) {
+            load_save_backup_from_offset(sloc);
+            save_index_note_turn(sloc);
+        }
+    } else if (relative_to_target(program_state.binary_save_location,
+                                  target_location, tlu) < 0) {
+        /* If we've been further forwards before, we might be able to skip
+           some save diffs. */
+        keyframe_cache_load(target_location, tlu,
+                            program_state.binary_save_location);
+    }
+
     if (program_state.binary_save_location != program_state.save_backup_location
         && relative_to_target(program_state.binary_save_location,
                               target_location, tlu) > 0) {
@@ -2300,12 +3491,19 @@ log_sync(long target_location, enum target_location_units tlu,
     }
 
     /* If we're behind the target, move forwards until we're at or ahead of the
-       target, via adding together diffs.
+       target, via adding together diffs. When the target is a byte offset, we
+       can skip straight to the last save backup before it. (We don't do that
+       for turn targets, because it could mean decoding several backups.) */
+    save_index_update(program_state.save_backup_location);
+    if (tlu == TLU_BYTES || tlu == TLU_EOF) {
+        sloc = save_index_backup_before(
+            tlu == TLU_EOF ? LONG_MAX : target_location, TLU_BYTES);
+        if (sloc > program_state.binary_save_location) {
+            load_save_backup_from_offset(sloc);
+            save_index_note_turn(sloc);
+        }
+    }
 
-       TODO: We could increase the loading speed via caching the end location of
-       the save diff / backup, rather than skipping it each time round the
-       loop. That isn't implemented yet in order to start off by getting the
-       simplest possible version of the code working. */
     sloc = program_state.binary_save_location;
     long loadamt;
     long orig_loadamt = 0;
@@ -2321,18 +3519,32 @@ log_sync(long target_location, enum target_location_units tlu,
             last_load_progress_time = now;
         }
 
-        lseek(program_state.logfile, sloc, SEEK_SET);
-        /* Skip the save diff or backup itself. */
-        free(lgetline_malloc(program_state.logfile));
-
-        /* Look for the next save diff or backup line. */
-        for ((loglineloc = get_log_offset()),
-                 (logline = lgetline_malloc(program_state.logfile));
-             logline;
-             free(logline), (loglineloc = get_log_offset()),
-                 (logline = lgetline_malloc(program_state.logfile))) {
-            if (*logline == '*' || *logline == '~')
-                break;
+        /* Look for the next save diff or backup line: it's the next line in
+           the index, if the index has one. Otherwise, there's no save line in
+           the indexed part of the log after sloc, so we read lines from the end
+           of that (or the line after sloc, if the index doesn't cover sloc)
+           until we find one. */
+        loglineloc = save_index_next(sloc);
+        if (loglineloc >= 0) {
+            log_lseek(program_state.logfile, loglineloc, SEEK_SET);
+            logline = lgetline(program_state.logfile);
+        } else {
+            if (sloc >= save_index.start && sloc < save_index.end) {
+                log_lseek(program_state.logfile, save_index.end, SEEK_SET);
+            } else {
+                log_lseek(program_state.logfile, sloc, SEEK_SET);
+                /* Skip the save diff or backup itself. */
+                lgetline(program_state.logfile);
+            }
+
+            for ((loglineloc = get_log_offset()),
+                     (logline = lgetline(program_state.logfile));
+                 logline;
+                 (loglineloc = get_log_offset()),
+                     (logline = lgetline(program_state.logfile))) {
+                if (*logline == '*' || *logline == '~')
+                    break;
+            }
         }
 
         if (!logline) {
@@ -2368,7 +3580,6 @@ log_sync(long target_location, enum target_location_units tlu,
             if (!program_state.binary_save_allocated) /* should never happen */
                 panic("overshoot in log_sync but no binary save present");
 
-            free(logline);
             mfree(&program_state.binary_save);
             program_state.binary_save = bsave;
 
@@ -2384,11 +3595,12 @@ log_sync(long target_location, enum target_location_units tlu,
             sloc = program_state.binary_save_location = loglineloc;
             if (*logline == '*')
                 program_state.save_backup_location = loglineloc;
+            save_index_note_turn(loglineloc);
+            keyframe_cache_note(loglineloc);
 
             mfree(&bsave);
         }
 
-        free(logline);
     }
 
     /* Fix the invariant on the gamestate. */
@@ -2424,10 +3636,10 @@ log_replay_save_line(void)
         if (!change_fd_lock(program_state.logfile, TRUE, LT_READ, 2))
             panic("Could not upgrade to read lock on logfile");
 
-        lseek(program_state.logfile,
+        log_lseek(program_state.logfile,
               program_state.end_of_gamestate_location, SEEK_SET);
 
-        logline = lgetline_malloc(program_state.logfile);
+        logline = lgetline(program_state.logfile);
 
         if (!change_fd_lock(program_state.logfile, TRUE, LT_MONITOR, 2))
             panic("Could not downgrade to monitor lock on logfile");
@@ -2471,16 +3683,838 @@ log_replay_save_line(void)
 
     }
 
-    free(logline);
-
     /* otherwise do nothing */
 }
 
-/***** Memory management *****/
+/***** Log compaction *****/
+
+/* nh_compact_savegame rewrites the log of a game that isn't being played into a
+   new file, changing only which save lines are backups and which are diffs.
+   During play, that choice is made by the heuristic in log_neutral_turnstate,
+   which can leave a game with long runs of diffs (slow to seek through when
+   replaying) or with backups much closer together than they need to be (large
+   on disk). Compaction places a backup whenever a byte budget (bytes of log
+   since the previous backup) or a turn budget runs out, and uses diffs
+   everywhere else.
+
+   A save diff depends only on the contents of the previous binary save, not on
+   whether that save was stored as a backup or a diff. So most save lines can be
+   reused: a diff that stays a diff is copied verbatim, as is the data of a
+   backup that stays a backup (only its header changes), and a diff that
+   becomes a backup is encoded from the binary save. A backup that becomes a
+   diff needs a new diff. There's no gamestate to run savegame() on here, so
+   the tags it would place aren't available; instead, both saves are tagged at
+   content-based anchors, which lets the diff resynchronize after data has been
+   inserted or removed. If that diff isn't smaller than the backup, the backup
+   is kept.
+
+   Everything other than save lines is copied unchanged, so the result replays
+   the same commands. Once it's written, the result is read back and every
+   binary save in it is checked against the original. */
+
+#define COMPACT_OUTBUF_SIZE 65536
+
+/* Anchors are placed where a rolling hash of the last 32 bytes has its top 8
+   bits clear (about one every 256 bytes), but no closer together than this. */
+#define COMPACT_ANCHOR_MASK 0xff000000U
+#define COMPACT_ANCHOR_MIN_GAP 32
+
+struct compact_save_summary {
+    unsigned long crc;
+    int len;
+};
+
+static struct {
+    int infd, outfd;
+    boolean infd_locked;
+
+    /* Output is buffered, as most lines are short. */
+    char *outbuf;
+    int outbuflen;
+    long outflushed;    /* bytes of output written before outbuf */
+
+    /* The binary saves for the previous and current save lines, and the final
+       binary save of the game. */
+    struct memfile prev, cur, final;
+    boolean prev_allocated, cur_allocated, final_allocated;
+
+    /* A summary of each binary save in the original log, so that the output
+       can be checked against it. */
+    struct compact_save_summary *saves;
+    long nsaves, maxsaves;
+} compaction;
+
+static void
+compact_flush(void)
+{
+    if (!compaction.outbuflen)
+        return;
+
+    if (!full_write(compaction.outfd, compaction.outbuf, compaction.outbuflen))
+        error_reading_save("Could not write the compacted save file\n");
+
+    compaction.outflushed += compaction.outbuflen;
+    compaction.outbuflen = 0;
+}
+
+static void
+compact_write(const char *buf, long len)
+{
+    if (compaction.outbuflen + len > COMPACT_OUTBUF_SIZE)
+        compact_flush();
+
+    if (len > COMPACT_OUTBUF_SIZE) {
+        if (!full_write(compaction.outfd, buf, len))
+            error_reading_save("Could not write the compacted save file\n");
+        compaction.outflushed += len;
+        return;
+    }
+
+    memcpy(compaction.outbuf + compaction.outbuflen, buf, len);
+    compaction.outbuflen += len;
+}
+
+static void
+compact_write_line(const char *line)
+{
+    compact_write(line, strlen(line));
+    compact_write("\x0a", 1);
+}
+
+/* Returns the offset in the output that the next write will go to. */
+static long
+compact_offset(void)
+{
+    return compaction.outflushed + compaction.outbuflen;
+}
+
+static void
+compact_free_save(struct memfile *mf, boolean *allocated)
+{
+    if (*allocated)
+        mfree(mf);
+    *allocated = FALSE;
+}
+
+static void
+compact_cleanup(void)
+{
+    if (compaction.infd_locked)
+        change_fd_lock(compaction.infd, FALSE, LT_NONE, 0);
+    compaction.infd_locked = FALSE;
+
+    free(compaction.outbuf);
+    compaction.outbuf = NULL;
+    compaction.outbuflen = 0;
+    compaction.outflushed = 0;
+
+    compact_free_save(&compaction.prev, &compaction.prev_allocated);
+    compact_free_save(&compaction.cur, &compaction.cur_allocated);
+    compact_free_save(&compaction.final, &compaction.final_allocated);
+
+    free(compaction.saves);
+    compaction.saves = NULL;
+    compaction.nsaves = compaction.maxsaves = 0;
+
+    lgetline_free();
+}
+
+static noreturn void
+compact_diff_error(const char *s, char *buf)
+{
+    free(buf);
+    error_reading_save(s);
+}
+
+/* Decodes a save line into compaction.cur, using compaction.prev as the base
+   for diffs. */
+static void
+compact_decode_save(char *logline, long lineloc)
+{
+    compact_free_save(&compaction.cur, &compaction.cur_allocated);
+    mnew(&compaction.cur, NULL);
+    compaction.cur_allocated = TRUE;
+
+    if (*logline == '*')
+        decode_save_backup(logline, &compaction.cur);
+    else if (compaction.prev_allocated)
+        decode_save_diff(logline, &compaction.prev, &compaction.cur,
+                         compact_diff_error);
+    else
+        error_reading_save(msgprintf(
+                               "Save diff with no save to apply it to at %ld\n",
+                               lineloc));
+}
+
+/* Makes the current binary save the previous one. */
+static void
+compact_next_save(void)
+{
+    compact_free_save(&compaction.prev, &compaction.prev_allocated);
+    compaction.prev = compaction.cur;
+    compaction.prev_allocated = compaction.cur_allocated;
+    compaction.cur_allocated = FALSE;
+}
+
+static unsigned long
+compact_save_crc(struct memfile *mf)
+{
+    return crc32(crc32(0L, Z_NULL, 0), (unsigned char *)mf->buf, mf->pos);
+}
+
+/* Writes len bytes of buf to mf, tagging them at content-based anchors. The
+   same data gets the same anchors wherever it is in a save, so if mf is
+   relative to a memfile that was written the same way, mtag will seek to the
+   matching data in it. */
+static void
+compact_write_anchored(struct memfile *mf, const char *buf, long len)
+{
+    uint32_t hash = 0;
+    long i, written = 0;
+
+    for (i = 0; i < len; i++) {
+        /* Each byte's contribution is shifted out of the top bits of the hash
+           after 32 more bytes. */
+        hash = (hash << 1) + ((unsigned char)buf[i] + 1) * 0x9e3779b1U;
+
+        if (!(hash & COMPACT_ANCHOR_MASK) &&
+            i + 1 - written >= COMPACT_ANCHOR_MIN_GAP) {
+            mwrite(mf, buf + written, i + 1 - written);
+            written = i + 1;
+            mtag(mf, hash, MTAG_ANCHOR);
+        }
+    }
+
+    mwrite(mf, buf + written, len - written);
+}
+
+/* Returns a save diff line (which the caller must free) that turns
+   compaction.prev into compaction.cur. */
+static char *
+compact_rediff(int *linelen)
+{
+    struct memfile base, mf;
+    char *line;
+
+    mnew(&base, NULL);
+    compact_write_anchored(&base, compaction.prev.buf, compaction.prev.pos);
+    mnew(&mf, &base);
+    compact_write_anchored(&mf, compaction.cur.buf, compaction.cur.pos);
+    mdiffflush(&mf, 1);
+
+    line = malloc(base64size(mf.diffpos) + 1);
+    line[0] = '~';
+    *linelen = 1 + base64_encode_binary((unsigned char *)mf.diffbuf, line + 1,
+                                        mf.diffpos);
+
+    mfree(&mf);
+    mfree(&base);
+    return line;
+}
+
+/* Copies the log on compaction.infd to compaction.outfd, choosing afresh where
+   to put save backups. */
+static void
+compact_log(long backup_bytes, long backup_turns, struct nh_compact_info *ci)
+{
+    char *logline, *newline;
+    char header[11];
+    long lineloc, loglen, turn = 0;
+    long first_backup = -1, last_backup = 0, last_backup_turn = 0;
+    int i, newlen;
+    boolean backup;
+
+    memset(ci, 0, sizeof *ci);
+
+    loglen = log_lseek(compaction.infd, 0, SEEK_END);
+    log_lseek(compaction.infd, 0, SEEK_SET);
+
+    /* read_log_header has already checked the header lines. */
+    for (i = 0; i < 3; i++)
+        compact_write_line(lgetline(compaction.infd));
+
+    while ((lineloc = log_lseek(compaction.infd, 0, SEEK_CUR)),
+           (logline = lgetline(compaction.infd))) {
+
+        if (*logline != '*' && *logline != '~') {
+            compact_write_line(logline);
+            continue;
+        }
+
+        compact_decode_save(logline, lineloc);
+
+        if (compaction.nsaves == compaction.maxsaves) {
+            compaction.maxsaves = compaction.maxsaves * 2 + 256;
+            compaction.saves = realloc(compaction.saves, compaction.maxsaves *
+                                       sizeof *compaction.saves);
+            if (!compaction.saves)
+                panic("Out of memory compacting save file");
+        }
+        compaction.saves[compaction.nsaves].crc =
+            compact_save_crc(&compaction.cur);
+        compaction.saves[compaction.nsaves].len = compaction.cur.pos;
+        compaction.nsaves++;
+
+        if (*logline == '*')
+            ci->backups_before++;
+        if (backup_turns)
+            turn = binary_save_turn(&compaction.cur);
+
+        backup = first_backup < 0 ||
+            (backup_bytes && compact_offset() - last_backup >= backup_bytes) ||
+            (backup_turns && turn - last_backup_turn >= backup_turns);
+
+        newline = NULL;
+        if (!backup && *logline == '*') {
+            /* Compare to the size of the backup's data, after the header. */
+            newline = compact_rediff(&newlen);
+            if (newlen >= (long)strlen(logline) - 10) {
+                free(newline);
+                newline = NULL;
+                backup = TRUE;
+            }
+        }
+
+        if (backup) {
+            /* The first backup points to the last one, which we don't know
+               yet; it's filled in at the end. */
+            long o = compact_offset();
+
+            snprintf(header, sizeof header, "*%08lx ",
+                     first_backup < 0 ? 0 : last_backup);
+            compact_write(header, 10);
+
+            if (*logline == '*') {
+                compact_write_line(logline + 10);
+            } else {
+                char *b64buf = malloc(base64size(compaction.cur.pos));
+                int b64len = base64_encode_binary(
+                    (unsigned char *)compaction.cur.buf, b64buf,
+                    compaction.cur.pos);
+
+                compact_write(b64buf, b64len);
+                compact_write("\x0a", 1);
+                free(b64buf);
+            }
+
+            if (first_backup < 0)
+                first_backup = o;
+            last_backup = o;
+            last_backup_turn = turn;
+            ci->backups_after++;
+
+        } else if (newline) {
+            compact_write(newline, newlen);
+            compact_write("\x0a", 1);
+            free(newline);
+        } else {
+            compact_write_line(logline);
+        }
+
+        compact_next_save();
+    }
+
+    if (lineloc != loglen)
+        error_reading_save(msgprintf(
+                               "Save file ends with a partial line at %ld\n",
+                               lineloc));
+
+    compact_flush();
+
+    if (first_backup >= 0) {
+        snprintf(header, sizeof header, "%08lx", last_backup);
+        if (log_lseek(compaction.outfd, first_backup + 1, SEEK_SET) < 0 ||
+            !full_write(compaction.outfd, header, 8))
+            error_reading_save("Could not write the compacted save file\n");
+        log_lseek(compaction.outfd, 0, SEEK_END);
+    }
+
+    /* Keep the final binary save for compact_verify. */
+    compaction.final = compaction.prev;
+    compaction.final_allocated = compaction.prev_allocated;
+    compaction.prev_allocated = FALSE;
+
+    ci->save_lines = compaction.nsaves;
+    ci->size_before = loglen;
+    ci->size_after = compact_offset();
+}
+
+/* Reads back the log written by compact_log, and checks that it has the same
+   binary saves as the original, and that its backups point to each other
+   correctly. */
+static void
+compact_verify(void)
+{
+    char *logline;
+    const char *reason;
+    long lineloc, n = 0, first_backup = -1, last_backup = 0, link;
+    int i;
+
+    log_lseek(compaction.outfd, 0, SEEK_SET);
+    for (i = 0; i < 3; i++)
+        if (!lgetline(compaction.outfd))
+            error_reading_save("Compacted save file has no header\n");
+
+    while ((lineloc = log_lseek(compaction.outfd, 0, SEEK_CUR)),
+           (logline = lgetline(compaction.outfd))) {
+
+        if (*logline != '*' && *logline != '~')
+            continue;
+
+        if (*logline == '*') {
+            link = strtol(logline + 1, NULL, 16);
+            if (first_backup < 0)
+                first_backup = lineloc;
+            else if (link != last_backup)
+                error_reading_save(msgprintf(
+                                       "Compacted save file has a bad backup "
+                                       "link at %ld\n", lineloc));
+            last_backup = lineloc;
+        }
+
+        compact_decode_save(logline, lineloc);
+
+        if (n >= compaction.nsaves ||
+            compaction.saves[n].len != compaction.cur.pos ||
+            compaction.saves[n].crc != compact_save_crc(&compaction.cur))
+            error_reading_save(msgprintf(
+                                   "Compacted save file has a different binary "
+                                   "save at %ld\n", lineloc));
+        n++;
+
+        compact_next_save();
+    }
+
+    if (n != compaction.nsaves)
+        error_reading_save("Compacted save file is missing save lines\n");
+
+    if (first_backup >= 0) {
+        log_lseek(compaction.outfd, first_backup, SEEK_SET);
+        logline = lgetline(compaction.outfd);
+        if (!logline || strtol(logline + 1, NULL, 16) != last_backup)
+            error_reading_save("Compacted save file does not point to its "
+                               "last backup\n");
+    }
+
+    if (compaction.final_allocated &&
+        (!compaction.prev_allocated ||
+         !mequal(&compaction.final, &compaction.prev, &reason)))
+        error_reading_save(msgprintf(
+                               "Compacted save file has a different final "
+                               "binary save: %s\n",
+                               compaction.prev_allocated ? reason : "missing"));
+}
+
+/* Writes a copy of the log on infd to outfd (which must be empty, and open for
+   reading as well as writing), with save backups placed as described above:
+   once there are backup_bytes bytes of log since the previous backup, or the
+   turn counter has advanced by backup_turns since then (either may be 0 to
+   turn it off). The game must not be in progress. The original is not changed.
+   Returns FALSE, after printing the reason, if the compaction failed; outfd may
+   then contain a partial copy. */
+nh_bool
+nh_compact_savegame(int infd, int outfd, long backup_bytes, long backup_turns,
+                    struct nh_compact_info *ci)
+{
+    struct nh_compact_info dummy;
+    struct nh_game_info gi;
+    enum nh_log_status status;
+    int recovery_count;
+
+    API_ENTRY_CHECKPOINT() {
+    IF_ANY_API_EXCEPTION():
+        compact_cleanup();
+        return FALSE;
+    }
+
+    xmalloc_cleanup(&api_blocklist);
+
+    if (program_state.game_running) {
+        raw_print("Cannot compact a save file while a game is running");
+        API_EXIT();
+        return FALSE;
+    }
+
+    compaction.infd = infd;
+    compaction.outfd = outfd;
+    if (!change_fd_lock(infd, FALSE, LT_READ, 1))
+        error_reading_save("The game is being played\n");
+    compaction.infd_locked = TRUE;
+
+    status = read_log_header(infd, &gi, &recovery_count, FALSE);
+    if (status != LS_SAVED && status != LS_DONE)
+        error_reading_save("Not a saved or finished NetHack Fourk game\n");
+
+    read_save_compression_level();
+    compaction.outbuf = malloc(COMPACT_OUTBUF_SIZE);
+
+    compact_log(backup_bytes, backup_turns, ci ? ci : &dummy);
+    compact_verify();
+
+    compact_cleanup();
+    API_EXIT();
+    return TRUE;
+}
+
+/***** Offline verification *****/
+
+/* Checks a game that log_sync() just loaded. log_sync() loads the gamestate
+   with maybe_old_version set, so a save that doesn't save back the same way
+   isn't an error; instead, it's no longer OK to diff against. We report that
+   rather than trying to recover the game. */
+static void
+verify_loaded_save(struct nh_verify_info *vi)
+{
+    struct memfile mf;
+    const char *reason;
+
+    vi->saves_checked++;
+    if (program_state.ok_to_diff)
+        return;
+
+    if (!vi->saves_mismatched++) {
+        mnew(&mf, NULL);
+        savegame(&mf);
+        if (mequal(&program_state.binary_save, &mf, &reason))
+            reason = "save did not load correctly";
+        mfree(&mf);
+
+        vi->first_mismatch_turn = moves;
+        snprintf(vi->mismatch_reason, sizeof vi->mismatch_reason, "%s",
+                 reason);
+    }
+}
+
+/* Loads the game in fd the way that nh_play_game would (in replay mode, so
+   nothing is written to the file), and checks that the engine saves the
+   resulting gamestate the same way as the file does. The recent_saves save
+   lines before the last one are checked the same way. Returns FALSE if the
+   game couldn't be loaded at all; a game that loads but doesn't save back the
+   same way returns TRUE, with the problem described in vi. */
+nh_bool
+nh_verify_savegame(int fd, int recent_saves, struct nh_verify_info *vi)
+{
+    long *offsets, end_location;
+    int i, first, count;
+
+    API_ENTRY_CHECKPOINT() {
+    IF_ANY_API_EXCEPTION():
+        log_uninit();
+        return FALSE;
+    }
+
+    xmalloc_cleanup(&api_blocklist);
+
+    if (program_state.game_running) {
+        raw_print("Cannot verify a save file while a game is running");
+        API_EXIT();
+        return FALSE;
+    }
+
+    memset(vi, 0, sizeof *vi);
+
+    program_state.followmode = FM_REPLAY;
+    init_data(TRUE);
+    startup_common(TRUE);
+    log_init(fd);
+
+    log_sync(0, TLU_EOF, FALSE);
+    verify_loaded_save(vi);
+    vi->turn = moves;
+    end_location = program_state.binary_save_location;
+
+    /* log_sync() can change the index, so take a copy of the offsets. */
+    first = max(save_index.count - recent_saves - 1, 0);
+    count = save_index.count - first;
+    offsets = xmalloc(&api_blocklist, (count ? count : 1) * sizeof *offsets);
+    for (i = 0; i < count; i++)
+        offsets[i] = save_index.entries[first + i].offset;
+
+    for (i = 0; i < count && offsets[i] < end_location; i++) {
+        log_sync(offsets[i], TLU_BYTES, FALSE);
+        verify_loaded_save(vi);
+    }
+
+    freedynamicdata();
+    log_uninit();
+
+    API_EXIT();
+    return TRUE;
+}
+
+/***** Headless analysis *****/
+
+/* A game can be opened for analysis, then sampled at any number of points
+   (turns or log offsets, in any order), without a user interface: each sample
+   is just a log_sync() to the requested point, which loads saves from the log
+   without running commands, vision or rendering, followed by a copy of the
+   parts of the gamestate that statistics are usually gathered from. The save
+   index and keyframe cache make repeated samples of one file cheap.
+
+   Loading a save doesn't normally talk to the window procs at all; the few
+   calls it can make (load progress, and a menu if the log is corrupted) go to
+   the stubs here instead, so that a caller doesn't need a working interface.
+   The host's win_raw_print is still used for error messages. */
+
+static boolean analysis_open = FALSE;
+static boolean analysis_procs_active = FALSE;
+static struct nh_window_procs analysis_host_procs;
+
+static void
+analysis_pause(enum nh_pause_reason reason)
+{
+}
+
+static void
+analysis_display_buffer(const char *buf, nh_bool trymove)
+{
+}
+
+static void
+analysis_update_status(struct nh_player_info *pi)
+{
+}
+
+static void
+analysis_print_message(enum msg_channel msgc, const char *msg)
+{
+}
+
+/* Menus only appear if the game can't be loaded; report why, then cancel. */
+static void
+analysis_display_menu(struct nh_menulist *menulist, const char *title,
+                      int how, int placement_hint, void *callbackarg,
+                      void (*callback)(const int *, int, void *))
+{
+    int i;
+
+    for (i = 0; i < menulist->icount; i++)
+        if (menulist->items[i].role == MI_TEXT &&
+            *menulist->items[i].caption)
+            analysis_host_procs.win_raw_print(menulist->items[i].caption);
+    dealloc_menulist(menulist);
+    callback(NULL, -1, callbackarg);
+}
+
+static void
+analysis_display_objects(struct nh_objlist *objlist, const char *title,
+                         int how, int placement_hint, void *callbackarg,
+                         void (*callback)(const struct nh_objresult *, int,
+                                          void *))
+{
+    dealloc_objmenulist(objlist);
+    callback(NULL, -1, callbackarg);
+}
+
+static void
+analysis_list_items(struct nh_objlist *itemlist, nh_bool invent)
+{
+    dealloc_objmenulist(itemlist);
+}
+
+static void
+analysis_update_screen(struct nh_dbuf_entry dbuf[ROWNO][COLNO], int ux, int uy)
+{
+}
+
+static void
+analysis_delay(void)
+{
+}
+
+static void
+analysis_load_progress(int progress)
+{
+}
+
+static void
+analysis_level_changed(int displaymode)
+{
+}
+
+static void
+analysis_server_cancel(void)
+{
+}
+
+static void
+analysis_begin_call(void)
+{
+    analysis_host_procs = windowprocs;
+    analysis_procs_active = TRUE;
+
+    windowprocs.win_pause = analysis_pause;
+    windowprocs.win_display_buffer = analysis_display_buffer;
+    windowprocs.win_update_status = analysis_update_status;
+    windowprocs.win_print_message = analysis_print_message;
+    windowprocs.win_display_menu = analysis_display_menu;
+    windowprocs.win_display_objects = analysis_display_objects;
+    windowprocs.win_list_items = analysis_list_items;
+    windowprocs.win_update_screen = analysis_update_screen;
+    windowprocs.win_delay = analysis_delay;
+    windowprocs.win_load_progress = analysis_load_progress;
+    windowprocs.win_level_changed = analysis_level_changed;
+    windowprocs.win_server_cancel = analysis_server_cancel;
+}
+
+static void
+analysis_end_call(void)
+{
+    if (analysis_procs_active)
+        windowprocs = analysis_host_procs;
+    analysis_procs_active = FALSE;
+}
+
+static void
+analysis_cleanup(void)
+{
+    if (analysis_open) {
+        freedynamicdata();
+        log_uninit();
+    }
+    analysis_open = FALSE;
+}
+
+/* Is a game open for analysis? (If so, no game can be played.) */
+boolean
+analysis_is_open(void)
+{
+    return analysis_open;
+}
+
+/* Copies the parts of the loaded gamestate that nh_analysis_sample reports. */
+static void
+make_game_snapshot(struct nh_game_snapshot *snap)
+{
+    struct nh_objlist objlist;
+    struct obj *otmp;
+
+    memset(snap, 0, sizeof *snap);
+    make_player_info(&snap->pi);
+    snap->offset = program_state.binary_save_location;
+
+    snprintf(snap->dungeon_name, sizeof snap->dungeon_name, "%s",
+             find_dungeon(&u.uz).dname);
+    snap->dlevel = u.uz.dlevel;
+    snap->depth = depth(&u.uz);
+    snap->max_depth = deepest_lev_reached(FALSE);
+
+    init_objmenulist(&objlist);
+    for (otmp = invent; otmp; otmp = otmp->nobj)
+        add_objitem(&objlist, MI_NORMAL, otmp->invlet, doname(otmp), otmp,
+                    TRUE);
+    snap->invent_count = objlist.icount;
+    snap->invent = xmalloc(&api_blocklist, (objlist.icount ? objlist.icount : 1)
+                           * sizeof *snap->invent);
+    if (objlist.icount)
+        memcpy(snap->invent, objlist.items,
+               objlist.icount * sizeof *snap->invent);
+    dealloc_objmenulist(&objlist);
+}
+
+/* Opens the game in fd (which must stay open until nh_analysis_close) for
+   nh_analysis_sample. No game can be played while a game is open for analysis.
+   Returns FALSE if the game can't be opened. */
+nh_bool
+nh_analysis_open(int fd)
+{
+    API_ENTRY_CHECKPOINT() {
+    IF_ANY_API_EXCEPTION():
+        analysis_end_call();
+        analysis_cleanup();
+        return FALSE;
+    }
+
+    xmalloc_cleanup(&api_blocklist);
+
+    if (program_state.game_running || analysis_open) {
+        raw_print("Cannot analyze a save file while a game is open");
+        API_EXIT();
+        return FALSE;
+    }
+
+    analysis_begin_call();
+
+    program_state.followmode = FM_REPLAY;
+    init_data(TRUE);
+    startup_common(TRUE);
+    log_init(fd);
+    analysis_open = TRUE;
+
+    /* Check that the file is a game, by loading its first save. */
+    log_sync(0, TLU_BYTES, FALSE);
+
+    analysis_end_call();
+    API_EXIT();
+    return TRUE;
+}
+
+/* Moves the open game to the last save on or before target (a turn or log
+   offset; ignored for SU_EOF) and describes the game at that point in snap.
+   If there's no such save, the first save in the file is used. Returns FALSE,
+   and closes the game, if it can't be loaded. */
+nh_bool
+nh_analysis_sample(long target, enum nh_sample_units units,
+                   struct nh_game_snapshot *snap)
+{
+    API_ENTRY_CHECKPOINT() {
+    IF_ANY_API_EXCEPTION():
+        analysis_end_call();
+        analysis_cleanup();
+        return FALSE;
+    }
+
+    xmalloc_cleanup(&api_blocklist);
+
+    if (!analysis_open) {
+        raw_print("No save file is open for analysis");
+        API_EXIT();
+        return FALSE;
+    }
+
+    analysis_begin_call();
+
+    switch (units) {
+    case SU_TURNS:
+        log_sync(target, TLU_TURNS, FALSE);
+        break;
+    case SU_BYTES:
+        log_sync(target, TLU_BYTES, FALSE);
+        break;
+    case SU_EOF:
+        log_sync(0, TLU_EOF, FALSE);
+        break;
+    }
+    make_game_snapshot(snap);
+
+    analysis_end_call();
+    API_EXIT();
+    return TRUE;
+}
+
+void
+nh_analysis_close(void)
+{
+    API_ENTRY_CHECKPOINT_RETURN_VOID_ON_ERROR();
+
+    xmalloc_cleanup(&api_blocklist);
+    analysis_cleanup();
+
+    API_EXIT();
+}
+
+/***** Memory management *****/
 
 static void
 log_reset(void)
 {
+    discard_deferred_save_verification();
+    save_index_reset();
+    keyframe_cache_reset();
+    log_discard_queue();
+    saves_since_verification = 0;
+    last_verified_ledger = 0;
+
     if (program_state.binary_save_allocated)
         mfree(&program_state.binary_save);
     program_state.binary_save_allocated = FALSE;
@@ -2508,12 +4542,26 @@ log_init(int logfd)
         terminate(ERR_IN_PROGRESS);
     }
 
+    read_save_verify_policy();
+    read_save_compression_level();
+    read_keyframe_cache_budget();
+    read_log_durability_policy();
+    read_save_stats_file();
+    rng_profile_init();
+    extrinsic_cache_init();
     log_reset();
 }
 
 void
 log_uninit(void)
 {
+    /* The queue should be empty already, as it's flushed at the end of every
+       update; but if not, we no longer know it's safe to write. */
+    log_discard_queue();
+
+    if (program_state.logfile > -1 && log_durability.unsynced)
+        log_sync_to_disk();
+
     if (program_state.logfile > -1)
         change_fd_lock(program_state.logfile, TRUE, LT_NONE, 0);
 
@@ -2523,6 +4571,14 @@ log_uninit(void)
 
     program_state.logfile = -1;
 
+    if (save_stats_file)
+        fclose(save_stats_file);
+    save_stats_file = NULL;
+
+    rng_profile_uninit();
+    discard_deferred_save_verification();
+    lgetline_free();
+
     /* We need to do this so that init_data doesn't leak memory when it's told
        to reinitialize the program_state; it can't rely on program_state.
        binary_save_allocated because for all it knows, that's uninitialized
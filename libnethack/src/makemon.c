@@ -874,6 +874,7 @@ clone_mon(struct monst *mon, xchar x, xchar y)
     m2->nmon = level->monlist;
     level->monlist = m2;
     m2->m_id = next_ident();
+    mon_index_add(&level->monindex, m2);
     m2->mx = mm.x;
     m2->my = mm.y;
 
@@ -1101,6 +1102,7 @@ makemon(const struct permonst *ptr, struct level *lev, int x, int y,
     mtmp->nmon = lev->monlist;
     lev->monlist = mtmp;
     mtmp->m_id = next_ident();
+    mon_index_add(&lev->monindex, mtmp);
     set_mon_data(mtmp, ptr, 0);
 
     if (mtmp->data->msound == MS_LEADER)
@@ -8,6 +8,9 @@
 #include <stdint.h>
 #include <inttypes.h>
 #include <zlib.h>
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
 
 #ifdef IS_BIG_ENDIAN
 static unsigned short
@@ -117,17 +120,17 @@ mnew(struct memfile *mf, struct memfile *relativeto)
 
     mdiffwrite(mf, diffheader, 2);
 
-    for (i = 0; i < MEMFILE_HASHTABLE_SIZE; i++)
-        mf->tags[i] = 0;
-    mf->last_tag = 0;
+    mf->tags = NULL;
+    mf->ntags = mf->maxtags = 0;
+    mf->tagtable = NULL;
+    mf->tagtable_size = 0;
+    mf->save_serial = 0;
 }
 
 /* Allocates to as a deep copy of from. */
 void
 mclone(struct memfile *to, const struct memfile *from)
 {
-    int i;
-
     *to = *from;
 
     if (from->buf) {
@@ -138,43 +141,37 @@ mclone(struct memfile *to, const struct memfile *from)
         to->diffbuf = malloc(to->difflen);
         memcpy(to->diffbuf, from->diffbuf, from->difflen);
     }
-
-    for (i = 0; i < MEMFILE_HASHTABLE_SIZE; i++) {
-        struct memfile_tag *fromtag, **totag;
-
-        fromtag = from->tags[i];
-        totag = &(to->tags[i]);
-
-        while (fromtag) {
-            *totag = malloc(sizeof (struct memfile_tag));
-            **totag = *fromtag;
-            fromtag = fromtag->next;
-            totag = &((*totag)->next);
-        }
-
-        *totag = 0;
+    if (from->tags) {
+        to->tags = malloc(from->maxtags * sizeof *to->tags);
+        memcpy(to->tags, from->tags, from->ntags * sizeof *to->tags);
+        to->tagtable = malloc(from->tagtable_size * sizeof *to->tagtable);
+        memcpy(to->tagtable, from->tagtable,
+               from->tagtable_size * sizeof *to->tagtable);
     }
 }
 
+/* The number of tags in the largest save we've seen. New memfiles that aren't
+   relative to another memfile use this to guess how many tags they'll need, so
+   that the tag array is normally allocated only once. This only affects
+   performance, not behaviour, so it doesn't need to be saved. */
+static int mtag_count_hint = 0;
+
 void
 mfree(struct memfile *mf)
 {
-    int i;
-
     free(mf->buf);
     mf->buf = 0;
     free(mf->diffbuf);
     mf->diffbuf = 0;
-    for (i = 0; i < MEMFILE_HASHTABLE_SIZE; i++) {
-        struct memfile_tag *tag, *otag;
 
-        for ((tag = mf->tags[i]), (otag = NULL); tag; tag = tag->next) {
-            free(otag);
-            otag = tag;
-        }
-        free(otag);
-        mf->tags[i] = 0;
-    }
+    if (mf->ntags > mtag_count_hint)
+        mtag_count_hint = mf->ntags;
+    free(mf->tags);
+    mf->tags = 0;
+    mf->ntags = mf->maxtags = 0;
+    free(mf->tagtable);
+    mf->tagtable = 0;
+    mf->tagtable_size = 0;
 }
 
 /* Functions for writing to a memory file.
@@ -211,6 +208,52 @@ mmmap(struct memfile *mf, long len, long off)
     return mf->buf + off;
 }
 
+/* Returns the number of bytes at the start of a and b (looking at no more than
+   len bytes) that are the same in both. Matching runs in a save diff are
+   typically very long, so this compares a vector or word at a time. */
+static unsigned int
+mdiff_match_len(const char *a, const char *b, unsigned int len)
+{
+    unsigned int i = 0;
+
+#ifdef __SSE2__
+    for (; i + 16 <= len; i += 16) {
+        unsigned int mask = _mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i)),
+                           _mm_loadu_si128((const __m128i *)(b + i))));
+        if (mask != 0xffff)
+            return i + __builtin_ctz(~mask);
+    }
+#endif
+
+    for (; i + 8 <= len; i += 8) {
+        uint64_t x, y;
+
+        memcpy(&x, a + i, 8);
+        memcpy(&y, b + i, 8);
+        if (x != y)
+            break;
+    }
+
+    while (i < len && a[i] == b[i])
+        i++;
+
+    return i;
+}
+
+/* Returns the number of bytes at the start of a and b (looking at no more than
+   len bytes) that differ. These runs are typically short. */
+static unsigned int
+mdiff_mismatch_len(const char *a, const char *b, unsigned int len)
+{
+    unsigned int i = 0;
+
+    while (i < len && a[i] != b[i])
+        i++;
+
+    return i;
+}
+
 void
 mwrite(struct memfile *mf, const void *buf, unsigned int num)
 {
@@ -220,28 +263,51 @@ mwrite(struct memfile *mf, const void *buf, unsigned int num)
     if (!mf->relativeto) {
         mf->pos += num;
     } else {
-        /* calculate and record the diff as well */
-        while (num--) {
-            if (mf->relativepos < mf->relativeto->pos &&
-                mf->buf[mf->pos] == mf->relativeto->buf[mf->relativepos]) {
+        /* calculate and record the diff as well
+
+           We handle a run of matching or differing bytes at a time. The result
+           is the same as handling one byte at a time: a byte that matches
+           flushes pending seeks and edits, then becomes a pending copy; a byte
+           that differs (or is past the end of relativeto) flushes pending
+           seeks, then becomes a pending edit. So the flush can only happen at
+           the start of a run. */
+        while (num) {
+            unsigned int comparable = 0;
+            unsigned int run;
+
+            if (mf->relativepos < mf->relativeto->pos)
+                comparable = min(num, (unsigned int)(mf->relativeto->pos -
+                                                     mf->relativepos));
+
+            run = mdiff_match_len(mf->buf + mf->pos,
+                                  mf->relativeto->buf + mf->relativepos,
+                                  comparable);
+            if (run) {
 
                 if (mf->pending_seeks || mf->pending_edits)
                     mdiffflush(mf, 0);
 
-                mf->pending_copies++;
+                mf->pending_copies += run;
 
             } else {
 
+                run = mdiff_mismatch_len(mf->buf + mf->pos,
+                                         mf->relativeto->buf + mf->relativepos,
+                                         comparable);
+                if (run == comparable)
+                    run = num;
+
                 /* Note that mdiffflush is responsible for writing the actual
                    data that was edited, once we have a complete run of it. So
                    there's no need to record the data anywhere but in buf. */
                 if (mf->pending_seeks)
                     mdiffflush(mf, 0);
 
-                mf->pending_edits++;
+                mf->pending_edits += run;
             }
-            mf->pos++;
-            mf->relativepos++;
+            mf->pos += run;
+            mf->relativepos += run;
+            num -= run;
         }
     }
 }
@@ -719,10 +785,10 @@ mdiffflush(struct memfile *mf, boolean eof)
            this point will be edited or seeked away) */
         fprintf(debuglog, "] pos %d, last copy %d:%08lx%+d anchor %d\n> ",
                 mf->pos,
-                mf->last_tag ? mf->last_tag->tagtype : -1,
-                mf->last_tag ? mf->last_tag->tagdata : 0,
+                mf->ntags ? mf->tags[mf->ntags - 1].tagtype : -1,
+                mf->ntags ? mf->tags[mf->ntags - 1].tagdata : 0,
                 mf->pos - (int)mf->pending_edits -
-                (mf->last_tag ? mf->last_tag->pos : 0),
+                (mf->ntags ? mf->tags[mf->ntags - 1].pos : 0),
                 mf->coord_relative_to);
     }
 
@@ -1029,38 +1095,266 @@ mdiffapply(char *diff, long difflen, struct memfile *diff_base,
    and the file location. For a diff memfile, it also sets relativepos
    to the pos of the tag in relativeto, if it exists, and adds a seek
    command to the diff, unless it would be redundant. */
+static unsigned long
+mtag_hash(long tagdata, enum memfile_tagtype tagtype)
+{
+    /* 619 is chosen here because it's a prime number, and it's approximately
+       in the golden ratio with 1009 (the size of the hashtable this used to
+       use). The rest mixes the high bits into the low bits that are used as
+       an index into the table. */
+    unsigned long h = (unsigned long)tagdata * 619 + (unsigned long)tagtype;
+
+    h ^= h >> 16;
+    h *= 0x45d9f3bUL;
+    h ^= h >> 16;
+    return h;
+}
+
+/* Adds tags[index] to the hashtable, replacing any older tag with the same
+   tagdata and tagtype (so that lookups find the most recent such tag). */
+static void
+mtag_table_insert(struct memfile *mf, int index)
+{
+    const struct memfile_tag *tag = &mf->tags[index];
+    int mask = mf->tagtable_size - 1;
+    int i = mtag_hash(tag->tagdata, tag->tagtype) & mask;
+
+    while (mf->tagtable[i]) {
+        const struct memfile_tag *other = &mf->tags[mf->tagtable[i] - 1];
+
+        if (other->tagtype == tag->tagtype && other->tagdata == tag->tagdata)
+            break;
+        i = (i + 1) & mask;
+    }
+    mf->tagtable[i] = index + 1;
+}
+
+/* Makes room for at least one more tag in mf. */
+static void
+mtag_reserve(struct memfile *mf)
+{
+    int i;
+
+    if (mf->ntags == mf->maxtags) {
+        int want = mf->relativeto ? mf->relativeto->ntags : mtag_count_hint;
+
+        want += want / 8 + 64;
+        if (want < mf->maxtags * 2)
+            want = mf->maxtags * 2;
+        mf->maxtags = want;
+        mf->tags = realloc(mf->tags, mf->maxtags * sizeof *mf->tags);
+        if (!mf->tags)
+            panic("Out of memory allocating memfile tags");
+    }
+
+    /* Keep the table no more than half full. */
+    if ((mf->ntags + 1) * 2 > mf->tagtable_size) {
+        int size = mf->tagtable_size ? mf->tagtable_size : 64;
+
+        while (size < mf->maxtags * 2)
+            size *= 2;
+
+        free(mf->tagtable);
+        mf->tagtable = calloc(size, sizeof *mf->tagtable);
+        if (!mf->tagtable)
+            panic("Out of memory allocating memfile tags");
+        mf->tagtable_size = size;
+
+        for (i = 0; i < mf->ntags; i++)
+            mtag_table_insert(mf, i);
+    }
+}
+
+/* Returns the most recent tag in mf with the given tagdata and tagtype, or
+   NULL if there isn't one. */
+static const struct memfile_tag *
+mtag_find(const struct memfile *mf, long tagdata, enum memfile_tagtype tagtype)
+{
+    int mask = mf->tagtable_size - 1;
+    int i;
+
+    if (!mf->tagtable)
+        return NULL;
+
+    for (i = mtag_hash(tagdata, tagtype) & mask; mf->tagtable[i];
+         i = (i + 1) & mask) {
+        const struct memfile_tag *tag = &mf->tags[mf->tagtable[i] - 1];
+
+        if (tag->tagtype == tagtype && tag->tagdata == tagdata)
+            return tag;
+    }
+    return NULL;
+}
+
 void
 mtag(struct memfile *mf, long tagdata, enum memfile_tagtype tagtype)
 {
-    /* 619 is chosen here because it's a prime number, and it's approximately
-       in the golden ratio with MEMFILE_HASHTABLE_SIZE. */
-    int bucket = (tagdata * 619 + (int)tagtype) % MEMFILE_HASHTABLE_SIZE;
-    struct memfile_tag *tag = malloc(sizeof (struct memfile_tag));
+    struct memfile_tag *tag;
 
-    tag->next = mf->tags[bucket];
+    mtag_reserve(mf);
+    tag = &mf->tags[mf->ntags];
     tag->tagdata = tagdata;
     tag->tagtype = tagtype;
     tag->pos = mf->pos;
-    mf->tags[bucket] = tag;
-    mf->last_tag = tag;
+    mtag_table_insert(mf, mf->ntags++);
 
     if (mf->relativeto) {
-        for (tag = mf->relativeto->tags[bucket]; tag; tag = tag->next) {
-            if (tag->tagtype == tagtype && tag->tagdata == tagdata)
-                break;
-        }
-        if (tag && mf->relativepos != tag->pos) {
-            int offset = mf->relativepos - tag->pos;
+        const struct memfile_tag *rtag =
+            mtag_find(mf->relativeto, tagdata, tagtype);
+
+        if (rtag && mf->relativepos != rtag->pos) {
+            int offset = mf->relativepos - rtag->pos;
 
             if (mf->pending_edits || mf->pending_copies)
                 mdiffflush(mf, 0);
 
             mf->pending_seeks += offset;
-            mf->relativepos = tag->pos;
+            mf->relativepos = rtag->pos;
         }
     }
 }
 
+/* Save size accounting. This is for finding out what's responsible for the size
+   of saves and save diffs, so it's only run on request, after the save has been
+   written; it works out which bytes the diff edited by following the tags the
+   same way that mwrite and mtag do. */
+static const char *const mtag_names[MTAG_COUNT + 1] = {
+    [MTAG_START] = "MTAG_START",
+    [MTAG_WATERLEVEL] = "MTAG_WATERLEVEL",
+    [MTAG_DUNGEONSTRUCT] = "MTAG_DUNGEONSTRUCT",
+    [MTAG_BRANCH] = "MTAG_BRANCH",
+    [MTAG_DUNGEON] = "MTAG_DUNGEON",
+    [MTAG_REGION] = "MTAG_REGION",
+    [MTAG_YOU] = "MTAG_YOU",
+    [MTAG_VERSION] = "MTAG_VERSION",
+    [MTAG_WORMS] = "MTAG_WORMS",
+    [MTAG_ROOMS] = "MTAG_ROOMS",
+    [MTAG_HISTORY] = "MTAG_HISTORY",
+    [MTAG_ORACLES] = "MTAG_ORACLES",
+    [MTAG_TIMER] = "MTAG_TIMER",
+    [MTAG_TIMERS] = "MTAG_TIMERS",
+    [MTAG_LIGHT] = "MTAG_LIGHT",
+    [MTAG_LIGHTS] = "MTAG_LIGHTS",
+    [MTAG_OBJ] = "MTAG_OBJ",
+    [MTAG_TRACK] = "MTAG_TRACK",
+    [MTAG_OCLASSES] = "MTAG_OCLASSES",
+    [MTAG_RNDMONST] = "MTAG_RNDMONST",
+    [MTAG_MON] = "MTAG_MON",
+    [MTAG_STEAL] = "MTAG_STEAL",
+    [MTAG_ARTIFACT] = "MTAG_ARTIFACT",
+    [MTAG_RNGSTATE] = "MTAG_RNGSTATE",
+    [MTAG_LEVEL] = "MTAG_LEVEL",
+    [MTAG_LEVELS] = "MTAG_LEVELS",
+    [MTAG_MVITALS] = "MTAG_MVITALS",
+    [MTAG_GAMESTATE] = "MTAG_GAMESTATE",
+    [MTAG_DAMAGE] = "MTAG_DAMAGE",
+    [MTAG_DAMAGEVALUE] = "MTAG_DAMAGEVALUE",
+    [MTAG_TRAP] = "MTAG_TRAP",
+    [MTAG_FRUIT] = "MTAG_FRUIT",
+    [MTAG_ENGRAVING] = "MTAG_ENGRAVING",
+    [MTAG_FLAGS] = "MTAG_FLAGS",
+    [MTAG_STAIRWAYS] = "MTAG_STAIRWAYS",
+    [MTAG_LFLAGS] = "MTAG_LFLAGS",
+    [MTAG_LOCATIONS] = "MTAG_LOCATIONS",
+    [MTAG_OPTION] = "MTAG_OPTION",
+    [MTAG_OPTIONS] = "MTAG_OPTIONS",
+    [MTAG_AUTOPICKUP_RULE] = "MTAG_AUTOPICKUP_RULE",
+    [MTAG_AUTOPICKUP_RULES] = "MTAG_AUTOPICKUP_RULES",
+    [MTAG_DUNGEON_TOPOLOGY] = "MTAG_DUNGEON_TOPOLOGY",
+    [MTAG_SPELLBOOK] = "MTAG_SPELLBOOK",
+    [MTAG_LOCPLANE] = "MTAG_LOCPLANE",
+    [MTAG_ANCHOR] = "MTAG_ANCHOR",
+    [MTAG_COUNT] = "untagged",
+};
+
+const char *
+mtag_name(int tagtype)
+{
+    if (tagtype < 0 || tagtype > MTAG_COUNT || !mtag_names[tagtype])
+        return "unknown";
+    return mtag_names[tagtype];
+}
+
+/* Returns how many of the len bytes at pos in mf differ from the bytes at
+   relpos in mf->relativeto (bytes past its end count as different). */
+static long
+mcount_changed(const struct memfile *mf, int pos, int relpos, int len)
+{
+    const struct memfile *rel = mf->relativeto;
+    long changed = 0;
+    int comparable = 0;
+
+    if (relpos < rel->pos)
+        comparable = min(len, rel->pos - relpos);
+    changed += len - comparable;
+
+    while (comparable) {
+        unsigned int run = mdiff_match_len(mf->buf + pos, rel->buf + relpos,
+                                           comparable);
+
+        if (!run) {
+            run = mdiff_mismatch_len(mf->buf + pos, rel->buf + relpos,
+                                     comparable);
+            changed += run;
+        }
+        pos += run;
+        relpos += run;
+        comparable -= run;
+    }
+
+    return changed;
+}
+
+/* Works out where the space in mf goes; see struct memfile_usage. This has to
+   be called before mf->relativeto is changed or freed. */
+void
+maccount(const struct memfile *mf, struct memfile_usage *usage)
+{
+    int i, relpos = 0, levnum = 0;
+
+    memset(usage, 0, sizeof *usage);
+
+    /* i == -1 is the data before the first tag. */
+    for (i = -1; i < mf->ntags; i++) {
+        int start = i < 0 ? 0 : mf->tags[i].pos;
+        int end = i + 1 < mf->ntags ? mf->tags[i + 1].pos : mf->pos;
+        int tagtype = MTAG_COUNT;
+        long changed;
+
+        if (i >= 0) {
+            const struct memfile_tag *tag = &mf->tags[i];
+
+            tagtype = tag->tagtype;
+            if (tagtype == MTAG_LEVELS)
+                levnum = tag->tagdata;  /* 0 for the list header */
+            else if (tagtype == MTAG_GAMESTATE)
+                levnum = 0;             /* the levels are over */
+
+            if (mf->relativeto) {
+                const struct memfile_tag *rtag =
+                    mtag_find(mf->relativeto, tag->tagdata, tag->tagtype);
+
+                if (rtag)
+                    relpos = rtag->pos;
+            }
+        }
+
+        if (levnum < 0 || levnum >= ARRAY_SIZE(usage->bylevel))
+            levnum = 0;
+
+        if (mf->relativeto)
+            changed = mcount_changed(mf, start, relpos, end - start);
+        else
+            changed = end - start;
+        relpos += end - start;
+
+        usage->bytype[tagtype].written += end - start;
+        usage->bytype[tagtype].changed += changed;
+        usage->bylevel[levnum].written += end - start;
+        usage->bylevel[levnum].changed += changed;
+    }
+}
+
 void
 mread(struct memfile *mf, void *buf, unsigned int len)
 {
@@ -1156,7 +1450,7 @@ mequal(struct memfile *mf1, struct memfile *mf2, const char **difference_reason)
 {
     char *p1, *p2;
     long len, off;
-    int bin;
+    int i;
 
     /* Compare the save files. If they're different lengths, we compare only the
        portion that fits into both files. */
@@ -1178,12 +1472,12 @@ mequal(struct memfile *mf1, struct memfile *mf2, const char **difference_reason)
         /* Determine where the desyncs are. */
         for (off = 0; off < len; off++) {
             if (p1[off] != p2[off]) {
-                struct memfile_tag *tag = NULL, *titer;
-                for (bin = 0; bin < MEMFILE_HASHTABLE_SIZE; bin++)
-                    for (titer = mf2->tags[bin]; titer; titer = titer->next)
-                        if (titer->pos <= off)
-                            if (!tag || tag->pos < titer->pos)
-                                tag = titer;
+                /* The tags are in order of pos, so we want the last one
+                   that isn't past off. */
+                struct memfile_tag *tag = NULL;
+                for (i = 0; i < mf2->ntags; i++)
+                    if (mf2->tags[i].pos <= off)
+                        tag = &mf2->tags[i];
 
                 if (!tag) {
 
@@ -1208,6 +1502,22 @@ mequal(struct memfile *mf1, struct memfile *mf2, const char **difference_reason)
                                   (int)(unsigned char)p1[off],
                                   (int)(unsigned char)p2[off]);
 
+                } else if (tag->tagtype == MTAG_LOCPLANE) {
+
+                    int plane = tag->tagdata % LOCPLANE_COUNT;
+                    const int bpl = plane == LOCPLANE_MEMORY ? 5 : 3;
+                    int which_location = (off - tag->pos) / bpl;
+
+                    *difference_reason =
+                        msgprintf("desync at %ld ((%d, %d) plane %d + %ld "
+                                  "byte%s), was %02x is %02x", off,
+                                  which_location / ROWNO,
+                                  which_location % ROWNO, plane,
+                                  (off - tag->pos) % bpl,
+                                  ((off - tag->pos) % bpl) == 1 ? "" : "s",
+                                  (int)(unsigned char)p1[off],
+                                  (int)(unsigned char)p2[off]);
+
                 } else {
 
                     *difference_reason =
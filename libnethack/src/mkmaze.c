@@ -1392,8 +1392,7 @@ mv_bubble(struct level *lev, struct bubble *b, int dx, int dy, boolean ini)
         case CONS_TRAP:{
                 struct trap *btrap = (struct trap *)cons->list;
 
-                btrap->tx = cons->x;
-                btrap->ty = cons->y;
+                move_trap(lev, btrap, cons->x, cons->y);
                 break;
             }
 
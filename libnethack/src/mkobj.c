@@ -324,7 +324,7 @@ splitobj(struct obj *obj, long num)
     otmp->nobj = obj->nobj;
     obj->nobj = otmp;
     otmp->where = obj->where;
-    otmp->o_id = next_ident();
+    set_obj_id(otmp, next_ident());
     otmp->timed = 0;    /* not timed, yet */
     otmp->lamplit = 0;  /* ditto */
     otmp->owornmask = 0L;       /* new object isn't worn */
@@ -439,7 +439,7 @@ bill_dummy_object(struct obj *otmp)
     if (otmp->unpaid)
         subfrombill(otmp, shop_keeper(level, *u.ushops));
     dummy = newobj(otmp->oxlth + otmp->onamelth, otmp);
-    dummy->o_id = next_ident();
+    set_obj_id(dummy, next_ident());
     dummy->timed = 0;
     if (otmp->oxlth)
         memcpy(dummy->oextra, otmp->oextra, otmp->oxlth);
@@ -469,7 +469,7 @@ mksobj_basic(struct level *lev, int otyp)
 
     otmp = newobj(0, &zeroobj);
     otmp->age = moves;
-    otmp->o_id = TEMPORARY_IDENT; /* temporary ID, no good for saving */
+    set_obj_id(otmp, TEMPORARY_IDENT); /* temporary ID, no good for saving */
     otmp->quan = 1L;
     otmp->oclass = let;
     otmp->otyp = otyp;
@@ -522,7 +522,7 @@ mksobj(struct level *lev, int otyp, boolean init, boolean artif, enum rng rng)
     otmp = mksobj_basic(lev, otyp);
     if (!otmp)
         return NULL;
-    otmp->o_id = next_ident();
+    set_obj_id(otmp, next_ident());
 
     if (init) {
 #ifdef INVISIBLE_OBJECTS
@@ -1602,6 +1602,9 @@ extract_nobj(struct obj *obj, struct obj **head_ptr,
     if (!curr)
         panic("extract_nobj: object lost");
 
+    if (obj->olev)
+        mark_level_dirty(obj->olev);
+
     if (new_chain) {
         obj->nobj = *new_chain;
         *new_chain = obj;
@@ -1711,6 +1714,134 @@ container_weight(struct obj *container)
 */
 }
 
+/* The object ID index.
+
+   Every object allocated by newobj() is recorded in this hash table, keyed on
+   its o_id, until dealloc_obj() frees it; so looking up an object by ID
+   (find_oid) doesn't have to search every object chain in the game. Code that
+   changes the o_id of an existing object must use set_obj_id(), so that the
+   object can be moved to the right place in the table.
+
+   The table uses open addressing with linear probing. IDs aren't quite unique
+   (for instance, realloc_obj has two copies of the same object for a while), so
+   a lookup may see more than one object with the ID it's looking for; callers
+   decide which of them they want. */
+#define OID_INDEX_MIN_SIZE 1024    /* must be a power of 2 */
+
+static struct obj **oid_index = NULL;
+static unsigned oid_index_size = 0;     /* 0, or a power of 2 */
+static unsigned oid_index_count = 0;
+
+static unsigned
+oid_index_slot(unsigned id)
+{
+    /* IDs are mostly allocated sequentially, so multiplying by an odd number
+       spreads them evenly over the table. */
+    return (id * 2654435761U) & (oid_index_size - 1);
+}
+
+static void
+oid_index_insert(struct obj *obj)
+{
+    unsigned i;
+
+    if ((oid_index_count + 1) * 2 > oid_index_size) {
+        struct obj **old = oid_index;
+        unsigned old_size = oid_index_size;
+
+        oid_index_size = old_size ? old_size * 2 : OID_INDEX_MIN_SIZE;
+        oid_index = malloc(oid_index_size * sizeof *oid_index);
+        memset(oid_index, 0, oid_index_size * sizeof *oid_index);
+        oid_index_count = 0;
+
+        for (i = 0; i < old_size; i++)
+            if (old[i])
+                oid_index_insert(old[i]);
+        free(old);
+    }
+
+    for (i = oid_index_slot(obj->o_id); oid_index[i];
+         i = (i + 1) & (oid_index_size - 1))
+        ;
+    oid_index[i] = obj;
+    oid_index_count++;
+}
+
+static void
+oid_index_remove(struct obj *obj)
+{
+    unsigned i, j, home;
+
+    if (!oid_index_size) {
+        impossible("object %u missing from the ID index", obj->o_id);
+        return;
+    }
+
+    for (i = oid_index_slot(obj->o_id); oid_index[i] != obj;
+         i = (i + 1) & (oid_index_size - 1)) {
+        if (!oid_index[i]) {
+            impossible("object %u missing from the ID index", obj->o_id);
+            return;
+        }
+    }
+
+    /* Close the gap, by moving back any later entry in the same run that
+       would no longer be reachable from its home slot. */
+    for (j = (i + 1) & (oid_index_size - 1); oid_index[j];
+         j = (j + 1) & (oid_index_size - 1)) {
+        home = oid_index_slot(oid_index[j]->o_id);
+        if (((j - home) & (oid_index_size - 1)) >=
+            ((j - i) & (oid_index_size - 1))) {
+            oid_index[i] = oid_index[j];
+            i = j;
+        }
+    }
+    oid_index[i] = NULL;
+    oid_index_count--;
+}
+
+/* Returns the next object with the given ID, or NULL if there are no more.
+   *cursor should be 0 on the first call, and is updated to remember where the
+   search got to. */
+struct obj *
+oid_index_find(unsigned id, unsigned *cursor)
+{
+    unsigned i;
+
+    if (!oid_index_size)
+        return NULL;
+
+    /* *cursor holds one more than the slot to resume from, so that it's
+       never 0 once the search has started */
+    i = *cursor ? *cursor & (oid_index_size - 1) : oid_index_slot(id);
+    for (; oid_index[i]; i = (i + 1) & (oid_index_size - 1)) {
+        if (oid_index[i]->o_id == id) {
+            *cursor = i + 1;
+            return oid_index[i];
+        }
+    }
+    return NULL;
+}
+
+/* Changes the ID of an object that was allocated with newobj(). */
+void
+set_obj_id(struct obj *obj, unsigned id)
+{
+    oid_index_remove(obj);
+    obj->o_id = id;
+    oid_index_insert(obj);
+}
+
+/* Forgets about every object in the ID index, when the game is freed. */
+void
+free_oid_index(void)
+{
+    free(oid_index);
+    oid_index = NULL;
+    oid_index_size = 0;
+    oid_index_count = 0;
+}
+
 /* Allocates an object. */
 struct obj *
 newobj(int extra_bytes, struct obj *initfrom)
@@ -1726,6 +1857,7 @@ newobj(int extra_bytes, struct obj *initfrom)
     otmp->where = OBJ_FREE;
     otmp->nobj = turnstate.floating_objects;
     turnstate.floating_objects = otmp;
+    oid_index_insert(otmp);
     return otmp;
 }
 
@@ -1756,6 +1888,7 @@ dealloc_obj(struct obj *obj)
         thrownobj = NULL;
 
     extract_nobj(obj, &turnstate.floating_objects, NULL, 0);
+    oid_index_remove(obj);
 
     free(obj);
 }
@@ -1774,6 +1907,10 @@ set_obj_level(struct level *lev, struct obj *obj)
     if (obj->lamplit)
 	transfer_lights(obj->olev, lev, obj->o_id);
 
+    if (obj->olev)
+        mark_level_dirty(obj->olev);
+    if (lev)
+        mark_level_dirty(lev);
     obj->olev = lev;
 
     for (cobj = obj->cobj; cobj; cobj = cobj->nobj)
@@ -1796,7 +1933,7 @@ restore_obj(struct memfile *mf)
     otmp = newobj(namelen, &zeroobj);
     memset(otmp, 0, namelen + sizeof (struct obj));
 
-    otmp->o_id = mread32(mf);
+    set_obj_id(otmp, mread32(mf));
     otmp->owt = mread32(mf);
     otmp->quan = mread32(mf);
     otmp->corpsenm = mread32(mf);
@@ -1637,6 +1637,7 @@ dmonsfree(struct level *lev)
             struct monst *freetmp = *mtmp;
 
             *mtmp = (*mtmp)->nmon;
+            mon_index_remove(&lev->monindex, freetmp);
             dealloc_monst(freetmp);
             count++;
         } else
@@ -1646,6 +1647,8 @@ dmonsfree(struct level *lev)
     if (count != lev->flags.purge_monsters)
         impossible("dmonsfree: %d removed doesn't match %d pending", count,
                    lev->flags.purge_monsters);
+    if (count)
+        mark_level_dirty(lev);
     lev->flags.purge_monsters = 0;
 }
 
@@ -1679,6 +1682,7 @@ replmon(struct monst *mtmp, struct monst *mtmp2)
     }
     mtmp2->nmon = mtmp2->dlevel->monlist;
     mtmp2->dlevel->monlist = mtmp2;
+    mon_index_add(&mtmp2->dlevel->monindex, mtmp2);
     if (u.ustuck == mtmp)
         u.ustuck = mtmp2;
     if (u.usteed == mtmp)
@@ -1702,6 +1706,7 @@ relmon(struct monst *mon)
     if (mon->dlevel->monlist == NULL)
         panic("relmon: no level->monlist available.");
 
+    mark_level_dirty(mon->dlevel);
     mon->dlevel->monsters[mon->mx][mon->my] = NULL;
 
     if (mon == mon->dlevel->monlist)
@@ -1715,6 +1720,132 @@ relmon(struct monst *mon)
         else
             panic("relmon: mon not in list.");
     }
+    mon_index_remove(&mon->dlevel->monindex, mon);
+}
+
+
+/* Monster ID indexes.
+
+   Each level has an index of the monsters on its monlist, keyed on m_id, and
+   there's one more for migrating_mons; find_mid() uses these rather than
+   walking the lists. Anything that adds a monster to, or removes one from,
+   one of those lists must update the matching index (restoring a whole list
+   can just rebuild it). A monster's m_id must not change while it's on an
+   indexed list.
+
+   The tables use open addressing with linear probing, and allow for more
+   than one monster with the same ID. */
+#define MON_INDEX_MIN_SIZE 64   /* must be a power of 2 */
+
+static struct mon_index migrating_index;
+
+static unsigned
+mon_index_slot(const struct mon_index *idx, unsigned id)
+{
+    return (id * 2654435761U) & (idx->size - 1);
+}
+
+void
+mon_index_add(struct mon_index *idx, struct monst *mon)
+{
+    unsigned i;
+
+    if ((idx->count + 1) * 2 > idx->size) {
+        struct monst **old = idx->slots;
+        unsigned old_size = idx->size;
+
+        idx->size = old_size ? old_size * 2 : MON_INDEX_MIN_SIZE;
+        idx->slots = malloc(idx->size * sizeof *idx->slots);
+        memset(idx->slots, 0, idx->size * sizeof *idx->slots);
+        idx->count = 0;
+
+        for (i = 0; i < old_size; i++)
+            if (old[i])
+                mon_index_add(idx, old[i]);
+        free(old);
+    }
+
+    for (i = mon_index_slot(idx, mon->m_id); idx->slots[i];
+         i = (i + 1) & (idx->size - 1))
+        ;
+    idx->slots[i] = mon;
+    idx->count++;
+}
+
+void
+mon_index_remove(struct mon_index *idx, struct monst *mon)
+{
+    unsigned i, j, home;
+
+    if (!idx->size) {
+        impossible("monster %u missing from its ID index", mon->m_id);
+        return;
+    }
+
+    for (i = mon_index_slot(idx, mon->m_id); idx->slots[i] != mon;
+         i = (i + 1) & (idx->size - 1)) {
+        if (!idx->slots[i]) {
+            impossible("monster %u missing from its ID index", mon->m_id);
+            return;
+        }
+    }
+
+    /* Close the gap, by moving back any later entry in the same run that
+       would no longer be reachable from its home slot. */
+    for (j = (i + 1) & (idx->size - 1); idx->slots[j];
+         j = (j + 1) & (idx->size - 1)) {
+        home = mon_index_slot(idx, idx->slots[j]->m_id);
+        if (((j - home) & (idx->size - 1)) >= ((j - i) & (idx->size - 1))) {
+            idx->slots[i] = idx->slots[j];
+            i = j;
+        }
+    }
+    idx->slots[i] = NULL;
+    idx->count--;
+}
+
+/* Returns a monster with the given ID from the index, or NULL. If live_only
+   is set, dead monsters that haven't been freed yet are ignored. */
+struct monst *
+mon_index_find(const struct mon_index *idx, unsigned id, boolean live_only)
+{
+    unsigned i;
+
+    if (!idx->size)
+        return NULL;
+
+    for (i = mon_index_slot(idx, id); idx->slots[i];
+         i = (i + 1) & (idx->size - 1))
+        if (idx->slots[i]->m_id == id &&
+            (!live_only || !DEADMONSTER(idx->slots[i])))
+            return idx->slots[i];
+
+    return NULL;
+}
+
+/* Makes the index list exactly the monsters on the given chain. */
+void
+mon_index_rebuild(struct mon_index *idx, struct monst *chain)
+{
+    mon_index_free(idx);
+    for (; chain; chain = chain->nmon)
+        mon_index_add(idx, chain);
+}
+
+void
+mon_index_free(struct mon_index *idx)
+{
+    free(idx->slots);
+    idx->slots = NULL;
+    idx->size = 0;
+    idx->count = 0;
+}
+
+/* The index for migrating_mons. */
+struct mon_index *
+migrating_mon_index(void)
+{
+    return &migrating_index;
 }
 
 /* remove effects of mtmp from other data structures */
@@ -14,23 +14,71 @@
    I know, originated there. For NetHack 4, the code was reformatted and
    simplified via removing unused codepaths. */
 
+/* For dladdr(), used to describe call sites in RNG profiles */
+#if defined(AIMAKE_BUILDOS_linux) && !defined(_GNU_SOURCE)
+# define _GNU_SOURCE
+#endif
+
 #ifdef AIMAKE_BUILDOS_MSWin32
 # define WIN32_LEAN_AND_MEAN /* else windows.h tries to define "boolean" */
 # include <windows.h> /* wincrypt.h is broken and doesn't include this itself */
 # include <wincrypt.h>
 #endif
 
+/* Headers for the hardware SHA-256 kernels below. They must come before the
+   game's headers, which define macros (such as "u") that clash with names used
+   in the system headers. */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+# define SHA256_X86
+# include <cpuid.h>
+# include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(AIMAKE_BUILDOS_linux) &&    \
+    (defined(__ARM_FEATURE_SHA2) || (defined(__GNUC__) && !defined(__clang__)))
+# define SHA256_ARM
+# include <arm_neon.h>
+# include <sys/auxv.h>
+# ifndef HWCAP_SHA2
+#  define HWCAP_SHA2 (1 << 6)
+# endif
+# ifdef __ARM_FEATURE_SHA2
+#  define SHA256_ARM_TARGET
+# else
+#  define SHA256_ARM_TARGET __attribute__((target("+crypto")))
+# endif
+#endif
+
 #include "rnd.h"
 #include "flag.h"
 #include "you.h"
 #include "extern.h"
 #include "rm.h"
+#include "menulist.h"
 #include <sys/time.h>
+#include <time.h>
+#ifdef AIMAKE_BUILDOS_linux
+# include <dlfcn.h>
+#endif
 
-struct sha256_state {
-    uint64_t length;
-    uint32_t state[8], curlen;
-    unsigned char buf[64];
+/* The SHA-256 compression function is the RNG's inner loop, so there are
+   several implementations of it (kernels): a portable one, and ones that use
+   the SHA instructions of x86 (SHA-NI) and ARMv8 processors, or the AVX2 vector
+   unit. They all give identical results; the fastest one that the CPU supports
+   is chosen the first time a random number is needed.
+
+   A kernel works on a fixed number of independent messages at once (its
+   lanes): it updates state[i] with the 64-byte block[i] for each lane i. Doing
+   several at once lets the kernel overlap the latency of one message's rounds
+   with the work on another; the RNG makes use of this by hashing several
+   upcoming seeds in advance (see struct rng_lookahead below). */
+#define SHA256_MAX_LANES 8
+typedef void (*sha256_kernel)(uint32_t state[][8],
+                              const unsigned char block[][64]);
+
+static const uint32_t sha256_initial_state[8] = {
+    0x6A09E667UL, 0xBB67AE85UL, 0x3C6EF372UL, 0xA54FF53AUL,
+    0x510E527FUL, 0x9B05688CUL, 0x1F83D9ABUL, 0x5BE0CD19UL
 };
 
 /* the K array */
@@ -50,21 +98,6 @@ static const uint32_t K[64] = {
     0x90befffaUL, 0xa4506cebUL, 0xbef9a3f7UL, 0xc67178f2UL
 };
 
-static void
-sha256_init(struct sha256_state *ss)
-{
-    ss->curlen = 0;
-    ss->length = 0;
-    ss->state[0] = 0x6A09E667UL;
-    ss->state[1] = 0xBB67AE85UL;
-    ss->state[2] = 0x3C6EF372UL;
-    ss->state[3] = 0xA54FF53AUL;
-    ss->state[4] = 0x510E527FUL;
-    ss->state[5] = 0x9B05688CUL;
-    ss->state[6] = 0x1F83D9ABUL;
-    ss->state[7] = 0x5BE0CD19UL;
-}
-
 /* Note: these assume uint32_t arguments. */
 #define S(x, n)      (((x) >> (n)) | ((x) << (32 - (n))))
 #define R(x, n)      ((x) >> (n))
@@ -75,133 +108,391 @@ sha256_init(struct sha256_state *ss)
 #define Gamma0(x)    (S(x, 7) ^ S(x, 18) ^ R(x, 3))
 #define Gamma1(x)    (S(x, 17) ^ S(x, 19) ^ R(x, 10))
 
+/* One round, with the working variables passed in their current roles rather
+   than being shifted along; the caller rotates the argument list instead. */
+#define SHA256_ROUND(a, b, c, d, e, f, g, h, i)                 \
+    do {                                                        \
+        uint32_t t0 = h + Sigma1(e) + Ch(e, f, g) + K[i] + W[i]; \
+        uint32_t t1 = Sigma0(a) + Maj(a, b, c);                 \
+        d += t0;                                                \
+        h = t0 + t1;                                            \
+    } while (0)
+
 static void
-sha256_compress(struct sha256_state *ss, const unsigned char buf[64])
+sha256_compress_scalar(uint32_t states[][8], const unsigned char blocks[][64])
 {
-    uint32_t S[8], W[64];
+    uint32_t *state = states[0];
+    const unsigned char *block = blocks[0];
+    uint32_t W[64];
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3],
+        e = state[4], f = state[5], g = state[6], h = state[7];
     int i;
 
-    /* copy state into S */
-    for (i = 0; i < 8; i++) {
-        S[i] = ss->state[i];
-    }
-
     /* copy the state into 512-bits into W[0..15] */
-    const unsigned char *bp = buf;
-    for (i = 0; i < 16; i++) {
-        W[i]  = *bp++ << 24;
-        W[i] |= *bp++ << 16;
-        W[i] |= *bp++ <<  8;
-        W[i] |= *bp++ <<  0;
-    }
+    for (i = 0; i < 16; i++)
+        W[i] = ((uint32_t)block[4 * i] << 24) |
+            ((uint32_t)block[4 * i + 1] << 16) |
+            ((uint32_t)block[4 * i + 2] << 8) |
+            ((uint32_t)block[4 * i + 3] << 0);
 
     /* fill W[16..63] */
-    for (i = 16; i < 64; i++) {
+    for (i = 16; i < 64; i++)
         W[i] = Gamma1(W[i - 2]) + W[i - 7] + Gamma0(W[i - 15]) + W[i - 16];
-    }
 
     /* Compress */
-    for (i = 0; i < 64; ++i) {
-        uint32_t t, t0, t1;
+    for (i = 0; i < 64; i += 8) {
+        SHA256_ROUND(a, b, c, d, e, f, g, h, i + 0);
+        SHA256_ROUND(h, a, b, c, d, e, f, g, i + 1);
+        SHA256_ROUND(g, h, a, b, c, d, e, f, i + 2);
+        SHA256_ROUND(f, g, h, a, b, c, d, e, i + 3);
+        SHA256_ROUND(e, f, g, h, a, b, c, d, i + 4);
+        SHA256_ROUND(d, e, f, g, h, a, b, c, i + 5);
+        SHA256_ROUND(c, d, e, f, g, h, a, b, i + 6);
+        SHA256_ROUND(b, c, d, e, f, g, h, a, i + 7);
+    }
 
-        t0 = S[7] + Sigma1(S[4]) + Ch(S[4], S[5], S[6]) + K[i] + W[i];
-        t1 = Sigma0(S[0]) + Maj(S[0], S[1], S[2]);
-        S[3] += t0;
-        S[7] = t0 + t1;
+    /* feedback */
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
 
-        t = S[7]; S[7] = S[6]; S[6] = S[5]; S[5] = S[4];
-        S[4] = S[3]; S[3] = S[2]; S[2] = S[1]; S[1] = S[0]; S[0] = t;
+#ifdef SHA256_X86
+static boolean
+sha256_x86_supported(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) ||
+        !(ecx & bit_SSSE3) || !(ecx & bit_SSE4_1))
+        return FALSE;
+    if (__get_cpuid_max(0, NULL) < 7)
+        return FALSE;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return !!(ebx & (1U << 29));        /* SHA */
+}
+
+/* The SHA-NI instructions keep the state as ABEF and CDGH, and do two rounds
+   at a time; the message schedule is four words per vector. The rounds of one
+   message form a long dependency chain, so the lanes are interleaved round by
+   round; this is inlined into wrappers with a constant number of lanes, so that
+   the per-lane arrays can live in registers. */
+__attribute__((target("sha,ssse3,sse4.1"), always_inline))
+static inline void
+sha256_compress_x86_lanes(uint32_t state[][8], const unsigned char block[][64],
+                          const int lanes)
+{
+    const __m128i byteswap =
+        _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i state0[4], state1[4], abef[4], cdgh[4], w[4][4], msg, k, tmp;
+    int i, l;
+
+    for (l = 0; l < lanes; l++) {
+        tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state[l]),
+                                0xB1);
+        state1[l] = _mm_shuffle_epi32(
+            _mm_loadu_si128((const __m128i *)(state[l] + 4)), 0x1B);
+        state0[l] = _mm_alignr_epi8(tmp, state1[l], 8);     /* ABEF */
+        state1[l] = _mm_blend_epi16(state1[l], tmp, 0xF0);  /* CDGH */
+        abef[l] = state0[l];
+        cdgh[l] = state1[l];
+
+        for (i = 0; i < 4; i++)
+            w[l][i] = _mm_shuffle_epi8(
+                _mm_loadu_si128((const __m128i *)(block[l] + 16 * i)),
+                byteswap);
     }
 
-    /* feedback */
-    for (i = 0; i < 8; i++) {
-        ss->state[i] += S[i];
+    for (i = 0; i < 16; i++) {
+        k = _mm_loadu_si128((const __m128i *)(K + 4 * i));
+        for (l = 0; l < lanes; l++) {
+            /* w[l][i & 3] holds words 4i-16 to 4i-13; replace them with 4i to
+               4i+3 */
+            if (i >= 4)
+                w[l][i & 3] = _mm_sha256msg2_epu32(
+                    _mm_add_epi32(
+                        _mm_sha256msg1_epu32(w[l][i & 3], w[l][(i + 1) & 3]),
+                        _mm_alignr_epi8(w[l][(i + 3) & 3],
+                                        w[l][(i + 2) & 3], 4)),
+                    w[l][(i + 3) & 3]);
+
+            msg = _mm_add_epi32(w[l][i & 3], k);
+            state1[l] = _mm_sha256rnds2_epu32(state1[l], state0[l], msg);
+            state0[l] = _mm_sha256rnds2_epu32(state0[l], state1[l],
+                                              _mm_shuffle_epi32(msg, 0x0E));
+        }
+    }
+
+    for (l = 0; l < lanes; l++) {
+        state0[l] = _mm_add_epi32(state0[l], abef[l]);
+        state1[l] = _mm_add_epi32(state1[l], cdgh[l]);
+
+        tmp = _mm_shuffle_epi32(state0[l], 0x1B);           /* FEBA */
+        state1[l] = _mm_shuffle_epi32(state1[l], 0xB1);     /* DCHG */
+        _mm_storeu_si128((__m128i *)state[l],
+                         _mm_blend_epi16(tmp, state1[l], 0xF0));  /* DCBA */
+        _mm_storeu_si128((__m128i *)(state[l] + 4),
+                         _mm_alignr_epi8(state1[l], tmp, 8));     /* HGFE */
     }
 }
 
-static const int sha256_block_size = 64;
+__attribute__((target("sha,ssse3,sse4.1")))
 static void
-sha256_process(struct sha256_state *ss,
-               const unsigned char *in, unsigned long inlen)
+sha256_compress_x86(uint32_t state[][8], const unsigned char block[][64])
 {
-    unsigned long n;
+    sha256_compress_x86_lanes(state, block, 4);
+}
 
-    if (ss->curlen > sizeof(ss->buf))
-        panic("corrupted sha256 state in sha256_process");
+static boolean
+sha256_avx2_supported(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    /* AVX2 also needs the OS to save the YMM registers (OSXSAVE and XCR0). */
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) ||
+        !(ecx & bit_OSXSAVE) || !(ecx & bit_AVX))
+        return FALSE;
+    __asm__("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+    if ((eax & 6) != 6)
+        return FALSE;
+    if (__get_cpuid_max(0, NULL) < 7)
+        return FALSE;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return !!(ebx & bit_AVX2);
+}
 
-    while (inlen > 0) {
+/* For processors without the SHA instructions: the portable algorithm, with
+   each 32-bit lane of the vectors holding a different message. */
+#define SHA256_AVX2_S(x, n) \
+    _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define SHA256_AVX2_XOR3(x, y, z) \
+    _mm256_xor_si256(_mm256_xor_si256(x, y), z)
 
-        if (ss->curlen == 0 && inlen >= sha256_block_size) {
+__attribute__((target("avx2")))
+static void
+sha256_compress_avx2(uint32_t state[][8], const unsigned char block[][64])
+{
+    const __m256i byteswap = _mm256_set_epi64x(
+        0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL,
+        0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m256i v[8], W[16], a, b, c, d, e, f, g, h, w, t0, t1;
+    uint32_t words[8];
+    int i, l;
 
-            sha256_compress(ss, in);
+    for (i = 0; i < 8; i++) {
+        for (l = 0; l < 8; l++)
+            words[l] = state[l][i];
+        v[i] = _mm256_loadu_si256((const __m256i *)words);
+    }
+    for (i = 0; i < 16; i++) {
+        for (l = 0; l < 8; l++)
+            memcpy(words + l, block[l] + 4 * i, 4);
+        W[i] = _mm256_shuffle_epi8(
+            _mm256_loadu_si256((const __m256i *)words), byteswap);
+    }
 
-            ss->length += sha256_block_size * 8;
-            in += sha256_block_size;
-            inlen -= sha256_block_size;
+    a = v[0]; b = v[1]; c = v[2]; d = v[3];
+    e = v[4]; f = v[5]; g = v[6]; h = v[7];
+    for (i = 0; i < 64; i++) {
+        /* W is a ring of the last 16 words of the message schedule */
+        if (i >= 16) {
+            __m256i w15 = W[(i - 15) & 15], w2 = W[(i - 2) & 15];
+
+            t0 = SHA256_AVX2_XOR3(SHA256_AVX2_S(w15, 7),
+                                  SHA256_AVX2_S(w15, 18),
+                                  _mm256_srli_epi32(w15, 3));
+            t1 = SHA256_AVX2_XOR3(SHA256_AVX2_S(w2, 17),
+                                  SHA256_AVX2_S(w2, 19),
+                                  _mm256_srli_epi32(w2, 10));
+            W[i & 15] = _mm256_add_epi32(
+                _mm256_add_epi32(W[i & 15], t0),
+                _mm256_add_epi32(W[(i - 7) & 15], t1));
+        }
+        w = _mm256_add_epi32(W[i & 15], _mm256_set1_epi32(K[i]));
+
+        t0 = _mm256_add_epi32(
+            _mm256_add_epi32(h, w),
+            _mm256_add_epi32(
+                SHA256_AVX2_XOR3(SHA256_AVX2_S(e, 6), SHA256_AVX2_S(e, 11),
+                                 SHA256_AVX2_S(e, 25)),
+                _mm256_xor_si256(g, _mm256_and_si256(
+                                     e, _mm256_xor_si256(f, g)))));
+        t1 = _mm256_add_epi32(
+            SHA256_AVX2_XOR3(SHA256_AVX2_S(a, 2), SHA256_AVX2_S(a, 13),
+                             SHA256_AVX2_S(a, 22)),
+            _mm256_or_si256(_mm256_and_si256(_mm256_or_si256(a, b), c),
+                            _mm256_and_si256(a, b)));
+
+        h = g;
+        g = f;
+        f = e;
+        e = _mm256_add_epi32(d, t0);
+        d = c;
+        c = b;
+        b = a;
+        a = _mm256_add_epi32(t0, t1);
+    }
+    v[0] = _mm256_add_epi32(v[0], a);
+    v[1] = _mm256_add_epi32(v[1], b);
+    v[2] = _mm256_add_epi32(v[2], c);
+    v[3] = _mm256_add_epi32(v[3], d);
+    v[4] = _mm256_add_epi32(v[4], e);
+    v[5] = _mm256_add_epi32(v[5], f);
+    v[6] = _mm256_add_epi32(v[6], g);
+    v[7] = _mm256_add_epi32(v[7], h);
 
-        } else {
+    for (i = 0; i < 8; i++) {
+        _mm256_storeu_si256((__m256i *)words, v[i]);
+        for (l = 0; l < 8; l++)
+            state[l][i] = words[l];
+    }
+}
+#endif
 
-            n = sha256_block_size - ss->curlen;
-            if (n > inlen)
-                n = inlen;
+#ifdef SHA256_ARM
+static boolean
+sha256_arm_supported(void)
+{
+    return !!(getauxval(AT_HWCAP) & HWCAP_SHA2);
+}
 
-            memcpy(ss->buf + ss->curlen, in, (size_t)n);
-            ss->curlen += n;
-            in += n;
-            inlen -= n;
+SHA256_ARM_TARGET
+static void
+sha256_compress_arm(uint32_t states[][8], const unsigned char blocks[][64])
+{
+    uint32_t *state = states[0];
+    const unsigned char *block = blocks[0];
+    uint32x4_t state0 = vld1q_u32(state), state1 = vld1q_u32(state + 4);
+    uint32x4_t abcd = state0, efgh = state1, msg, tmp, w[4];
+    int i;
 
-            if (ss->curlen == sha256_block_size) {
+    for (i = 0; i < 4; i++)
+        w[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(block + 16 * i)));
 
-                sha256_compress(ss, ss->buf);
-                ss->length += sha256_block_size * 8;
-                ss->curlen = 0;
-            }
-        }
+    for (i = 0; i < 16; i++) {
+        /* w[i & 3] holds words 4i-16 to 4i-13; replace them with 4i to 4i+3 */
+        if (i >= 4)
+            w[i & 3] = vsha256su1q_u32(
+                vsha256su0q_u32(w[i & 3], w[(i + 1) & 3]),
+                w[(i + 2) & 3], w[(i + 3) & 3]);
+
+        msg = vaddq_u32(w[i & 3], vld1q_u32(K + 4 * i));
+        tmp = state0;
+        state0 = vsha256hq_u32(state0, state1, msg);
+        state1 = vsha256h2q_u32(state1, tmp, msg);
     }
+
+    vst1q_u32(state, vaddq_u32(state0, abcd));
+    vst1q_u32(state + 4, vaddq_u32(state1, efgh));
 }
+#endif
+
+/* In order of preference. */
+static const struct {
+    const char *name;
+    sha256_kernel compress;
+    int lanes;
+    boolean (*supported)(void);
+} sha256_kernels[] = {
+#ifdef SHA256_X86
+    {"x86 SHA-NI", sha256_compress_x86, 4, sha256_x86_supported},
+    {"x86 AVX2", sha256_compress_avx2, 8, sha256_avx2_supported},
+#endif
+#ifdef SHA256_ARM
+    {"ARMv8 SHA2", sha256_compress_arm, 1, sha256_arm_supported},
+#endif
+    {"portable", sha256_compress_scalar, 1, NULL},
+};
 
-/* Note: the output lifetime of the return pointer (which points to eight 32-bit
-   numbers) is equal to that of the input struct sha256_state. */
-static uint32_t *
-sha256_done(struct sha256_state *ss)
+static sha256_kernel sha256_compress = NULL;
+static int sha256_lanes;
+
+/* Whether the given kernel can be used: the CPU must support it, and as a
+   precaution against misdetection, it must agree with the portable kernel. */
+static boolean
+sha256_kernel_usable(int kernel)
 {
-    if (ss->curlen >= sizeof(ss->buf))
-        panic("corrupted sha256 state in sha256-done");
+    uint32_t expected[SHA256_MAX_LANES][8], actual[SHA256_MAX_LANES][8];
+    unsigned char block[SHA256_MAX_LANES][64];
+    int i, l, lanes = sha256_kernels[kernel].lanes;
+
+    if (sha256_kernels[kernel].supported && !sha256_kernels[kernel].supported())
+        return FALSE;
+
+    for (l = 0; l < lanes; l++) {
+        for (i = 0; i < 64; i++)
+            block[l][i] = i * 37 + l * 101 + 11;
+        memcpy(expected[l], sha256_initial_state, sizeof expected[l]);
+        memcpy(actual[l], sha256_initial_state, sizeof actual[l]);
+        sha256_compress_scalar(expected + l, block + l);
+    }
+    sha256_kernels[kernel].compress(actual, block);
 
-    /* increase the length of the message */
-    ss->length += ss->curlen * 8;
+    return memcmp(expected, actual, lanes * sizeof expected[0]) == 0;
+}
 
-    /* append the '1' bit */
-    ss->buf[ss->curlen++] = (unsigned char)0x80;
+static void
+sha256_select_kernel(void)
+{
+    int i;
 
-    /* if the length is currently above 56 bytes we append zeros then compress.
-       Then we can fall back to padding zeros and length encoding like
-       normal. */
-    if (ss->curlen > 56) {
-        while (ss->curlen < 64) {
-            ss->buf[ss->curlen++] = (unsigned char)0;
+    for (i = 0; !sha256_compress; i++)
+        if (sha256_kernel_usable(i)) {
+            sha256_compress = sha256_kernels[i].compress;
+            sha256_lanes = sha256_kernels[i].lanes;
         }
-        sha256_compress(ss, ss->buf);
-        ss->curlen = 0;
-    }
+}
 
-    /* pad up to 56 bytes of zeroes */
-    while (ss->curlen < 56) {
-        ss->buf[ss->curlen++] = (unsigned char)0;
+/* Increases a seed by 1. We treat it as one big little-endian number. */
+static void
+increment_seed(unsigned char seed[static RNG_SEED_SIZE_BYTES])
+{
+    int s;
+
+    for (s = 0; s < RNG_SEED_SIZE_BYTES; s++) {
+        seed[s]++;
+        if (seed[s])
+            break;
     }
+}
 
-    /* store length */
-    ss->buf[56] = (ss->length >> 56) & 255;
-    ss->buf[57] = (ss->length >> 48) & 255;
-    ss->buf[58] = (ss->length >> 40) & 255;
-    ss->buf[59] = (ss->length >> 32) & 255;
-    ss->buf[60] = (ss->length >> 24) & 255;
-    ss->buf[61] = (ss->length >> 16) & 255;
-    ss->buf[62] = (ss->length >>  8) & 255;
-    ss->buf[63] = (ss->length >>  0) & 255;
-    sha256_compress(ss, ss->buf);
+/* Calculates the SHA-256 of a seed and the seeds that follow it: out[i] is the
+   hash of seed + i. The seed is short enough to fit in a single block along
+   with the padding and length, so each hash is one lane of a call to the
+   kernel. Returns the number of hashes calculated, which is the number of lanes
+   of the kernel in use. Note: the output is in host byte order, eight 32-bit
+   numbers per hash. */
+static_assert(RNG_SEED_SIZE_BYTES < 56 && RNG_SEED_SIZE_BYTES * 8 < 256,
+              "RNG seed does not fit in one SHA-256 block");
+static int
+sha256_of_seeds(const unsigned char seed[static RNG_SEED_SIZE_BYTES],
+                uint32_t out[static SHA256_MAX_LANES][8])
+{
+    unsigned char block[SHA256_MAX_LANES][64] = {{0}};
+    int l;
+
+    if (!sha256_compress)
+        sha256_select_kernel();
+
+    for (l = 0; l < sha256_lanes; l++) {
+        if (l == 0)
+            memcpy(block[l], seed, RNG_SEED_SIZE_BYTES);
+        else {
+            memcpy(block[l], block[l - 1], RNG_SEED_SIZE_BYTES);
+            increment_seed(block[l]);
+        }
+        block[l][RNG_SEED_SIZE_BYTES] = 0x80;   /* the '1' bit */
+        block[l][63] = RNG_SEED_SIZE_BYTES * 8; /* the length, in bits */
+        memcpy(out[l], sha256_initial_state, sizeof sha256_initial_state);
+    }
+    sha256_compress(out, block);
 
-    return ss->state;
+    return sha256_lanes;
 }
 
 /* End of SHA-256 code. Start of entropy collectors (based on AdeonRNG by Mikko
@@ -441,31 +732,339 @@ get_initial_rng_seed(char out[static RNG_SEED_SIZE_BASE64])
 }
 
 
+/* Profiling. */
+
+/* If the NH4RNGPROFILE environment variable names a file, the game counts how
+   random numbers are used, and appends a report to that file at the end of the
+   game (and when requested via the #rngprofile debug command, which can also
+   turn profiling on for the rest of the game). The report gives, for each RNG
+   and for each place in the code that asks for random numbers:
+
+   - the number of random numbers requested ("calls");
+   - the number of seeds hashed to produce them ("hashes"), which is more than
+     the number of calls when a hash had to be discarded to avoid modulo bias;
+   - (for RNGs) the number of calls to the SHA-256 kernel ("batches"), which
+     can be less than the number of hashes because of the lookahead buffers.
+
+   A caller is the code that called rn2_on_rng() or one of the wrappers in this
+   file (rn2(), rnd(), dice() and so on are inlined into their callers). It's
+   described as an offset into the executable or library it's in, which
+   addr2line can convert into a function and line number. */
+struct rng_profile_count {
+    unsigned long calls, hashes, batches;
+};
+
+#define RNG_PROFILE_SITES 4096  /* must be a power of 2 */
+
+static boolean rng_profiling = FALSE;
+static FILE *rng_profile_file = NULL;
+
+/* Totals over the whole program; the profiler counts the differences that each
+   call makes to these. */
+static unsigned long rng_hashes_used = 0, rng_batches = 0;
+
+/* Indexed by RNG number + 1, like the lookahead buffers. */
+static struct rng_profile_count
+rng_profile_streams[RNG_SEEDSPACE / RNG_SEED_SIZE_BYTES + 1];
+
+/* A hash table of call sites, with unknown callers and any that don't fit
+   counted together. */
+static struct rng_profile_site {
+    const void *caller;
+    struct rng_profile_count count;
+} rng_profile_sites[RNG_PROFILE_SITES];
+static struct rng_profile_count rng_profile_other_sites;
+
+#ifdef __GNUC__
+# define RNG_CALLER __builtin_return_address(0)
+#else
+# define RNG_CALLER NULL
+#endif
+
+static void
+rng_profile_add(struct rng_profile_count *count, unsigned long hashes,
+                unsigned long batches)
+{
+    count->calls++;
+    count->hashes += hashes;
+    count->batches += batches;
+}
+
+static void
+rng_profile_record(enum rng rng, const void *caller, unsigned long hashes,
+                   unsigned long batches)
+{
+    uintptr_t h = ((uintptr_t)caller >> 2) * 2654435761U;
+    int i, probe;
+
+    rng_profile_add(rng_profile_streams + rng + 1, hashes, batches);
+
+    for (probe = 0; caller && probe < 16; probe++) {
+        i = (h + probe) & (RNG_PROFILE_SITES - 1);
+        if (!rng_profile_sites[i].caller)
+            rng_profile_sites[i].caller = caller;
+        if (rng_profile_sites[i].caller == caller) {
+            rng_profile_add(&rng_profile_sites[i].count, hashes, batches);
+            return;
+        }
+    }
+    rng_profile_add(&rng_profile_other_sites, hashes, batches);
+}
+
+static void
+rng_profile_reset(void)
+{
+    memset(rng_profile_streams, 0, sizeof rng_profile_streams);
+    memset(rng_profile_sites, 0, sizeof rng_profile_sites);
+    memset(&rng_profile_other_sites, 0, sizeof rng_profile_other_sites);
+}
+
+/* Called at the start of each game. */
+void
+rng_profile_init(void)
+{
+    const char *path = nh_getenv("NH4RNGPROFILE");
+
+    if (rng_profile_file)
+        fclose(rng_profile_file);
+    rng_profile_file = NULL;
+    rng_profiling = FALSE;
+    rng_profile_reset();
+
+    if (path && *path) {
+        rng_profile_file = fopen(path, "a");
+        if (!rng_profile_file)
+            paniclog("rng_profile", "could not open the NH4RNGPROFILE file");
+        else
+            rng_profiling = TRUE;
+    }
+}
+
+/* Starts profiling for the rest of the game, if it isn't already on. */
+void
+rng_profile_start(void)
+{
+    rng_profiling = TRUE;
+}
+
+boolean
+rng_profile_active(void)
+{
+    return rng_profiling;
+}
+
+static int
+rng_profile_count_compare(const struct rng_profile_count *c1,
+                          const struct rng_profile_count *c2)
+{
+    if (c1->hashes != c2->hashes)
+        return c1->hashes < c2->hashes ? 1 : -1;
+    if (c1->calls != c2->calls)
+        return c1->calls < c2->calls ? 1 : -1;
+    return 0;
+}
+
+static int
+rng_profile_stream_compare(const void *s1, const void *s2)
+{
+    int i1 = *(const int *)s1, i2 = *(const int *)s2;
+    int rv = rng_profile_count_compare(rng_profile_streams + i1,
+                                       rng_profile_streams + i2);
+
+    return rv ? rv : i1 - i2;
+}
+
+static int
+rng_profile_site_compare(const void *s1, const void *s2)
+{
+    const struct rng_profile_site *site1 = s1, *site2 = s2;
+    int rv = rng_profile_count_compare(&site1->count, &site2->count);
+
+    if (rv)
+        return rv;
+    return (uintptr_t)site1->caller < (uintptr_t)site2->caller ? -1 : 1;
+}
+
+static void
+rng_profile_stream_name(int rng, char *buf, int size)
+{
+    if (rng == rng_display)
+        snprintf(buf, size, "display");
+    else if (rng == rng_main)
+        snprintf(buf, size, "main");
+    else if (rng >= first_level_rng)
+        snprintf(buf, size, "level %d", rng - first_level_rng);
+    else
+        snprintf(buf, size, "rng %d", rng); /* see enum rng in rnd.h */
+}
+
+static void
+rng_profile_site_name(const void *caller, char *buf, int size)
+{
+#ifdef AIMAKE_BUILDOS_linux
+    Dl_info info;
+
+    if (dladdr(caller, &info) && info.dli_fname) {
+        const char *file = strrchr(info.dli_fname, '/');
+
+        snprintf(buf, size, "%s+0x%lx", file ? file + 1 : info.dli_fname,
+                 (unsigned long)((const char *)caller -
+                                 (const char *)info.dli_fbase));
+        return;
+    }
+#endif
+    snprintf(buf, size, "%p", caller);
+}
+
+static void
+rng_profile_text(struct nh_menulist *menu, const char *line)
+{
+    if (menu)
+        add_menutext(menu, line);
+    if (rng_profile_file)
+        fprintf(rng_profile_file, "%s\n", line);
+}
+
+static void
+rng_profile_line(struct nh_menulist *menu, const char *name,
+                 const struct rng_profile_count *count, boolean batches)
+{
+    char line[BUFSZ];
+
+    if (batches)
+        snprintf(line, sizeof line, "%-24s %10lu %10lu %10lu", name,
+                 count->calls, count->hashes, count->batches);
+    else
+        snprintf(line, sizeof line, "%-24s %10lu %10lu", name,
+                 count->calls, count->hashes);
+
+    rng_profile_text(menu, line);
+}
+
+/* Produces a report of the RNG usage so far, sorted so that the RNGs and
+   callers that needed the most hashes come first. It goes into the
+   NH4RNGPROFILE file if there is one, and into menu unless that's NULL. */
+void
+rng_profile_report(struct nh_menulist *menu)
+{
+    int streams[sizeof rng_profile_streams / sizeof *rng_profile_streams];
+    struct rng_profile_site *sites;
+    char name[BUFSZ];
+    int i, nstreams = 0, nsites = 0;
+
+    if (!rng_profiling)
+        return;
+
+    for (i = 0; i < (int)(sizeof streams / sizeof *streams); i++)
+        if (rng_profile_streams[i].calls)
+            streams[nstreams++] = i;
+    if (!nstreams && !menu)
+        return;
+    qsort(streams, nstreams, sizeof *streams, rng_profile_stream_compare);
+
+    sites = malloc(sizeof rng_profile_sites);
+    if (!sites)
+        return;
+    for (i = 0; i < RNG_PROFILE_SITES; i++)
+        if (rng_profile_sites[i].caller)
+            sites[nsites++] = rng_profile_sites[i];
+    qsort(sites, nsites, sizeof *sites, rng_profile_site_compare);
+
+    if (rng_profile_file)
+        fprintf(rng_profile_file, "RNG profile, turn %u:\n", moves);
+    snprintf(name, sizeof name, "%-24s %10s %10s %10s",
+             "RNG", "calls", "hashes", "batches");
+    rng_profile_text(menu, name);
+    for (i = 0; i < nstreams; i++) {
+        rng_profile_stream_name(streams[i] - 1, name, sizeof name);
+        rng_profile_line(menu, name, rng_profile_streams + streams[i], TRUE);
+    }
+
+    rng_profile_text(menu, "");
+    snprintf(name, sizeof name, "%-24s %10s %10s", "caller", "calls", "hashes");
+    rng_profile_text(menu, name);
+    for (i = 0; i < nsites; i++) {
+        rng_profile_site_name(sites[i].caller, name, sizeof name);
+        rng_profile_line(menu, name, &sites[i].count, FALSE);
+    }
+    if (rng_profile_other_sites.calls)
+        rng_profile_line(menu, "(other)", &rng_profile_other_sites, FALSE);
+
+    if (rng_profile_file) {
+        fprintf(rng_profile_file, "\n");
+        fflush(rng_profile_file);
+    }
+    free(sites);
+}
+
+/* Called at the end of each game. */
+void
+rng_profile_uninit(void)
+{
+    rng_profile_report(NULL);
+
+    if (rng_profile_file)
+        fclose(rng_profile_file);
+    rng_profile_file = NULL;
+    rng_profiling = FALSE;
+}
+
+
 /* Generation. */
 
+/* The hash of a seed depends on nothing but the seed, and each RNG's seed just
+   counts upwards, so the hashes of the next few seeds can be calculated in
+   advance, in one call to a multi-lane kernel. Each RNG has a lookahead buffer
+   for this.
+
+   The buffer remembers which seed its next hash belongs to, and is only used if
+   the RNG's seed still has that value. So anything that changes the seed other
+   than generating a random number (reseeding, restoring a save file, starting
+   another game in the same process) invalidates the buffer automatically, and
+   the sequence of random numbers is the same as without the buffer. */
+struct rng_lookahead {
+    unsigned char seed[RNG_SEED_SIZE_BYTES];  /* the seed of hash[next] */
+    int next, count;
+    uint32_t hash[SHA256_MAX_LANES][8];
+};
+
+/* Indexed by RNG number + 1, to include rng_display. */
+static struct rng_lookahead
+rng_lookahead[RNG_SEEDSPACE / RNG_SEED_SIZE_BYTES + 1];
+
+/* Sets out to the SHA-256 of the seed, then increases the seed. */
+static void
+rng_next_hash(unsigned char seedarray[static RNG_SEED_SIZE_BYTES],
+              struct rng_lookahead *lookahead, uint32_t out[static 8])
+{
+    if (lookahead->next >= lookahead->count ||
+        memcmp(lookahead->seed, seedarray, RNG_SEED_SIZE_BYTES) != 0) {
+        lookahead->count = sha256_of_seeds(seedarray, lookahead->hash);
+        lookahead->next = 0;
+        rng_batches++;
+    }
+    rng_hashes_used++;
+
+    memcpy(out, lookahead->hash[lookahead->next++], sizeof lookahead->hash[0]);
+    increment_seed(seedarray);
+    memcpy(lookahead->seed, seedarray, RNG_SEED_SIZE_BYTES);
+}
+
 static uint32_t
 rn2_from_seedarray(uint32_t maxplus1,
-                   unsigned char seedarray[static RNG_SEED_SIZE_BYTES])
+                   unsigned char seedarray[static RNG_SEED_SIZE_BYTES],
+                   struct rng_lookahead *lookahead)
 {
-    struct sha256_state ss;
+    uint32_t out[8];
+    int s;
 
     if (maxplus1 == 0) {
         impossible("Impossible range 0 <= x < 0 for a random number");
         maxplus1 = 1;
     }
 
-    /* Calculate the SHA-256 of the current seed. */
-    sha256_init(&ss);
-    sha256_process(&ss, seedarray, RNG_SEED_SIZE_BYTES);
-    uint32_t *out = sha256_done(&ss);
-
-    /* Increase the seed. We treat it as one big little-endian number. */
-    int s;
-    for (s = 0; s < RNG_SEED_SIZE_BYTES; s++) {
-        seedarray[s]++;
-        if (seedarray[s])
-            break;
-    }
+    /* Calculate the SHA-256 of the current seed, and increase the seed. */
+    rng_next_hash(seedarray, lookahead, out);
 
     /* Produce output in the range 0..maxplus1-1. We look through the 32-bit
        numbers that the SHA-256 algorithm calculated, trying each one in turn to
@@ -494,11 +1093,56 @@ rn2_from_seedarray(uint32_t maxplus1,
             return out[s] / (unbiased_maximum / maxplus1);
     }
 
-    return rn2_from_seedarray(maxplus1, seedarray);
+    return rn2_from_seedarray(maxplus1, seedarray, lookahead);
 }
 
-int
-rn2_on_rng(int maxplus1, enum rng rng)
+/* Measures the speed of the SHA-256 kernel with the given index, for wizard
+   mode. Returns FALSE if there's no such kernel (setting *name to NULL) or
+   this computer can't use it; otherwise sets *per_second to the number of
+   random numbers it generated per second. The game's RNGs aren't touched. */
+boolean
+rng_benchmark_kernel(int kernel, const char **name, long *per_second)
+{
+    unsigned char seed[RNG_SEED_SIZE_BYTES] = {0};
+    struct rng_lookahead lookahead = {.count = 0};
+    sha256_kernel saved;
+    int saved_lanes;
+    clock_t start, elapsed;
+    long count = 0;
+    int i;
+
+    if (kernel < 0 ||
+        kernel >= (int)(sizeof sha256_kernels / sizeof *sha256_kernels)) {
+        *name = NULL;
+        return FALSE;
+    }
+    *name = sha256_kernels[kernel].name;
+    if (!sha256_kernel_usable(kernel))
+        return FALSE;
+
+    if (!sha256_compress)
+        sha256_select_kernel();
+    saved = sha256_compress;
+    saved_lanes = sha256_lanes;
+    sha256_compress = sha256_kernels[kernel].compress;
+    sha256_lanes = sha256_kernels[kernel].lanes;
+
+    start = clock();
+    do {
+        for (i = 0; i < 10000; i++)
+            rn2_from_seedarray(1000, seed, &lookahead);
+        count += 10000;
+        elapsed = clock() - start;
+    } while (elapsed < CLOCKS_PER_SEC / 4);
+
+    sha256_compress = saved;
+    sha256_lanes = saved_lanes;
+    *per_second = (long)(count * (double)CLOCKS_PER_SEC / elapsed);
+    return TRUE;
+}
+
+static int
+rn2_on_rng_unprofiled(int maxplus1, enum rng rng)
 {
     if (maxplus1 <= 0) {
         impossible(msgprintf("RNG %d range has less than 1 value", rng));
@@ -520,7 +1164,8 @@ rn2_on_rng(int maxplus1, enum rng rng)
            for the sequence to be particularly secure, so we can start at 0. */
         static unsigned char display_rng_seed[RNG_SEED_SIZE_BYTES] = {0};
 
-        return (int)rn2_from_seedarray(maxplus1, display_rng_seed);
+        return (int)rn2_from_seedarray(maxplus1, display_rng_seed,
+                                       rng_lookahead + rng_display + 1);
 
     } else if (rng == rng_initialseed) {
 
@@ -533,7 +1178,8 @@ rn2_on_rng(int maxplus1, enum rng rng)
             impossible("Zero-time command used main RNG");
 
         return (int)rn2_from_seedarray(maxplus1,
-            flags.rngstate + rng * RNG_SEED_SIZE_BYTES);
+            flags.rngstate + rng * RNG_SEED_SIZE_BYTES,
+            rng_lookahead + rng + 1);
 
     } else {
 
@@ -542,11 +1188,33 @@ rn2_on_rng(int maxplus1, enum rng rng)
     }
 }
 
+/* rn2_on_rng(), attributing the call to caller when profiling. */
+static int
+rn2_on_rng_from(int maxplus1, enum rng rng, const void *caller)
+{
+    unsigned long hashes = rng_hashes_used, batches = rng_batches;
+    int rv;
+
+    if (!rng_profiling)
+        return rn2_on_rng_unprofiled(maxplus1, rng);
+
+    rv = rn2_on_rng_unprofiled(maxplus1, rng);
+    rng_profile_record(rng, caller, rng_hashes_used - hashes,
+                       rng_batches - batches);
+    return rv;
+}
+
+int
+rn2_on_rng(int maxplus1, enum rng rng)
+{
+    return rn2_on_rng_from(maxplus1, rng, RNG_CALLER);
+}
+
 /* Wrapper for functions that take an RNG as an argument. */
 int
 rn2_on_display_rng(int x)
 {
-    return rn2_on_rng(x, rng_display);
+    return rn2_on_rng_from(x, rng_display, RNG_CALLER);
 }
 
 
@@ -556,11 +1224,12 @@ rn2_on_display_rng(int x)
 int
 rnl(int x)
 {
+    const void *caller = RNG_CALLER;
     int i;
 
-    i = rn2(x);
+    i = rn2_on_rng_from(x, rng_main, caller);
 
-    if (Luck && rn2(50 - Luck)) {
+    if (Luck && rn2_on_rng_from(50 - Luck, rng_main, caller)) {
         i -= (x <= 15 && Luck >= -5 ? Luck / 3 : Luck);
         if (i < 0)
             i = 0;
@@ -580,12 +1249,13 @@ rng_for_level(const d_level *lev)
 int
 mklev_rn2(int x, struct level *lev)
 {
-    return rn2_on_rng(x, rng_for_level(&lev->z));
+    return rn2_on_rng_from(x, rng_for_level(&lev->z), RNG_CALLER);
 }
 
 int
 rat_rne(int numerator, int denominator, enum rng rng)
 {
+    const void *caller = RNG_CALLER;
     int tmp = 1;
     if (numerator < 1) {
         impossible("Numerator too small in rat_rne(%d,%d,%d)",
@@ -597,7 +1267,8 @@ rat_rne(int numerator, int denominator, enum rng rng)
                    numerator, denominator, rng);
         return tmp;
     }
-    while (tmp < 10 && (numerator - 1) >= rn2_on_rng(denominator, rng))
+    while (tmp < 10 &&
+           (numerator - 1) >= rn2_on_rng_from(denominator, rng, caller))
         tmp++;
     return tmp;
 }
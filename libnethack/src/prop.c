@@ -9,6 +9,8 @@
 #include "mfndpos.h"
 #include "alignrec.h"
 
+#include <time.h>
+
 /* This file is responsible for determining whether the character has intrinsics
    and extrinsics, because it was previously done with a bunch of macros, which
    are rather hard to iterate over, and make it even harder to work with the
@@ -25,9 +27,10 @@ m_has_property(const struct monst *mon, enum youprop property,
     unsigned rv = 0;
     struct obj *otmp;
     const struct permonst *pm = mon->data;
+    boolean blocked;
 
     /* The general case for equipment */
-    rv |= mworn_extrinsic(mon, property);
+    rv |= mworn_extrinsic_blocked(mon, property, &blocked);
 
     if (mon == &youmonst) {
         /* Intrinsics */
@@ -142,7 +145,7 @@ m_has_property(const struct monst *mon, enum youprop property,
 
         if (property == WWALKING && Is_waterlevel(m_mz(mon)))
             rv &= (unsigned)(W_MASK(os_birthopt));
-        if (mworn_blocked(mon, property))
+        if (blocked)
             rv &= (unsigned)(W_MASK(os_birthopt));
     }
 
@@ -195,11 +198,9 @@ m_helpless(const struct monst *mon, enum helpless_mask mask)
 }
 
 
-/* Returns the bitwise OR of all MSENSE_ values that explain how "viewer" can
-   see "viewee". &youmonst is accepted as either argument. If both arguments
-   are the same, this tests if/how a monster/player can detect itself. */
-unsigned
-msensem(const struct monst *viewer, const struct monst *viewee)
+/* Does the actual work for msensem (below), without consulting the memo. */
+static unsigned
+msensem_uncached(const struct monst *viewer, const struct monst *viewee)
 {
     unsigned sensemethod = 0;
 
@@ -393,6 +394,158 @@ msensem(const struct monst *viewer, const struct monst *viewee)
     return sensemethod;
 }
 
+/* Memoization of msensem.
+
+   The inputs to msensem are scattered all over the monster and player
+   structures, and are written directly in hundreds of places, so there is no
+   practical way to notice every change that would invalidate a cached answer.
+   Instead, the memo is only active inside a "sensing scope", which the caller
+   opens with msensem_memo_begin() around code that reads the game state but
+   does not change it (such as redrawing every monster on the map). Within a
+   scope, asking the same question twice must give the same answer, so any
+   repeat can be served from the table; each new scope starts a new generation,
+   which invalidates everything cached before it. As a further safety net, an
+   entry only matches if both monsters are still where they were when it was
+   computed.
+
+   The biggest winner is a long worm: its head and every tail segment are
+   drawn separately, and each of those asks whether the hero can sense the
+   worm, which walks the whole tail. */
+#define MSENSEM_MEMO_SIZE 256       /* must be a power of 2 */
+#define MSENSEM_MEMO_TIMING 32      /* time one in this many misses */
+
+struct msensem_memo {
+    const struct monst *viewer;
+    const struct monst *viewee;
+    unsigned viewer_id, viewee_id;
+    unsigned generation;
+    xchar sx, sy, tx, ty;
+    unsigned result;
+};
+
+static struct msensem_memo msensem_memo[MSENSEM_MEMO_SIZE];
+static unsigned msensem_memo_depth = 0;
+static unsigned msensem_memo_generation = 0;
+
+static unsigned long long msensem_hits, msensem_misses, msensem_uncached_calls;
+static unsigned long long msensem_timed_misses, msensem_timed_nsec;
+
+void
+msensem_memo_begin(void)
+{
+    if (msensem_memo_depth++)
+        return;
+
+    /* Generation 0 is never used, so that zeroed entries can't match. */
+    if (!++msensem_memo_generation) {
+        memset(msensem_memo, 0, sizeof msensem_memo);
+        msensem_memo_generation++;
+    }
+}
+
+void
+msensem_memo_end(void)
+{
+    if (!msensem_memo_depth)
+        impossible("msensem_memo_end without msensem_memo_begin");
+    else
+        msensem_memo_depth--;
+}
+
+static unsigned
+msensem_timed(const struct monst *viewer, const struct monst *viewee)
+{
+    unsigned result;
+#ifdef CLOCK_MONOTONIC
+    struct timespec start, end;
+
+    if ((msensem_misses % MSENSEM_MEMO_TIMING) == 0 &&
+        clock_gettime(CLOCK_MONOTONIC, &start) == 0) {
+        result = msensem_uncached(viewer, viewee);
+        if (clock_gettime(CLOCK_MONOTONIC, &end) == 0) {
+            msensem_timed_misses++;
+            msensem_timed_nsec +=
+                (end.tv_sec - start.tv_sec) * 1000000000LL +
+                (end.tv_nsec - start.tv_nsec);
+        }
+        return result;
+    }
+#endif
+    return msensem_uncached(viewer, viewee);
+}
+
+/* Returns the bitwise OR of all MSENSE_ values that explain how "viewer" can
+   see "viewee". &youmonst is accepted as either argument. If both arguments
+   are the same, this tests if/how a monster/player can detect itself. */
+unsigned
+msensem(const struct monst *viewer, const struct monst *viewee)
+{
+    struct msensem_memo *memo;
+    unsigned viewer_id, viewee_id;
+
+    if (!msensem_memo_depth) {
+        msensem_uncached_calls++;
+        return msensem_uncached(viewer, viewee);
+    }
+
+    /* m_id 0 is the hero. */
+    viewer_id = viewer == &youmonst ? 0 : viewer->m_id;
+    viewee_id = viewee == &youmonst ? 0 : viewee->m_id;
+    memo = msensem_memo +
+        ((viewer_id * 31 + viewee_id * 17 + (viewee_id >> 8)) &
+         (MSENSEM_MEMO_SIZE - 1));
+
+    if (memo->generation == msensem_memo_generation &&
+        memo->viewer == viewer && memo->viewee == viewee &&
+        memo->viewer_id == viewer_id && memo->viewee_id == viewee_id &&
+        memo->sx == m_mx(viewer) && memo->sy == m_my(viewer) &&
+        memo->tx == m_mx(viewee) && memo->ty == m_my(viewee)) {
+        msensem_hits++;
+        return memo->result;
+    }
+
+    msensem_misses++;
+    memo->result = msensem_timed(viewer, viewee);
+    memo->viewer = viewer;
+    memo->viewee = viewee;
+    memo->viewer_id = viewer_id;
+    memo->viewee_id = viewee_id;
+    memo->sx = m_mx(viewer);
+    memo->sy = m_my(viewer);
+    memo->tx = m_mx(viewee);
+    memo->ty = m_my(viewee);
+    memo->generation = msensem_memo_generation;
+    return memo->result;
+}
+
+/* Describes how well the msensem memo is doing, for the #sensestats debug
+   command. */
+void
+msensem_memo_report(struct nh_menulist *menu)
+{
+    unsigned long long lookups = msensem_hits + msensem_misses;
+    double miss_nsec = msensem_timed_misses ?
+        (double)msensem_timed_nsec / msensem_timed_misses : 0.0;
+
+    add_menutext(menu, msgprintf(
+                     "Calls outside a sensing scope: %llu",
+                     msensem_uncached_calls));
+    add_menutext(menu, msgprintf(
+                     "Calls inside a sensing scope: %llu", lookups));
+    add_menutext(menu, msgprintf(
+                     "Memo hits: %llu (%.1f%%)", msensem_hits,
+                     lookups ? 100.0 * msensem_hits / lookups : 0.0));
+    if (msensem_timed_misses) {
+        add_menutext(menu, msgprintf(
+                         "Average cost of a miss: %.0f ns (%llu timed)",
+                         miss_nsec, msensem_timed_misses));
+        add_menutext(menu, msgprintf(
+                         "Estimated time saved by hits: %.3f ms",
+                         miss_nsec * msensem_hits / 1000000.0));
+    } else
+        add_menutext(menu, "No misses have been timed yet.");
+}
+
 
 /* Enlightenment and conduct */
 static const char
@@ -0,0 +1,414 @@
+/* This source file is generated by 'makedefs'.  Do not edit. */
+/* This file contains generated tables of read-only data. */
+#include "config.h"
+#include "decl.h"
+#include "objclass.h"
+#include "mondata.h"
+
+const int bases[MAXOCLASSES] = {
+  0,   0,   1,  60, 140, 184, 196, 252, 280, 317, 353, 415, 442, 443, 480, 
+482, 483, 484, 
+};
+
+const struct nh_listitem timezone_list[] = {
+    {0, "UTC"},
+    {-43200, "UTC-1200"},
+    {-42300, "UTC-1145"},
+    {-41400, "UTC-1130"},
+    {-40500, "UTC-1115"},
+    {-39600, "UTC-1100"},
+    {-38700, "UTC-1045"},
+    {-37800, "UTC-1030"},
+    {-36900, "UTC-1015"},
+    {-36000, "UTC-1000"},
+    {-35100, "UTC-0945"},
+    {-34200, "UTC-0930"},
+    {-33300, "UTC-0915"},
+    {-32400, "UTC-0900"},
+    {-31500, "UTC-0845"},
+    {-30600, "UTC-0830"},
+    {-29700, "UTC-0815"},
+    {-28800, "UTC-0800"},
+    {-27900, "UTC-0745"},
+    {-27000, "UTC-0730"},
+    {-26100, "UTC-0715"},
+    {-25200, "UTC-0700"},
+    {-24300, "UTC-0645"},
+    {-23400, "UTC-0630"},
+    {-22500, "UTC-0615"},
+    {-21600, "UTC-0600"},
+    {-20700, "UTC-0545"},
+    {-19800, "UTC-0530"},
+    {-18900, "UTC-0515"},
+    {-18000, "UTC-0500"},
+    {-17100, "UTC-0445"},
+    {-16200, "UTC-0430"},
+    {-15300, "UTC-0415"},
+    {-14400, "UTC-0400"},
+    {-13500, "UTC-0345"},
+    {-12600, "UTC-0330"},
+    {-11700, "UTC-0315"},
+    {-10800, "UTC-0300"},
+    {-9900, "UTC-0245"},
+    {-9000, "UTC-0230"},
+    {-8100, "UTC-0215"},
+    {-7200, "UTC-0200"},
+    {-6300, "UTC-0145"},
+    {-5400, "UTC-0130"},
+    {-4500, "UTC-0115"},
+    {-3600, "UTC-0100"},
+    {-2700, "UTC-0045"},
+    {-1800, "UTC-0030"},
+    {-900, "UTC-0015"},
+    {900, "UTC+0015"},
+    {1800, "UTC+0030"},
+    {2700, "UTC+0045"},
+    {3600, "UTC+0100"},
+    {4500, "UTC+0115"},
+    {5400, "UTC+0130"},
+    {6300, "UTC+0145"},
+    {7200, "UTC+0200"},
+    {8100, "UTC+0215"},
+    {9000, "UTC+0230"},
+    {9900, "UTC+0245"},
+    {10800, "UTC+0300"},
+    {11700, "UTC+0315"},
+    {12600, "UTC+0330"},
+    {13500, "UTC+0345"},
+    {14400, "UTC+0400"},
+    {15300, "UTC+0415"},
+    {16200, "UTC+0430"},
+    {17100, "UTC+0445"},
+    {18000, "UTC+0500"},
+    {18900, "UTC+0515"},
+    {19800, "UTC+0530"},
+    {20700, "UTC+0545"},
+    {21600, "UTC+0600"},
+    {22500, "UTC+0615"},
+    {23400, "UTC+0630"},
+    {24300, "UTC+0645"},
+    {25200, "UTC+0700"},
+    {26100, "UTC+0715"},
+    {27000, "UTC+0730"},
+    {27900, "UTC+0745"},
+    {28800, "UTC+0800"},
+    {29700, "UTC+0815"},
+    {30600, "UTC+0830"},
+    {31500, "UTC+0845"},
+    {32400, "UTC+0900"},
+    {33300, "UTC+0915"},
+    {34200, "UTC+0930"},
+    {35100, "UTC+0945"},
+    {36000, "UTC+1000"},
+    {36900, "UTC+1015"},
+    {37800, "UTC+1030"},
+    {38700, "UTC+1045"},
+    {39600, "UTC+1100"},
+    {40500, "UTC+1115"},
+    {41400, "UTC+1130"},
+    {42300, "UTC+1145"},
+    {43200, "UTC+1200"},
+    {44100, "UTC+1215"},
+    {45000, "UTC+1230"},
+    {45900, "UTC+1245"},
+    {46800, "UTC+1300"},
+    {47700, "UTC+1315"},
+    {48600, "UTC+1330"},
+    {49500, "UTC+1345"},
+    {50400, "UTC+1400"},
+};
+const struct nh_enum_option timezone_spec =
+    { timezone_list, sizeof timezone_list / sizeof *timezone_list };
+
+
+const struct nh_listitem polyinit_list[] = {
+    {-1, "(off)"},
+    {0, "giant ant"},
+    {1, "killer bee"},
+    {2, "soldier ant"},
+    {3, "fire ant"},
+    {4, "giant beetle"},
+    {5, "queen bee"},
+    {6, "chickatrice"},
+    {7, "cockatrice"},
+    {8, "pyrolisk"},
+    {9, "jackal"},
+    {10, "fox"},
+    {11, "coyote"},
+    {13, "puppy"},
+    {14, "dog"},
+    {15, "large dog"},
+    {16, "dingo"},
+    {17, "wolf"},
+    {19, "warg"},
+    {20, "winter wolf cub"},
+    {21, "winter wolf"},
+    {22, "hell hound pup"},
+    {23, "hell hound"},
+    {24, "gas spore"},
+    {25, "floating eye"},
+    {26, "yellow light"},
+    {27, "black light"},
+    {28, "stinking sphere"},
+    {29, "freezing sphere"},
+    {30, "flaming sphere"},
+    {31, "shocking sphere"},
+    {32, "kitten"},
+    {33, "housecat"},
+    {34, "jaguar"},
+    {35, "lynx"},
+    {36, "panther"},
+    {37, "large cat"},
+    {38, "tiger"},
+    {39, "gremlin"},
+    {40, "gargoyle"},
+    {41, "winged gargoyle"},
+    {42, "hobbit"},
+    {44, "bugbear"},
+    {45, "dwarf lord"},
+    {46, "dwarf king"},
+    {47, "quantum mechanic"},
+    {49, "mind flayer"},
+    {50, "master mind flayer"},
+    {51, "homunculus"},
+    {52, "imp"},
+    {53, "quasit"},
+    {54, "leprechaun"},
+    {55, "tengu"},
+    {56, "acid blob"},
+    {57, "quivering blob"},
+    {58, "gelatinous cube"},
+    {59, "blue jelly"},
+    {60, "spotted jelly"},
+    {61, "ochre jelly"},
+    {62, "kobold"},
+    {63, "large kobold"},
+    {64, "kobold lord"},
+    {65, "kobold shaman"},
+    {66, "newt"},
+    {67, "gecko"},
+    {68, "iguana"},
+    {69, "baby crocodile"},
+    {70, "lizard"},
+    {71, "crocodile"},
+    {73, "salamander"},
+    {74, "small mimic"},
+    {75, "large mimic"},
+    {76, "giant mimic"},
+    {77, "wood nymph"},
+    {78, "water nymph"},
+    {79, "mountain nymph"},
+    {80, "island nymph"},
+    {81, "goblin"},
+    {82, "hobgoblin"},
+    {84, "hill orc"},
+    {85, "Mordor orc"},
+    {86, "Uruk-hai"},
+    {87, "orc shaman"},
+    {88, "orc-captain"},
+    {89, "rothe"},
+    {90, "mumak"},
+    {91, "leocrotta"},
+    {92, "wumpus"},
+    {93, "titanothere"},
+    {94, "mammoth"},
+    {95, "sewer rat"},
+    {96, "giant rat"},
+    {97, "rabid rat"},
+    {99, "scurrier"},
+    {100, "rock mole"},
+    {101, "woodchuck"},
+    {102, "cave spider"},
+    {103, "centipede"},
+    {104, "giant spider"},
+    {105, "scorpion"},
+    {106, "rock piercer"},
+    {107, "iron piercer"},
+    {108, "glass piercer"},
+    {109, "lurker above"},
+    {110, "trapper"},
+    {111, "white unicorn"},
+    {112, "gray unicorn"},
+    {113, "black unicorn"},
+    {114, "pony"},
+    {115, "horse"},
+    {116, "warhorse"},
+    {117, "fog cloud"},
+    {118, "dust vortex"},
+    {119, "ice vortex"},
+    {120, "energy vortex"},
+    {121, "steam vortex"},
+    {122, "fire vortex"},
+    {123, "baby long worm"},
+    {124, "baby purple worm"},
+    {125, "long worm"},
+    {126, "purple worm"},
+    {127, "grid bug"},
+    {129, "xan"},
+    {130, "couatl"},
+    {131, "Aleax"},
+    {135, "bat"},
+    {136, "giant bat"},
+    {137, "raven"},
+    {138, "vampire bat"},
+    {139, "plains centaur"},
+    {140, "forest centaur"},
+    {141, "mountain centaur"},
+    {142, "baby gray dragon"},
+    {143, "baby silver dragon"},
+    {144, "baby red dragon"},
+    {145, "baby white dragon"},
+    {146, "baby orange dragon"},
+    {147, "baby black dragon"},
+    {148, "baby blue dragon"},
+    {149, "baby green dragon"},
+    {150, "baby yellow dragon"},
+    {151, "young gray dragon"},
+    {152, "young silver dragon"},
+    {153, "young red dragon"},
+    {154, "young white dragon"},
+    {155, "young orange dragon"},
+    {156, "young black dragon"},
+    {157, "young blue dragon"},
+    {158, "young green dragon"},
+    {159, "young yellow dragon"},
+    {160, "gray dragon"},
+    {161, "silver dragon"},
+    {162, "red dragon"},
+    {163, "white dragon"},
+    {164, "orange dragon"},
+    {165, "black dragon"},
+    {166, "blue dragon"},
+    {167, "green dragon"},
+    {168, "yellow dragon"},
+    {187, "stalker"},
+    {188, "sylph"},
+    {189, "air elemental"},
+    {190, "fire elemental"},
+    {191, "earth elemental"},
+    {192, "water elemental"},
+    {193, "lichen"},
+    {194, "brown mold"},
+    {195, "yellow mold"},
+    {196, "green mold"},
+    {197, "red mold"},
+    {198, "shrieker"},
+    {199, "violet fungus"},
+    {201, "gnome lord"},
+    {202, "gnomish wizard"},
+    {203, "gnome king"},
+    {204, "giant"},
+    {205, "hill giant"},
+    {206, "fire giant"},
+    {207, "frost giant"},
+    {208, "storm giant"},
+    {209, "titan"},
+    {210, "minotaur"},
+    {211, "baby gryphon"},
+    {212, "gryphon"},
+    {213, "jabberwock"},
+    {214, "jellyfish"},
+    {215, "piranha"},
+    {216, "shark"},
+    {217, "giant eel"},
+    {218, "electric eel"},
+    {220, "lich"},
+    {221, "demilich"},
+    {222, "master lich"},
+    {223, "arch-lich"},
+    {224, "kobold mummy"},
+    {225, "gnome mummy"},
+    {226, "orc mummy"},
+    {227, "dwarf mummy"},
+    {228, "elf mummy"},
+    {229, "human mummy"},
+    {230, "ettin mummy"},
+    {231, "giant mummy"},
+    {232, "red naga hatchling"},
+    {233, "black naga hatchling"},
+    {234, "golden naga hatchling"},
+    {235, "guardian naga hatchling"},
+    {236, "red naga"},
+    {237, "black naga"},
+    {238, "golden naga"},
+    {239, "guardian naga"},
+    {240, "ogre"},
+    {241, "ogre lord"},
+    {242, "ogre king"},
+    {243, "gray ooze"},
+    {244, "brown pudding"},
+    {245, "black pudding"},
+    {247, "green slime"},
+    {249, "Woodland-elf"},
+    {250, "Green-elf"},
+    {251, "Grey-elf"},
+    {252, "elf-lord"},
+    {253, "Elvenking"},
+    {254, "rust monster"},
+    {255, "disenchanter"},
+    {256, "garter snake"},
+    {257, "pit viper"},
+    {258, "python"},
+    {259, "cobra"},
+    {260, "troll"},
+    {261, "ice troll"},
+    {262, "rock troll"},
+    {263, "water troll"},
+    {264, "Olog-hai"},
+    {265, "black bear"},
+    {266, "brown bear"},
+    {267, "grizzly bear"},
+    {268, "dire bear"},
+    {270, "vampire"},
+    {271, "vampire lord"},
+    {273, "manes"},
+    {274, "barrow wight"},
+    {275, "wraith"},
+    {279, "xorn"},
+    {280, "umber hulk"},
+    {281, "ettin"},
+    {282, "deep ettin"},
+    {283, "monkey"},
+    {284, "ape"},
+    {285, "owlbear"},
+    {286, "yeti"},
+    {287, "sasquatch"},
+    {288, "kobold zombie"},
+    {289, "gnome zombie"},
+    {290, "orc zombie"},
+    {291, "dwarf zombie"},
+    {292, "elf zombie"},
+    {293, "human zombie"},
+    {294, "ettin zombie"},
+    {295, "giant zombie"},
+    {296, "ghoul"},
+    {297, "skeleton"},
+    {298, "straw golem"},
+    {299, "paper golem"},
+    {300, "rope golem"},
+    {301, "gold golem"},
+    {302, "leather golem"},
+    {303, "wood golem"},
+    {304, "flesh golem"},
+    {305, "clay golem"},
+    {306, "stone golem"},
+    {307, "glass golem"},
+    {308, "iron golem"},
+    {333, "horned devil"},
+    {334, "succubus"},
+    {335, "incubus"},
+    {337, "barbed devil"},
+    {338, "marilith"},
+    {339, "vrock"},
+    {340, "hezrou"},
+    {341, "bone devil"},
+    {342, "ice devil"},
+    {343, "nalfeshnee"},
+    {344, "pit fiend"},
+    {345, "balrog"},
+};
+const struct nh_enum_option polyinit_spec =
+    { polyinit_list, sizeof polyinit_list / sizeof *polyinit_list };
+
+
+/*readonly.c*/
@@ -215,6 +215,7 @@ add_region(struct level *lev, struct region *reg)
     struct region **tmp_reg;
     int i, j;
 
+    mark_level_dirty(lev);
     if (lev->max_regions <= lev->n_regions) {
         tmp_reg = lev->regions;
         lev->regions =
@@ -263,6 +264,7 @@ remove_region(struct region *reg)
             break;
     if (i == reg->lev->n_regions)
         return;
+    mark_level_dirty(lev);
 
     /* Update screen if necessary */
     if (reg->visible && level == lev)
@@ -230,7 +230,7 @@ restobjchn(struct memfile *mf, struct level *lev, boolean ghostly,
             unsigned nid = next_ident();
 
             add_id_mapping(otmp->o_id, nid);
-            otmp->o_id = nid;
+            set_obj_id(otmp, nid);
         }
         if (ghostly && otmp->otyp == SLIME_MOLD)
             ghostfruit(otmp);
@@ -471,6 +471,7 @@ restgamestate(struct memfile *mf)
     restobjchn(mf, lev, FALSE, FALSE, &invent, NULL);
     restobjchn(mf, lev, FALSE, FALSE, &magic_chest_objs, NULL);
     migrating_mons = restmonchn(mf, NULL, FALSE);
+    mon_index_rebuild(migrating_mon_index(), migrating_mons);
     restore_mvitals(mf);
 
     restore_spellbook(mf);
@@ -968,17 +969,12 @@ trickery(const char *reason)
 }
 
 
+/* Unpacks the bitfields that save.c packs into 32 and 16 bits. */
 static void
-restore_location(struct memfile *mf, struct rm *loc)
+unpack_location(struct rm *loc, unsigned int lflags1, unsigned short lflags2)
 {
-    unsigned int lflags1;
-    unsigned short lflags2;
     int l = 0, t = 0;
 
-    lflags1 = mread32(mf);
-    loc->typ = mread8(mf);
-    loc->seenv = mread8(mf);
-    lflags2 = mread16(mf);
     loc->mem_bg = (lflags1 >> 26) & 63;
     loc->mem_trap = (lflags1 >> 21) & 31;
     loc->mem_obj = (lflags1 >> 11) & 1023;
@@ -1047,6 +1043,38 @@ restore_location(struct memfile *mf, struct rm *loc)
     loc->mem_door_t = t;
 }
 
+/* The inverse of save_locations. */
+static void
+restore_locations(struct memfile *mf, struct level *lev)
+{
+    struct rm (*locs)[ROWNO] = lev->locations;
+    unsigned int memflags[COLNO][ROWNO];
+    int x, y;
+
+    if (flags.save_encoding < saveenc_planar) {
+        for (x = 0; x < COLNO; x++)
+            for (y = 0; y < ROWNO; y++) {
+                unsigned int lflags1 = mread32(mf);
+
+                locs[x][y].typ = mread8(mf);
+                locs[x][y].seenv = mread8(mf);
+                unpack_location(&locs[x][y], lflags1, mread16(mf));
+            }
+        return;
+    }
+
+    for (x = 0; x < COLNO; x++)
+        for (y = 0; y < ROWNO; y++) {
+            memflags[x][y] = mread32(mf);
+            locs[x][y].seenv = mread8(mf);
+        }
+    for (x = 0; x < COLNO; x++)
+        for (y = 0; y < ROWNO; y++) {
+            locs[x][y].typ = mread8(mf);
+            unpack_location(&locs[x][y], memflags[x][y], mread16(mf));
+        }
+}
+
 
 static struct trap *
 restore_traps(struct memfile *mf)
@@ -1176,9 +1204,7 @@ getlev(struct memfile *mf, xchar levnum, boolean ghostly)
     init_rect(rng_for_level(&lev->z));
 
     mread(mf, lev->levname, sizeof (lev->levname));
-    for (x = 0; x < COLNO; x++)
-        for (y = 0; y < ROWNO; y++)
-            restore_location(mf, &lev->locations[x][y]);
+    restore_locations(mf, lev);
 
     lev->lastmoves = mread32(mf);
     restore_stairway(mf, &lev->upstair);
@@ -1213,6 +1239,7 @@ getlev(struct memfile *mf, xchar levnum, boolean ghostly)
     restore_timers(mf, lev, RANGE_LEVEL, ghostly, moves - lev->lastmoves);
     restore_light_sources(mf, lev);
     lev->monlist = restmonchn(mf, lev, ghostly);
+    mon_index_rebuild(&lev->monindex, lev->monlist);
 
     if (ghostly) {
         struct monst *mtmp2;
@@ -1233,6 +1260,7 @@ getlev(struct memfile *mf, xchar levnum, boolean ghostly)
 
     rest_worm(mf, lev); /* restore worm information */
     lev->lev_traps = restore_traps(mf);
+    index_traps(lev);
     restobjchn(mf, lev, ghostly, FALSE, &lev->objlist, &table);
     find_lev_obj(lev);
     /* restobjchn()'s `frozen' argument probably ought to be a callback routine
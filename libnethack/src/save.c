@@ -30,6 +30,16 @@ static void save_flags(struct memfile *mf);
 static void save_autopickup_rules(struct memfile *mf,
                                   struct nh_autopickup_rules *ar);
 static void freefruitchn(void);
+static void savelev_or_copy(struct memfile *mf, xchar levnum,
+                            const struct memfile *prev_save);
+static boolean level_save_reusable(const struct level *lev,
+                                   const struct memfile *prev_save);
+static void record_level_save(struct memfile *mf, struct level *lev, int start,
+                              int tags_before);
+static void free_level_save_cache(struct level *lev);
+
+/* Distinguishes the memfiles written by different savegame() calls. */
+static unsigned long last_save_serial = 0;
 
 
 /*
@@ -57,7 +67,7 @@ static void freefruitchn(void);
     int##bw##_t                                                         \
     save_encode_##bw(int##bw##_t val, int rel, int rel2) {              \
         if (!val || !flags.save_encoding) return val;                   \
-        if (flags.save_encoding == saveenc_levelrel) rel = rel2;        \
+        if (flags.save_encoding >= saveenc_levelrel) rel = rel2;        \
         uint##bw##_t rotamount = ((uint32_t) rel) % rmax;               \
         uint##bw##_t out = val - 1;                                     \
         if (out >= rotamount) out -= rotamount;                         \
@@ -73,7 +83,7 @@ GEN_SAVE_ENCODE(32, 0xFFFFFFFF)
     int##bw##_t                                                         \
     save_decode_##bw(int##bw##_t val, int rel, int rel2) {              \
         if (!val || !flags.save_encoding) return val;                   \
-        if (flags.save_encoding == saveenc_levelrel) rel = rel2;        \
+        if (flags.save_encoding >= saveenc_levelrel) rel = rel2;        \
         uint##bw##_t rotamount = ((uint32_t) rel) % rmax;               \
         rotamount = rmax - rotamount;                                   \
         uint##bw##_t out = val - 1;                                     \
@@ -93,6 +103,16 @@ savegame(struct memfile *mf)
 {
     int count = 0;
     xchar ltmp;
+    const struct memfile *prev_save;
+
+    /* Levels that haven't changed since the previous save can be copied from
+       it. When diffing, that's the save we're diffing against; otherwise, it's
+       the binary save (if we aren't overwriting it). */
+    prev_save = mf->relativeto;
+    if (!prev_save && program_state.binary_save_allocated &&
+        mf != &program_state.binary_save)
+        prev_save = &program_state.binary_save;
+    mf->save_serial = ++last_save_serial;
 
     /* no tag useful here as store_version adds one */
     store_version(mf);
@@ -120,9 +140,7 @@ savegame(struct memfile *mf)
     for (ltmp = 1; ltmp <= maxledgerno(); ltmp++) {
         if (!levels[ltmp])
             continue;
-        mtag(mf, ltmp, MTAG_LEVELS);
-        mwrite8(mf, ltmp);      /* level number */
-        savelev(mf, ltmp);      /* actual level */
+        savelev_or_copy(mf, ltmp, prev_save);
     }
     savegamestate(mf);
 
@@ -133,6 +151,111 @@ savegame(struct memfile *mf)
 }
 
 
+/* Whether lev can be copied from prev_save rather than being serialized. The
+   current level is excluded because it changes far too often to be worth
+   tracking; the other levels change only via mark_level_dirty() callers. Save
+   encodings before saveenc_levelrel make the level's bytes depend on the
+   current turn, and a change of encoding changes the level's layout. */
+static boolean
+level_save_reusable(const struct level *lev, const struct memfile *prev_save)
+{
+    const struct level_save_cache *cache = &lev->save_cache;
+
+    return prev_save && lev != level && !cache->dirty &&
+        cache->serial && cache->serial == prev_save->save_serial &&
+        flags.save_encoding >= saveenc_levelrel &&
+        cache->encoding == flags.save_encoding &&
+        !lev->flags.purge_monsters &&
+        cache->start + cache->len <= prev_save->pos;
+}
+
+/* Writes a level (including its MTAG_LEVELS header) to mf, either by
+   serializing it or by copying the bytes it had in prev_save. The copy
+   replays the level's tags at the same offsets, so the resulting memfile
+   (tags included) is the same as if the level had been serialized. */
+static void
+savelev_or_copy(struct memfile *mf, xchar levnum,
+                const struct memfile *prev_save)
+{
+    struct level *lev = levels[levnum];
+    struct level_save_cache *cache = &lev->save_cache;
+    int tags_before = mf->ntags;
+    int start = mf->pos;
+
+    if (level_save_reusable(lev, prev_save)) {
+        const char *src = prev_save->buf + cache->start;
+        int i, done = 0;
+
+        for (i = 0; i < cache->ntags; i++) {
+            const struct level_save_tag *tag = &cache->tags[i];
+
+            if (tag->offset > done) {
+                mwrite(mf, src + done, tag->offset - done);
+                done = tag->offset;
+            }
+            mtag(mf, tag->tagdata, (enum memfile_tagtype)tag->tagtype);
+        }
+        if (cache->len > done)
+            mwrite(mf, src + done, cache->len - done);
+        if (cache->mon_coord_hint >= 0)
+            mf->mon_coord_hint = start + cache->mon_coord_hint;
+    } else {
+        mtag(mf, levnum, MTAG_LEVELS);
+        mwrite8(mf, levnum);    /* level number */
+        savelev(mf, levnum);    /* actual level */
+    }
+
+    record_level_save(mf, lev, start, tags_before);
+}
+
+/* Remembers where lev was just written to mf, for savelev_or_copy. */
+static void
+record_level_save(struct memfile *mf, struct level *lev, int start,
+                  int tags_before)
+{
+    struct level_save_cache *cache = &lev->save_cache;
+    int i;
+
+    cache->dirty = FALSE;
+    if (flags.save_encoding < saveenc_levelrel) {
+        cache->serial = 0;
+        return;
+    }
+
+    cache->serial = mf->save_serial;
+    cache->start = start;
+    cache->len = mf->pos - start;
+    cache->encoding = flags.save_encoding;
+    cache->mon_coord_hint = mf->mon_coord_hint >= start ?
+        mf->mon_coord_hint - start : -1;
+
+    cache->ntags = mf->ntags - tags_before;
+    if (cache->ntags > cache->maxtags) {
+        free(cache->tags);
+        cache->maxtags = cache->ntags * 2;
+        cache->tags = malloc(cache->maxtags * sizeof *cache->tags);
+    }
+
+    for (i = 0; i < cache->ntags; i++) {
+        const struct memfile_tag *tag = &mf->tags[tags_before + i];
+
+        cache->tags[i].tagdata = tag->tagdata;
+        cache->tags[i].tagtype = tag->tagtype;
+        cache->tags[i].offset = tag->pos - start;
+    }
+}
+
+
+static void
+free_level_save_cache(struct level *lev)
+{
+    free(lev->save_cache.tags);
+    lev->save_cache.tags = NULL;
+    lev->save_cache.ntags = lev->save_cache.maxtags = 0;
+    lev->save_cache.serial = 0;
+}
+
+
 /* WARNING: Do not use save encoding functions in this function; although they
    will work on save, the restore code couldn't handle them */
 static void
@@ -352,16 +475,10 @@ savegamestate(struct memfile *mf)
 }
 
 
-/* Note: when changing this function, you should also change the error handler
-   in load_gamestate_from_binary_save, so that it can correctly calculate
-   which location had the problem. It needs to know how many bytes there are
-   per location (currently 64 bits = 8 bytes). */
-static void
-save_location(struct memfile *mf, struct rm *loc)
+/* Packs the remembered-display fields of loc into 32 bits. */
+static unsigned int
+location_memflags(const struct rm *loc)
 {
-    unsigned int memflags;
-    unsigned short rflags;
-
     unsigned char bg = loc->mem_bg;
 
     /* pack mem_door_l, mem_door_t into mem_bg */
@@ -400,15 +517,61 @@ save_location(struct memfile *mf, struct rm *loc)
         break;
     }
 
-    memflags = (bg << 26) | (loc->mem_trap << 21) | (loc->mem_obj << 11) |
+    return (bg << 26) | (loc->mem_trap << 21) | (loc->mem_obj << 11) |
         (loc->mem_obj_mn << 2) | (loc->mem_invis << 1) |
         (loc->mem_stepped << 0);
-    rflags = (loc->flags << 11) | (loc->horizontal << 10) | (loc->lit << 9) |
+}
+
+/* Packs the remaining bitfields of loc into 16 bits. */
+static unsigned short
+location_rflags(const struct rm *loc)
+{
+    return (loc->flags << 11) | (loc->horizontal << 10) | (loc->lit << 9) |
         (loc->waslit << 8) | (loc->roomno << 2) | (loc->edge << 1);
-    mwrite32(mf, memflags);
-    mwrite8(mf, loc->typ);
-    mwrite8(mf, loc->seenv);
-    mwrite16(mf, rflags);
+}
+
+/* Note: when changing this function, you should also change the error handler
+   in mequal, so that it can correctly calculate which location had the
+   problem. It needs to know how many bytes there are per location (currently
+   64 bits = 8 bytes, or 5 + 3 bytes split across the two planes). */
+static void
+save_locations(struct memfile *mf, xchar levnum, struct level *lev)
+{
+    struct rm (*locs)[ROWNO] = lev->locations;
+    int x, y;
+
+    if (flags.save_encoding < saveenc_planar) {
+        mtag(mf, levnum, MTAG_LOCATIONS);
+        for (x = 0; x < COLNO; x++)
+            for (y = 0; y < ROWNO; y++) {
+                struct rm *loc = &locs[x][y];
+
+                mwrite32(mf, location_memflags(loc));
+                mwrite8(mf, loc->typ);
+                mwrite8(mf, loc->seenv);
+                mwrite16(mf, location_rflags(loc));
+            }
+        return;
+    }
+
+    /* Two runs, split by how often the fields change: the remembered display
+       changes whenever the player sees something new, but the terrain hardly
+       ever does, so a save diff can copy all of it in one stretch. (Splitting
+       further, a run per field, makes diffs larger, because exploration
+       changes several display fields of each location at once.) */
+    mtag(mf, levnum * LOCPLANE_COUNT + LOCPLANE_MEMORY, MTAG_LOCPLANE);
+    for (x = 0; x < COLNO; x++)                       /* savemap: ignore */
+        for (y = 0; y < ROWNO; y++) {                 /* savemap: ignore */
+            mwrite32(mf, location_memflags(&locs[x][y])); /* savemap: 66360 */
+            mwrite8(mf, locs[x][y].seenv);                /* savemap: ignore */
+        }
+
+    mtag(mf, levnum * LOCPLANE_COUNT + LOCPLANE_TERRAIN, MTAG_LOCPLANE);
+    for (x = 0; x < COLNO; x++)                       /* savemap: ignore */
+        for (y = 0; y < ROWNO; y++) {                 /* savemap: ignore */
+            mwrite8(mf, locs[x][y].typ);                  /* savemap: 39816 */
+            mwrite16(mf, location_rflags(&locs[x][y]));   /* savemap: ignore */
+        }
 }
 
 static void
@@ -669,7 +832,6 @@ save_coords(struct memfile *mf, const coord *c, int n)
 void
 savelev(struct memfile *mf, xchar levnum)
 {
-    int x, y;
     unsigned int lflags;
     struct level *lev = levels[levnum];
 
@@ -689,10 +851,7 @@ savelev(struct memfile *mf, xchar levnum)
     mwrite8(mf, lev->z.dlevel);
     mwrite(mf, lev->levname, sizeof (lev->levname));
 
-    mtag(mf, levnum, MTAG_LOCATIONS);
-    for (x = 0; x < COLNO; x++)                       /* savemap: ignore */
-        for (y = 0; y < ROWNO; y++)                   /* savemap: ignore */
-            save_location(mf, &lev->locations[x][y]); /* savemap: 106176 */
+    save_locations(mf, levnum, lev);
 
     mwrite32(mf, lev->lastmoves);
 
@@ -752,6 +911,7 @@ freelev(xchar levnum)
 
     lev->monlist = NULL;
     lev->lev_traps = NULL;
+    memset(lev->traps, 0, sizeof lev->traps);
     lev->objlist = NULL;
     lev->buriedobjlist = NULL;
     lev->billobjs = NULL;
@@ -759,6 +919,8 @@ freelev(xchar levnum)
     free_engravings(lev);
     freedamage(lev);
     free_regions(lev);
+    free_level_save_cache(lev);
+    mon_index_free(&lev->monindex);
 
     free(lev);
     levels[levnum] = NULL;
@@ -846,6 +1008,7 @@ free_objchn(struct obj *otmp)
         turnstate.floating_objects = otmp;
         otmp->timed = 0;        /* not timed any more */
         otmp->lamplit = 0;      /* caller handled lights */
+        otmp->olev = NULL;      /* may already be freed; don't mark it dirty */
         dealloc_obj(otmp);
         otmp = otmp2;
     }
@@ -1029,6 +1192,8 @@ freedynamicdata(void)
         free_objchn(lev->billobjs);
         free_engravings(lev);
         freedamage(lev);
+        free_level_save_cache(lev);
+        mon_index_free(&lev->monindex);
 
         free(lev);
     }
@@ -1037,6 +1202,7 @@ freedynamicdata(void)
     free_objchn(invent);
     free_objchn(magic_chest_objs);
     free_monchn(migrating_mons);
+    mon_index_free(migrating_mon_index());
     /* this should normally be NULL between turns, but might not be due to
        the game ending where pets can follow (e.g. ascension or dungeon escape)
        or due to panicing. */
@@ -1060,6 +1226,8 @@ freedynamicdata(void)
         flags.ap_rules = NULL;
     }
 
+    free_oid_index();
+
     free(artilist);
     free(objects);
     objects = NULL;
@@ -57,7 +57,6 @@ static void dropped_container(struct obj *, struct monst *, boolean);
 static void add_to_billobjs(struct obj *);
 static void bill_box_content(struct obj *, boolean, boolean, struct monst *);
 static boolean rob_shop(struct monst *);
-static struct obj *find_oid_lev(struct level *lev, unsigned id);
 static const char *cad(void);
 
 #define muteshk(shkp)   ((shkp)->msleeping || !(shkp)->mcanmove || \
@@ -175,6 +174,7 @@ shkgone(struct monst *mtmp)
 
     remove_damage(mtmp, TRUE);
     sroom->resident = NULL;
+    mark_level_dirty(shoplev);
 
     /* items on shop floor revert to ordinary objects */
     for (sx = sroom->lx; sx <= sroom->hx; sx++)
@@ -1830,61 +1830,43 @@ bp_to_obj(struct bill_x *bp)
 }
 
 
-static struct obj *
-find_oid_lev(struct level *lev, unsigned id)
-{
-    struct obj *obj;
-    struct monst *mon;
-
-    if ((obj = o_on(id, lev->objlist)) != 0)
-        return obj;
-    if ((obj = o_on(id, lev->buriedobjlist)) != 0)
-        return obj;
-
-    for (mon = lev->monlist; mon; mon = mon->nmon)
-        if ((obj = o_on(id, mon->minvent)) != 0)
-            return obj;
-
-    return NULL;
-}
-
 /*
  * Look for o_id on all lists but billobj.  Return obj or NULL if not found.
  * It's OK for restore_timers() to call this function, there should not
  * be any timeouts on the billobjs chain.
+ *
+ * The object is found via the ID index (see newobj()); this only has to
+ * decide whether it's somewhere that we would have searched.  Objects on the
+ * current level take priority, as they did when the lists were searched
+ * directly.
  */
 struct obj *
 find_oid(unsigned id)
 {
-    struct obj *obj;
-    struct monst *mon;
-    int i;
-
-    /* try searching the current level, if any */
-    if (level && (obj = find_oid_lev(level, id)))
-        return obj;
-
-    /* first check various obj lists directly */
-    if ((obj = o_on(id, invent)))
-        return obj;
-    if ((obj = o_on(id, magic_chest_objs)))
-        return obj;
-
-    /* not found yet; check inventory for members of various monst lists */
-    for (mon = migrating_mons; mon; mon = mon->nmon)
-        if ((obj = o_on(id, mon->minvent)))
-            return obj;
-    for (mon = turnstate.migrating_pets; mon; mon = mon->nmon)
-        if ((obj = o_on(id, mon->minvent)))
-            return obj;
+    struct obj *obj, *top, *found = NULL;
+    unsigned cursor = 0;
+
+    while ((obj = oid_index_find(id, &cursor))) {
+        for (top = obj; top->where == OBJ_CONTAINED; top = top->ocontainer)
+            ;
+        switch (top->where) {
+        case OBJ_FLOOR:
+        case OBJ_BURIED:
+        case OBJ_INVENT:
+        case OBJ_MINVENT:
+        case OBJ_MAGIC_CHEST:
+            break;
+        default:
+            continue;   /* free, billed, or migrating */
+        }
 
-    /* search all levels */
-    for (i = 0; i <= maxledgerno(); i++)
-        if (levels[i] && (obj = find_oid_lev(levels[i], id)))
+        if (level && obj->olev == level)
             return obj;
+        if (!found)
+            found = obj;
+    }
 
-    /* not found at all */
-    return NULL;
+    return found;
 }
 
 
@@ -2472,7 +2454,8 @@ sub_one_frombill(struct obj *obj, struct monst *shkp)
         obj->unpaid = 0;
         if (bp->bquan > obj->quan) {
             otmp = newobj(0, obj);
-            bp->bo_id = otmp->o_id = next_ident();
+            set_obj_id(otmp, next_ident());
+            bp->bo_id = otmp->o_id;
             otmp->quan = (bp->bquan -= obj->quan);
             otmp->owt = 0;      /* superfluous */
             otmp->onamelth = 0;
@@ -3106,6 +3089,7 @@ remove_damage(struct monst *shkp, boolean croaked)
     uchar saw_walls = 0;
     struct level *lev = levels[ledger_no(&ESHK(shkp)->shoplevel)];
 
+    mark_level_dirty(lev);
     tmp_dam = lev->damagelist;
     tmp2_dam = 0;
     while (tmp_dam) {
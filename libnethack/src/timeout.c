@@ -1262,15 +1262,26 @@ do_storms(void)
  */
 
 static const char *kind_name(short);
-static void print_queue(struct nh_menulist *menu, timer_element *);
+static void print_queue(struct nh_menulist *menu, struct timer_queue *);
+static boolean timer_before(const timer_element *, const timer_element *);
+static int timer_order(const void *, const void *);
+static void heap_move(struct timer_queue *, timer_element *, unsigned);
+static void heap_fix(struct timer_queue *, unsigned);
+static unsigned byarg_slot(const struct timer_queue *, const void *);
+static void byarg_add(struct timer_queue *, timer_element *);
+static void byarg_remove(struct timer_queue *, timer_element *);
+static int timers_with_arg(struct timer_queue *, const void *,
+                           timer_element **, int);
+static timer_element **timers_in_order(struct timer_queue *);
 static void insert_timer(struct level *lev, timer_element * gnu);
-static timer_element *remove_timer(timer_element **, short, void *);
-static timer_element *peek_timer(timer_element **, short, const void *);
+static void unlink_timer(struct level *lev, timer_element *);
+static void set_timer_arg(struct level *lev, timer_element *, void *);
+static timer_element *find_timer(struct timer_queue *, short, const void *);
 static void write_timer(struct memfile *mf, timer_element *);
 static boolean mon_is_local(struct monst *);
 static boolean timer_is_local(timer_element *);
-static int maybe_write_timer(struct memfile *mf, struct level *lev, int range,
-                             boolean write_it);
+static int maybe_write_timer(struct memfile *mf, timer_element **, int count,
+                             int range, boolean write_it);
 
 typedef struct {
     timeout_proc f, cleanup;
@@ -1306,20 +1317,24 @@ kind_name(short kind)
 }
 
 static void
-print_queue(struct nh_menulist *menu, timer_element * base)
+print_queue(struct nh_menulist *menu, struct timer_queue *queue)
 {
-    timer_element *curr;
+    timer_element *curr, **sorted;
+    unsigned i;
 
-    if (!base) {
+    if (!queue->count) {
         add_menutext(menu, "<empty>");
     } else {
         add_menutext(menu, "timeout\tid\tkind\tcall");
-        for (curr = base; curr; curr = curr->next) {
+        sorted = timers_in_order(queue);
+        for (i = 0; i < queue->count; i++) {
+            curr = sorted[i];
             add_menutext(menu, msgprintf(
                              " %4u\t%4u\t%-6s #%d\t%s(%p)", curr->timeout,
                              curr->tid, kind_name(curr->kind), curr->func_index,
                              timeout_funcs[curr->func_index].name, curr->arg));
         }
+        free(sorted);
     }
 }
 
@@ -1336,7 +1351,7 @@ wiz_timeout_queue(const struct nh_cmd_arg *arg)
     add_menutext(&menu, "");
     add_menutext(&menu, "Active timeout queue:");
     add_menutext(&menu, "");
-    print_queue(&menu, level->lev_timers);
+    print_queue(&menu, &level->lev_timers);
 
     display_menu(&menu, NULL, PICK_NONE, PLHINT_ANYWHERE, NULL);
 
@@ -1355,12 +1370,13 @@ run_timers(void)
 
     /*
      * Always use the first element.  Elements may be added or deleted at
-     * any time.  The list is ordered, we are done when the first element
+     * any time.  The queue is ordered, we are done when the first element
      * is in the future.
      */
-    while (level->lev_timers && level->lev_timers->timeout <= moves) {
-        curr = level->lev_timers;
-        level->lev_timers = curr->next;
+    while (level->lev_timers.count &&
+           level->lev_timers.heap[0]->timeout <= moves) {
+        curr = level->lev_timers.heap[0];
+        unlink_timer(level, curr);
 
         if (curr->kind == TIMER_OBJECT)
             ((struct obj *)(curr->arg))->timed--;
@@ -1384,7 +1400,6 @@ start_timer(struct level *lev, long when, short kind, short func_index,
 
     gnu = malloc(sizeof (timer_element));
     memset(gnu, 0, sizeof (timer_element));
-    gnu->next = NULL;
     gnu->tid = timer_id++;
     gnu->timeout = moves + when;
     gnu->kind = kind;
@@ -1411,9 +1426,10 @@ stop_timer(struct level *lev, short func_index, void *arg)
     timer_element *doomed;
     long timeout;
 
-    doomed = remove_timer(&lev->lev_timers, func_index, arg);
+    doomed = find_timer(&lev->lev_timers, func_index, arg);
 
     if (doomed) {
+        unlink_timer(lev, doomed);
         timeout = doomed->timeout;
         if (doomed->kind == TIMER_OBJECT)
             ((struct obj *)arg)->timed--;
@@ -1434,7 +1450,7 @@ report_timer(struct level *lev, short func_index, const void *arg)
 {
     timer_element *checking;
 
-    checking = peek_timer(&lev->lev_timers, func_index, arg);
+    checking = find_timer(&lev->lev_timers, func_index, arg);
 
     if (checking) {
         return checking->timeout;
@@ -1449,12 +1465,15 @@ report_timer(struct level *lev, short func_index, const void *arg)
 void
 obj_move_timers(struct obj *src, struct obj *dest)
 {
-    int count;
-    timer_element *curr;
-
-    for (count = 0, curr = src->olev->lev_timers; curr; curr = curr->next)
-        if (curr->kind == TIMER_OBJECT && curr->arg == src) {
-            curr->arg = dest;
+    int count, i, found;
+    timer_element *timers[src->timed + 1];
+
+    mark_level_dirty(src->olev);
+    found = timers_with_arg(&src->olev->lev_timers, src, timers,
+                            src->timed + 1);
+    for (count = 0, i = 0; i < found; i++)
+        if (timers[i]->kind == TIMER_OBJECT) {
+            set_timer_arg(src->olev, timers[i], dest);
             dest->timed++;
             count++;
         }
@@ -1470,15 +1489,16 @@ obj_move_timers(struct obj *src, struct obj *dest)
 void
 obj_split_timers(struct obj *src, struct obj *dest)
 {
-    timer_element *curr, *next_timer = 0;
-
-    for (curr = src->olev->lev_timers; curr; curr = next_timer) {
-        next_timer = curr->next;        /* things may be inserted */
-        if (curr->kind == TIMER_OBJECT && curr->arg == src) {
-            start_timer(dest->olev, curr->timeout - moves, TIMER_OBJECT,
-                        curr->func_index, dest);
-        }
-    }
+    timer_element *timers[src->timed + 1];
+    int found, i;
+
+    /* Look them all up first, because starting timers changes the queue. */
+    found = timers_with_arg(&src->olev->lev_timers, src, timers,
+                            src->timed + 1);
+    for (i = 0; i < found; i++)
+        if (timers[i]->kind == TIMER_OBJECT)
+            start_timer(dest->olev, timers[i]->timeout - moves, TIMER_OBJECT,
+                        timers[i]->func_index, dest);
 }
 
 
@@ -1489,79 +1509,282 @@ obj_split_timers(struct obj *src, struct obj *dest)
 void
 obj_stop_timers(struct obj *obj)
 {
-    timer_element *curr, *prev, *next_timer = 0;
-
-    for (prev = 0, curr = obj->olev->lev_timers; curr; curr = next_timer) {
-        next_timer = curr->next;
-        if (curr->kind == TIMER_OBJECT && curr->arg == obj) {
-            if (prev)
-                prev->next = curr->next;
-            else
-                obj->olev->lev_timers = curr->next;
+    timer_element *curr, *timers[obj->timed + 1];
+    int found, i;
+
+    mark_level_dirty(obj->olev);
+    found = timers_with_arg(&obj->olev->lev_timers, obj, timers,
+                            obj->timed + 1);
+    for (i = 0; i < found; i++) {
+        curr = timers[i];
+        if (curr->kind == TIMER_OBJECT) {
+            unlink_timer(obj->olev, curr);
             if (timeout_funcs[curr->func_index].cleanup)
                 (*timeout_funcs[curr->func_index].cleanup)(
                     curr->arg, curr->timeout);
             free(curr);
-        } else {
-            prev = curr;
         }
     }
     obj->timed = 0;
 }
 
 
-/* Insert timer into the global queue */
+/*
+ * The timer queue.
+ *
+ * Timers are kept in a binary min-heap (queue->heap), so that the next timer
+ * to go off can be found at once, and adding or removing a timer is
+ * O(log n). The order is the one the timer list used to be sorted in: by
+ * timeout, and among timers with the same timeout, most recently added
+ * first. save_timers() writes timers in that order, and restore_timers()
+ * adds them back so that it's reproduced, which keeps the save file
+ * stable.
+ *
+ * Most timers are looked up by their arg (usually an object), so each
+ * queue also has a hash table of its timers keyed on arg. That uses open
+ * addressing with linear probing, and naturally allows several timers to
+ * share an arg.
+ */
+#define TIMER_QUEUE_MIN_SIZE 16 /* must be a power of 2 */
+
+/* Does "a" go off before "b"? */
+static boolean
+timer_before(const timer_element *a, const timer_element *b)
+{
+    if (a->timeout != b->timeout)
+        return a->timeout < b->timeout;
+    return a->seq > b->seq;
+}
+
+/* qsort comparator for timer_element *, using timer_before */
+static int
+timer_order(const void *a, const void *b)
+{
+    const timer_element *ta = *(const timer_element *const *)a;
+    const timer_element *tb = *(const timer_element *const *)b;
+
+    return timer_before(ta, tb) ? -1 : timer_before(tb, ta) ? 1 : 0;
+}
+
 static void
-insert_timer(struct level *lev, timer_element * gnu)
+heap_move(struct timer_queue *queue, timer_element *timer, unsigned pos)
 {
-    timer_element *curr, *prev;
-
-    for (prev = 0, curr = lev->lev_timers; curr; prev = curr, curr = curr->next)
-        /* For most purposes, > vs. >= has little effect. Using >=, however,
-           ensures that we load timers in the same order as when they were saved
-           to a file, which avoids desyncing the save. (We used to use > for
-           the same reason, but timers are now loaded in reverse order in order
-           to avoid a performance bottleneck.) */
-        if (curr->timeout >= gnu->timeout)
+    queue->heap[pos] = timer;
+    timer->heap_pos = pos;
+}
+
+/* Restores the heap property around the given position, whose timer may
+   be out of place in either direction. */
+static void
+heap_fix(struct timer_queue *queue, unsigned pos)
+{
+    timer_element *timer = queue->heap[pos];
+    unsigned child;
+
+    while (pos > 0 && timer_before(timer, queue->heap[(pos - 1) / 2])) {
+        heap_move(queue, queue->heap[(pos - 1) / 2], pos);
+        pos = (pos - 1) / 2;
+    }
+
+    while ((child = pos * 2 + 1) < queue->count) {
+        if (child + 1 < queue->count &&
+            timer_before(queue->heap[child + 1], queue->heap[child]))
+            child++;
+        if (!timer_before(queue->heap[child], timer))
             break;
+        heap_move(queue, queue->heap[child], pos);
+        pos = child;
+    }
 
-    gnu->next = curr;
-    if (prev)
-        prev->next = gnu;
-    else
-        lev->lev_timers = gnu;
+    heap_move(queue, timer, pos);
 }
 
+static unsigned
+byarg_slot(const struct timer_queue *queue, const void *arg)
+{
+    uintptr_t key = (uintptr_t) arg;
 
-static timer_element *
-remove_timer(timer_element ** base, short func_index, void *arg)
+    /* args are pointers (with low bits often 0) or small integers */
+    key ^= key >> 17;
+    return ((unsigned)key * 2654435761U) & (queue->byarg_size - 1);
+}
+
+static void
+byarg_add(struct timer_queue *queue, timer_element *timer)
 {
-    timer_element *prev, *curr;
+    unsigned i;
+
+    /* queue->count already includes the new timer */
+    if (queue->count * 2 > queue->byarg_size) {
+        timer_element **old = queue->byarg;
+        unsigned old_size = queue->byarg_size;
+
+        queue->byarg_size =
+            old_size ? old_size * 2 : TIMER_QUEUE_MIN_SIZE;
+        queue->byarg = malloc(queue->byarg_size * sizeof *queue->byarg);
+        memset(queue->byarg, 0, queue->byarg_size * sizeof *queue->byarg);
+
+        for (i = 0; i < old_size; i++) {
+            if (old[i]) {
+                unsigned j;
+
+                for (j = byarg_slot(queue, old[i]->arg); queue->byarg[j];
+                     j = (j + 1) & (queue->byarg_size - 1))
+                    ;
+                queue->byarg[j] = old[i];
+            }
+        }
+        free(old);
+    }
 
-    for (prev = 0, curr = *base; curr; prev = curr, curr = curr->next)
-        if (curr->func_index == func_index && curr->arg == arg)
-            break;
+    for (i = byarg_slot(queue, timer->arg); queue->byarg[i];
+         i = (i + 1) & (queue->byarg_size - 1))
+        ;
+    queue->byarg[i] = timer;
+}
 
-    if (curr) {
-        if (prev)
-            prev->next = curr->next;
-        else
-            *base = curr->next;
+static void
+byarg_remove(struct timer_queue *queue, timer_element *timer)
+{
+    unsigned i, j, home, mask = queue->byarg_size - 1;
+
+    for (i = byarg_slot(queue, timer->arg); queue->byarg[i] != timer;
+         i = (i + 1) & mask)
+        if (!queue->byarg[i])
+            panic("timer missing from its queue's hash table");
+
+    /* Close the gap, by moving back any later entry in the same run that
+       would no longer be reachable from its home slot. */
+    for (j = (i + 1) & mask; queue->byarg[j]; j = (j + 1) & mask) {
+        home = byarg_slot(queue, queue->byarg[j]->arg);
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            queue->byarg[i] = queue->byarg[j];
+            i = j;
+        }
+    }
+    queue->byarg[i] = NULL;
+}
+
+/* Fills "out" with the timers that have the given arg, in the order they'll
+   go off, and returns how many there are. At most "max" are returned. */
+static int
+timers_with_arg(struct timer_queue *queue, const void *arg,
+                timer_element **out, int max)
+{
+    unsigned i;
+    int found = 0;
+
+    if (!queue->byarg_size)
+        return 0;
+
+    for (i = byarg_slot(queue, arg); queue->byarg[i] && found < max;
+         i = (i + 1) & (queue->byarg_size - 1))
+        if (queue->byarg[i]->arg == arg)
+            out[found++] = queue->byarg[i];
+
+    qsort(out, found, sizeof *out, timer_order);
+    return found;
+}
+
+/* Returns a newly allocated array of all the queue's timers, in the order
+   they'll go off. */
+static timer_element **
+timers_in_order(struct timer_queue *queue)
+{
+    timer_element **sorted = malloc((queue->count + 1) * sizeof *sorted);
+
+    if (queue->count)
+        memcpy(sorted, queue->heap, queue->count * sizeof *sorted);
+    qsort(sorted, queue->count, sizeof *sorted, timer_order);
+    return sorted;
+}
+
+/* Insert timer into the level's queue */
+static void
+insert_timer(struct level *lev, timer_element * gnu)
+{
+    struct timer_queue *queue = &lev->lev_timers;
+
+    mark_level_dirty(lev);
+
+    if (queue->count == queue->size) {
+        queue->size = queue->size ? queue->size * 2 : TIMER_QUEUE_MIN_SIZE;
+        queue->heap = realloc(queue->heap, queue->size * sizeof *queue->heap);
     }
 
-    return curr;
+    /* For most purposes, the order of timers with the same timeout has
+       little effect. However, it has to be consistent, so that timers are
+       loaded in the same order as when they were saved to a file, which
+       avoids desyncing the save. */
+    gnu->seq = queue->seq++;
+    queue->count++;
+    heap_move(queue, gnu, queue->count - 1);
+    heap_fix(queue, queue->count - 1);
+    byarg_add(queue, gnu);
+}
+
+/* Remove a timer from the level's queue, without freeing it */
+static void
+unlink_timer(struct level *lev, timer_element *timer)
+{
+    struct timer_queue *queue = &lev->lev_timers;
+    unsigned pos = timer->heap_pos;
+
+    mark_level_dirty(lev);
+    byarg_remove(queue, timer);
+
+    queue->count--;
+    if (pos != queue->count) {
+        heap_move(queue, queue->heap[queue->count], pos);
+        heap_fix(queue, pos);
+    }
+}
+
+/* Change what a queued timer applies to */
+static void
+set_timer_arg(struct level *lev, timer_element *timer, void *arg)
+{
+    byarg_remove(&lev->lev_timers, timer);
+    timer->arg = arg;
+    byarg_add(&lev->lev_timers, timer);
 }
 
+/* Find the first timer to go off with the given function and arg */
 static timer_element *
-peek_timer(timer_element ** base, short func_index, const void *arg)
+find_timer(struct timer_queue *queue, short func_index, const void *arg)
 {
-    timer_element *curr;
+    timer_element *best = NULL, *curr;
+    unsigned i;
 
-    for (curr = *base; curr; curr = curr->next)
-        if (curr->func_index == func_index && curr->arg == arg)
-            break;
+    if (!queue->byarg_size)
+        return NULL;
 
-    return curr;
+    for (i = byarg_slot(queue, arg); (curr = queue->byarg[i]);
+         i = (i + 1) & (queue->byarg_size - 1))
+        if (curr->func_index == func_index && curr->arg == arg &&
+            (!best || timer_before(curr, best)))
+            best = curr;
+
+    return best;
+}
+
+/* Returns how many timers on the level apply to the given arg. */
+int
+count_timers_with_arg(struct level *lev, const void *arg)
+{
+    struct timer_queue *queue = &lev->lev_timers;
+    unsigned i;
+    int count = 0;
+
+    if (!queue->byarg_size)
+        return 0;
+
+    for (i = byarg_slot(queue, arg); queue->byarg[i];
+         i = (i + 1) & (queue->byarg_size - 1))
+        if (queue->byarg[i]->arg == arg)
+            count++;
+
+    return count;
 }
 
 static void
@@ -1671,13 +1894,14 @@ timer_is_local(timer_element * timer)
  * be written.  If write_it is true, actually write the timer.
  */
 static int
-maybe_write_timer(struct memfile *mf, struct level *lev, int range,
-                  boolean write_it)
+maybe_write_timer(struct memfile *mf, timer_element **timers, int ntimers,
+                  int range, boolean write_it)
 {
-    int count = 0;
+    int count = 0, i;
     timer_element *curr;
 
-    for (curr = lev->lev_timers; curr; curr = curr->next) {
+    for (i = 0; i < ntimers; i++) {
+        curr = timers[i];
         if (range == RANGE_GLOBAL) {
             /* global timers */
 
@@ -1707,31 +1931,48 @@ void
 transfer_timers(struct level *oldlev, struct level *newlev,
                 unsigned int obj_id)
 {
-    timer_element *curr, *prev = NULL, *next_timer = NULL;
+    timer_element *curr, **timers;
+    int count = 0, i;
 
     if (newlev == oldlev)
         return;
     if (newlev == NULL || oldlev == NULL)
         panic("Attempting to transfer timers to/from NULL");
 
-    for (curr = oldlev->lev_timers; curr; curr = next_timer) {
-        next_timer = curr->next;        /* in case curr is removed */
+    mark_level_dirty(oldlev);
+    if (!oldlev->lev_timers.count)
+        return;
 
-	/* transfer global timers or timers of requested object */
-	if ((!obj_id && !timer_is_local(curr)) ||
-	    (obj_id && curr->kind == TIMER_OBJECT &&
-	     ((struct obj *)curr->arg)->o_id == obj_id)) {
-            if (prev)
-                prev->next = curr->next;
-            else
-                oldlev->lev_timers = curr->next;
+    /* Collect the timers to move, in the order they'll go off (which is the
+       order they'll be added to newlev). */
+    timers = malloc(oldlev->lev_timers.count * sizeof *timers);
+    if (obj_id) {
+        /* transfer timers of the requested object */
+        struct obj *obj;
+        unsigned cursor = 0;
+
+        while ((obj = oid_index_find(obj_id, &cursor)))
+            count += timers_with_arg(&oldlev->lev_timers, obj, timers + count,
+                                     oldlev->lev_timers.count - count);
+        qsort(timers, count, sizeof *timers, timer_order);
+    } else {
+        /* transfer global timers */
+        timer_element **sorted = timers_in_order(&oldlev->lev_timers);
 
-            insert_timer(newlev, curr);
-            /* prev stays the same */
-        } else {
-            prev = curr;
-        }
+        for (i = 0; i < (int)oldlev->lev_timers.count; i++)
+            if (!timer_is_local(sorted[i]))
+                timers[count++] = sorted[i];
+        free(sorted);
     }
+
+    for (i = 0; i < count; i++) {
+        curr = timers[i];
+        if (obj_id && curr->kind != TIMER_OBJECT)
+            continue;
+        unlink_timer(oldlev, curr);
+        insert_timer(newlev, curr);
+    }
+    free(timers);
 }
 
 
@@ -1752,27 +1993,30 @@ void
 save_timers(struct memfile *mf, struct level *lev, int range)
 {
     int count;
+    timer_element **sorted = timers_in_order(&lev->lev_timers);
 
     mtag(mf, 2 * (int)ledger_no(&lev->z) + range, MTAG_TIMERS);
     if (range == RANGE_GLOBAL)
         mwrite32(mf, timer_id);
 
-    count = maybe_write_timer(mf, lev, range, FALSE);
+    count = maybe_write_timer(mf, sorted, lev->lev_timers.count, range, FALSE);
     mwrite32(mf, count);
-    maybe_write_timer(mf, lev, range, TRUE);
+    maybe_write_timer(mf, sorted, lev->lev_timers.count, range, TRUE);
+    free(sorted);
 }
 
 
 void
 free_timers(struct level *lev)
 {
-    timer_element *curr, *next = NULL;
-
-    for (curr = lev->lev_timers; curr; curr = next) {
-        next = curr->next;
-        free(curr);
-    }
-    lev->lev_timers = NULL;
+    struct timer_queue *queue = &lev->lev_timers;
+    unsigned i;
+
+    for (i = 0; i < queue->count; i++)
+        free(queue->heap[i]);
+    free(queue->heap);
+    free(queue->byarg);
+    memset(queue, 0, sizeof *queue);
 }
 
 
@@ -1814,16 +2058,12 @@ restore_timers(struct memfile *mf, struct level *lev, int range,
         if (ghostly)
             curr->timeout += adjust;
 
-        /* The code here previously did `insert_timer(lev, curr);`. This is
-           correct in terms of code effect. However, because the timer list
-           is a linked list, and it's output front to back, and because the
-           list of timers must be maintained in order, that had quadratic
-           performance. Worse, during pudding farming, a /lot/ of timers are
-           generated (one for each pudding corpse).
-
-           Instead, we store the timers into an array temporarily, then add them
-           in the opposite order, making the performance linear rather than
-           quadratic. */
+        /* Timers are saved in the order they'll go off. Of timers with the
+           same timeout, the one added last goes off first, so we add them
+           back in the opposite order to reproduce the saved order. (This
+           also used to avoid quadratic performance back when the queue was
+           a sorted linked list; during pudding farming, a /lot/ of timers
+           are generated, one for each pudding corpse.) */
         temp_timers[i] = curr;
     }
     for (i = 0; i < count; i++)
@@ -1836,9 +2076,11 @@ void
 relink_timers(boolean ghostly, struct level *lev, struct trietable **table)
 {
     timer_element *curr;
-    unsigned nid;
+    unsigned nid, i;
+    void *arg;
 
-    for (curr = lev->lev_timers; curr; curr = curr->next) {
+    for (i = 0; i < lev->lev_timers.count; i++) {
+        curr = lev->lev_timers.heap[i];
         if (curr->needs_fixup) {
             if (curr->kind == TIMER_OBJECT) {
                 if (ghostly) {
@@ -1861,13 +2103,14 @@ relink_timers(boolean ghostly, struct level *lev, struct trietable **table)
                    to loop over all the objects on the level to find the one
                    they were applying to. That was quadratic performance, and
                    not irrelevantly so either.) */
-                curr->arg = NULL;
+                arg = NULL;
                 if (table)
-                    curr->arg = trietable_find(table, nid);
-                if (!curr->arg)
-                    curr->arg = find_oid(nid);
-                if (!curr->arg)
+                    arg = trietable_find(table, nid);
+                if (!arg)
+                    arg = find_oid(nid);
+                if (!arg)
                     panic("cant find o_id %d", nid);
+                set_timer_arg(lev, curr, arg);
                 curr->needs_fixup = 0;
             } else
                 panic("relink_timers 2");
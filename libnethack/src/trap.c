@@ -317,6 +317,7 @@ maketrap(struct level *lev, int x, int y, int typ, enum rng rng)
     struct rm *loc;
     boolean oldplace;
 
+    mark_level_dirty(lev);
     if ((ttmp = t_at(lev, x, y)) != 0) {
         if (ttmp->ttyp == MAGIC_PORTAL)
             return NULL;
@@ -412,6 +413,7 @@ maketrap(struct level *lev, int x, int y, int typ, enum rng rng)
     if (!oldplace) {
         ttmp->ntrap = lev->lev_traps;
         lev->lev_traps = ttmp;
+        lev->traps[x][y] = ttmp;
     }
     return ttmp;
 }
@@ -3017,16 +3019,14 @@ dofiretrap(struct obj *box)
             if (tt) {
                 xbak = tt->tx;
                 ybak = tt->ty;
-                tt->tx = tt->ty = 0;
+                move_trap(level, tt, 0, 0);
             } else {
                 impossible("dofiretrap: no tt and no box?");
             }
         }
         melt_ice(lev, u.ux, u.uy);
-        if (tt) {
-            tt->tx = xbak;
-            tt->ty = ybak;
-        }
+        if (tt)
+            move_trap(level, tt, xbak, ybak);
     }
 }
 
@@ -4539,14 +4539,37 @@ chest_trap(struct obj *obj, int bodypart, boolean disarm)
 struct trap *
 t_at(struct level *lev, int x, int y)
 {
-    struct trap *trap = lev->lev_traps;
+    if (!isok(x, y))
+        return NULL;
+    return lev->traps[x][y];
+}
 
-    while (trap) {
-        if (trap->tx == x && trap->ty == y)
-            return trap;
-        trap = trap->ntrap;
-    }
-    return NULL;
+
+/* Change the location of a trap that's on lev->lev_traps. Always use this
+   rather than setting tx and ty directly, to keep lev->traps up to date. */
+void
+move_trap(struct level *lev, struct trap *trap, int x, int y)
+{
+    /* another trap may already have been moved onto the old location, e.g.
+       when a bubble on the Plane of Water moves several traps */
+    if (lev->traps[trap->tx][trap->ty] == trap)
+        lev->traps[trap->tx][trap->ty] = NULL;
+    trap->tx = x;
+    trap->ty = y;
+    lev->traps[x][y] = trap;
+}
+
+
+/* Rebuild lev->traps from lev->lev_traps (e.g. after restoring a level). */
+void
+index_traps(struct level *lev)
+{
+    struct trap *trap;
+
+    memset(lev->traps, 0, sizeof lev->traps);
+    for (trap = lev->lev_traps; trap; trap = trap->ntrap)
+        if (!lev->traps[trap->tx][trap->ty])    /* t_at used to find the first */
+            lev->traps[trap->tx][trap->ty] = trap;
 }
 
 
@@ -4555,6 +4578,7 @@ deltrap(struct level *lev, struct trap *trap)
 {
     struct trap *ttmp;
 
+    mark_level_dirty(lev);
     if (trap == lev->lev_traps)
         lev->lev_traps = lev->lev_traps->ntrap;
     else {
@@ -4562,6 +4586,8 @@ deltrap(struct level *lev, struct trap *trap)
             ;
         ttmp->ntrap = trap->ntrap;
     }
+    if (lev->traps[trap->tx][trap->ty] == trap)
+        lev->traps[trap->tx][trap->ty] = NULL;
     dealloc_trap(trap);
 }
 
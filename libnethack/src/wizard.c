@@ -813,6 +813,7 @@ resurrect(void)
                     mtmp->mfrozen = 0, mtmp->mcanmove = 1;
                 if (mtmp->mcanmove && !mtmp->msleeping) {
                     *mmtmp = mtmp->nmon;
+                    mon_index_remove(migrating_mon_index(), mtmp);
                     mon_arrive(mtmp, TRUE);
                     /* note: there might be a second Wizard; if so, he'll have
                        to wait til the next resurrection */
@@ -431,10 +431,13 @@ see_wsegs(struct monst *worm)
 
 /*  if (!mtmp->wormno) return;  bullet proofing */
 
+    /* each newsym asks whether the whole worm can be sensed */
+    msensem_memo_begin();
     while (curr != level->wheads[worm->wormno]) {
         newsym(curr->wx, curr->wy);
         curr = curr->nseg;
     }
+    msensem_memo_end();
 }
 
 /*
@@ -40,20 +40,162 @@ find_extrinsic(struct obj *chain, int extrinsic, int *warntype,
     return mask;
 }
 
+/* Property checks happen thousands of times a turn, and each would otherwise
+   scan the whole inventory twice (once for the extrinsic, once to see if it's
+   blocked). So the results of the scan are cached, per property, for a few
+   recently checked monsters and for the player.
+
+   The things the scan depends on (which objects are in the chain, and their
+   types, artifact status, dragon scales and worn slots) are changed directly
+   in many places around the code, so rather than trying to invalidate the
+   cache in all of them, a cache entry records a signature of the chain that
+   it was calculated from, and is discarded if the chain's signature is now
+   different. Calculating the signature is much cheaper than the scans.
+
+   If the NH4PROPCHECK environment variable is set, every cached result is
+   compared against a fresh scan, and mismatches are reported via impossible().
+   This is for debugging only, as it makes the cache slower than no cache. */
+#define EXTRINSIC_CACHE_MONS 64         /* must be a power of 2 */
+#define PROP_BITMAP_SIZE ((LAST_PROP + 8) / 8)
+
+struct extrinsic_cache {
+    const struct monst *mon;
+    unsigned long long signature;
+    unsigned char known[PROP_BITMAP_SIZE];      /* which props are cached */
+    unsigned char blocked[PROP_BITMAP_SIZE];    /* blocked by an item */
+    long extrinsic[LAST_PROP + 1];      /* ignoring blocking */
+};
+
+static struct extrinsic_cache extrinsic_cache_you;
+static struct extrinsic_cache extrinsic_cache_mons[EXTRINSIC_CACHE_MONS];
+static boolean extrinsic_cache_check = FALSE;
+
+/* Called at the start of each game. */
+void
+extrinsic_cache_init(void)
+{
+    const char *check = nh_getenv("NH4PROPCHECK");
+
+    extrinsic_cache_check = check && *check;
+    memset(&extrinsic_cache_you, 0, sizeof extrinsic_cache_you);
+    memset(extrinsic_cache_mons, 0, sizeof extrinsic_cache_mons);
+}
+
+static unsigned long long
+extrinsic_signature(const struct obj *chain)
+{
+    /* The role is included for w_blocks(). */
+    unsigned long long sig = 0x9E3779B97F4A7C15ULL ^ Role_switch;
+
+    for (; chain; chain = chain->nobj) {
+        sig = (sig ^ (uintptr_t)chain) * 0x100000001B3ULL;
+        sig = (sig ^ (unsigned long)chain->owornmask) * 0x100000001B3ULL;
+        sig = (sig ^ ((unsigned long long)chain->otyp << 32 |
+                      (unsigned long long)chain->oartifact << 16 |
+                      (unsigned)chain->scalecolor)) * 0x100000001B3ULL;
+    }
+    return sig ^ (sig >> 29);
+}
+
+/* Returns the cache entry for mon, cleared if it was for a different monster
+   or a different inventory. */
+static struct extrinsic_cache *
+extrinsic_cache_for(const struct monst *mon)
+{
+    struct extrinsic_cache *cache;
+    unsigned long long sig = extrinsic_signature(m_minvent(mon));
+
+    if (mon == &youmonst)
+        cache = &extrinsic_cache_you;
+    else
+        cache = extrinsic_cache_mons +
+            ((((uintptr_t)mon >> 4) * 0x9E3779B1U >> 8) &
+             (EXTRINSIC_CACHE_MONS - 1));
+
+    if (cache->mon != mon || cache->signature != sig) {
+        memset(cache->known, 0, sizeof cache->known);
+        cache->mon = mon;
+        cache->signature = sig;
+    }
+    return cache;
+}
+
+/* Finds what find_extrinsic() would, via the cache: the slots in which mon has
+   items that provide the given extrinsic (0 if it's blocked), and whether
+   an item blocks it. */
 long
-mworn_extrinsic(const struct monst *mon, int extrinsic)
+mworn_extrinsic_blocked(const struct monst *mon, int extrinsic,
+                        boolean *blocked)
 {
+    struct obj *chain = m_minvent(mon);
+    struct extrinsic_cache *cache;
+    int byte = extrinsic / 8, bit = 1 << (extrinsic % 8);
     int warntype = 0;
+    long mask;
+    boolean chain_blocked;
+
+    /* Neither cached nor cacheable: find_extrinsic() returns nothing while
+       the chains are being restored. */
+    if (program_state.restoring_binary_save || extrinsic < 0 ||
+        extrinsic > LAST_PROP || extrinsic == WARN_OF_MON)
+        return find_extrinsic(chain, extrinsic, &warntype, blocked);
+
+    cache = extrinsic_cache_for(mon);
+    if (!(cache->known[byte] & bit)) {
+        /* Scan without the hallucination resistance check, which depends on
+           more than just the chain (it's repeated below). */
+        mask = 0L;
+        chain_blocked = FALSE;
+        for (; chain; chain = chain->nobj) {
+            mask |= item_provides_extrinsic(chain, extrinsic, &warntype);
+            if (extrinsic == w_blocks(chain, chain->owornmask))
+                chain_blocked = TRUE;
+        }
+        cache->extrinsic[extrinsic] = mask;
+        if (chain_blocked)
+            cache->blocked[byte] |= bit;
+        else
+            cache->blocked[byte] &= ~bit;
+        cache->known[byte] |= bit;
+        chain = m_minvent(mon);
+    }
+
+    /* Read the entry before checking Halluc_resistance, which uses the cache
+       itself. */
+    mask = cache->extrinsic[extrinsic];
+    *blocked = !!(cache->blocked[byte] & bit) ||
+        (extrinsic == HALLUC && chain && Halluc_resistance);
+    if (*blocked)
+        mask = 0L;
+
+    if (extrinsic_cache_check) {
+        boolean slow_blocked;
+        long slow_mask = find_extrinsic(chain, extrinsic, &warntype,
+                                        &slow_blocked);
+
+        if (slow_mask != mask || slow_blocked != *blocked)
+            impossible("Cached property %d for %s is %lx/%d, not %lx/%d",
+                       extrinsic, mon == &youmonst ? "you" : mon->data->mname,
+                       mask, (int)*blocked, slow_mask, (int)slow_blocked);
+        *blocked = slow_blocked;
+        return slow_mask;
+    }
+
+    return mask;
+}
+
+long
+mworn_extrinsic(const struct monst *mon, int extrinsic)
+{
     boolean blocked = FALSE;
-    return find_extrinsic(m_minvent(mon), extrinsic, &warntype, &blocked);
+    return mworn_extrinsic_blocked(mon, extrinsic, &blocked);
 }
 
 boolean
 mworn_blocked(const struct monst *mon, int extrinsic)
 {
-    int warntype;
     boolean blocked;
-    find_extrinsic(m_minvent(mon), extrinsic, &warntype, &blocked);
+    mworn_extrinsic_blocked(mon, extrinsic, &blocked);
     return blocked;
 }
 
@@ -0,0 +1,186 @@
+/* vim:set cin ft=c sw=4 sts=4 ts=8 et ai cino=Ls\:0t0(0 : -*- mode:c;fill-column:80;tab-width:8;c-basic-offset:4;indent-tabs-mode:nil;c-file-style:"k&r" -*-*/
+/* Last modified by agent, 2026-10-17 */
+/* Copyright (c) NetHack Fourk DevTeam, 2026. */
+/* NetHack may be freely redistributed.  See license for details. */
+
+/* Micro-benchmark for the base 64 kernels in base64.c, using the save backups
+   and save diffs from real save files as input. Usage:
+
+       b64bench [-n repetitions] file.nhgame...
+
+   For each kernel the CPU supports, this reports the encode and decode speed
+   over all the save lines found, and checks that the output is identical to
+   that of the portable kernel. */
+
+#ifdef AIMAKE_BUILDOS_MSWin32
+# error !AIMAKE_FAIL_SILENTLY! This benchmark uses POSIX timers.
+#endif
+
+#include "base64.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct payload {
+    const char *text;           /* base 64, without header or padding block */
+    int nblocks;
+};
+
+static struct payload *payloads = NULL;
+static int npayloads = 0;
+static long totalblocks = 0;
+
+static void
+add_payload(const char *line)
+{
+    const char *p = line;
+    int len;
+
+    /* Save backups start with "*%08lx "; save diffs with "~". Either may then
+       have a "$length$" header for compressed data. */
+    if (*p == '*')
+        p += 10;
+    else
+        p++;
+    if (*p == '$') {
+        p = strchr(p + 1, '$');
+        if (!p)
+            return;
+        p++;
+    }
+
+    /* Leave off the last block, which may contain padding. */
+    len = strlen(p) / 4 - 1;
+    if (len <= 0)
+        return;
+
+    payloads = realloc(payloads, (npayloads + 1) * sizeof *payloads);
+    if (!payloads) {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    payloads[npayloads].text = strdup(p);
+    payloads[npayloads].nblocks = len;
+    npayloads++;
+    totalblocks += len;
+}
+
+static void
+read_save_file(const char *filename)
+{
+    FILE *fp = fopen(filename, "r");
+    char *line = NULL;
+    size_t linesize = 0;
+    ssize_t linelen;
+
+    if (!fp) {
+        perror(filename);
+        exit(EXIT_FAILURE);
+    }
+
+    while ((linelen = getline(&line, &linesize, fp)) > 0) {
+        if (line[linelen - 1] == '\n')
+            line[linelen - 1] = '\0';
+        if (*line == '*' || *line == '~')
+            add_payload(line);
+    }
+
+    free(line);
+    fclose(fp);
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int
+main(int argc, char **argv)
+{
+    int reps = 20, i, r, k;
+    unsigned char **ref;
+    unsigned char *dbuf;
+    char *ebuf;
+    long maxblocks = 0;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc)
+            reps = atoi(argv[++i]);
+        else
+            read_save_file(argv[i]);
+    }
+
+    if (!npayloads || reps <= 0) {
+        fprintf(stderr, "Usage: %s [-n repetitions] file.nhgame...\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    for (i = 0; i < npayloads; i++)
+        if (payloads[i].nblocks > maxblocks)
+            maxblocks = payloads[i].nblocks;
+    dbuf = malloc(maxblocks * 3);
+    ebuf = malloc(maxblocks * 4);
+
+    /* The portable kernel's output is the reference. */
+    base64_set_kernel(B64K_SCALAR);
+    ref = malloc(npayloads * sizeof *ref);
+    for (i = 0; i < npayloads; i++) {
+        ref[i] = malloc(payloads[i].nblocks * 3);
+        if (base64_decode_blocks(payloads[i].text, ref[i],
+                                 payloads[i].nblocks) != payloads[i].nblocks) {
+            fprintf(stderr, "Save line %d is not valid base 64\n", i);
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("%d save lines, %.1f MB of base 64, %d repetitions\n", npayloads,
+           totalblocks * 4 / 1e6, reps);
+
+    for (k = B64K_SCALAR; k < B64K_COUNT; k++) {
+        double t, dtime, etime;
+
+        if (!base64_set_kernel(k)) {
+            printf("%-8s not supported\n", base64_kernel_name(k));
+            continue;
+        }
+
+        t = now();
+        for (r = 0; r < reps; r++)
+            for (i = 0; i < npayloads; i++)
+                base64_decode_blocks(payloads[i].text, dbuf,
+                                     payloads[i].nblocks);
+        dtime = now() - t;
+
+        t = now();
+        for (r = 0; r < reps; r++)
+            for (i = 0; i < npayloads; i++)
+                base64_encode_blocks(ref[i], ebuf, payloads[i].nblocks);
+        etime = now() - t;
+
+        for (i = 0; i < npayloads; i++) {
+            int n = payloads[i].nblocks;
+
+            base64_decode_blocks(payloads[i].text, dbuf, n);
+            base64_encode_blocks(ref[i], ebuf, n);
+            if (memcmp(dbuf, ref[i], n * 3) ||
+                memcmp(ebuf, payloads[i].text, n * 4)) {
+                printf("%-8s MISMATCH on save line %d\n",
+                       base64_kernel_name(k), i);
+                return EXIT_FAILURE;
+            }
+        }
+
+        printf("%-8s decode %8.1f MB/s   encode %8.1f MB/s\n",
+               base64_kernel_name(k),
+               totalblocks * 4.0 * reps / dtime / 1e6,
+               totalblocks * 4.0 * reps / etime / 1e6);
+    }
+
+    return EXIT_SUCCESS;
+}
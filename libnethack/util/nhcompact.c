@@ -0,0 +1,146 @@
+/* vim:set cin ft=c sw=4 sts=4 ts=8 et ai cino=Ls\:0t0(0 : -*- mode:c;fill-column:80;tab-width:8;c-basic-offset:4;indent-tabs-mode:nil;c-file-style:"k&r" -*-*/
+/* Last modified by agent, 2026-10-17 */
+/* Copyright (c) NetHack Fourk DevTeam, 2026. */
+/* NetHack may be freely redistributed.  See license for details. */
+
+/* Compacts the save files of finished games, via nh_compact_savegame. Usage:
+
+       nhcompact [-b bytes] [-t turns] [-n] file.nhgame...
+
+   Each file is rewritten with a save backup whenever there have been the given
+   number of bytes of log (default 1 MiB) or turns (default: no limit) since the
+   previous one, and save diffs everywhere else. This bounds the time needed to
+   seek within a replay of the game, and usually makes the file smaller too.
+
+   A file is only replaced once its compacted copy has been checked to contain
+   the same binary saves. Games that haven't finished are skipped, as they
+   could be resumed while being compacted. With -n, nothing is replaced; the
+   sizes the files would have are just reported. */
+
+#ifdef AIMAKE_BUILDOS_MSWin32
+# error !AIMAKE_FAIL_SILENTLY! This utility uses POSIX file handling.
+#endif
+
+#include "nethack.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static void
+compact_raw_print(const char *str)
+{
+    fprintf(stderr, strchr(str, '\n') ? "%s" : "%s\n", str);
+}
+
+static const struct nh_window_procs compact_windowprocs = {
+    .win_raw_print = compact_raw_print,
+};
+
+/* Returns 0 on success, 1 if the file was skipped, or 2 on error. */
+static int
+compact_file(const char *filename, long backup_bytes, long backup_turns,
+             int dry_run)
+{
+    struct nh_compact_info ci;
+    struct stat st;
+    char *tempname;
+    int infd, outfd, rv = 2;
+
+    infd = open(filename, O_RDONLY);
+    if (infd < 0 || fstat(infd, &st) < 0) {
+        perror(filename);
+        if (infd >= 0)
+            close(infd);
+        return 2;
+    }
+
+    if (nh_get_savegame_status(infd, NULL) != LS_DONE) {
+        fprintf(stderr, "%s: not a finished game, skipping\n", filename);
+        close(infd);
+        return 1;
+    }
+
+    tempname = malloc(strlen(filename) + sizeof ".compact");
+    sprintf(tempname, "%s.compact", filename);
+    outfd = open(tempname, O_RDWR | O_CREAT | O_EXCL, st.st_mode & 0777);
+    if (outfd < 0) {
+        perror(tempname);
+        free(tempname);
+        close(infd);
+        return 2;
+    }
+
+    if (!nh_compact_savegame(infd, outfd, backup_bytes, backup_turns, &ci)) {
+        fprintf(stderr, "%s: compaction failed\n", filename);
+    } else if (!dry_run && (fsync(outfd) < 0 || rename(tempname, filename))) {
+        perror(tempname);
+    } else {
+        printf("%s: %ld save lines, %ld -> %ld backups, %ld -> %ld bytes\n",
+               filename, ci.save_lines, ci.backups_before, ci.backups_after,
+               ci.size_before, ci.size_after);
+        rv = 0;
+    }
+
+    if (rv || dry_run)
+        unlink(tempname);
+
+    close(outfd);
+    close(infd);
+    free(tempname);
+    return rv;
+}
+
+static void
+usage(const char *argv0)
+{
+    fprintf(stderr, "Usage: %s [-b bytes] [-t turns] [-n] file.nhgame...\n",
+            argv0);
+    exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char **argv)
+{
+    long backup_bytes = 1024 * 1024, backup_turns = 0;
+    int dry_run = 0, errors = 0, opt, i;
+    const char *paths[PREFIX_COUNT] = {
+        [BONESPREFIX] = "$OMIT",        /* no game is played, so no */
+        [DATAPREFIX] = "",              /* other files are needed */
+        [SCOREPREFIX] = "",
+        [LOCKPREFIX] = "",
+        [TROUBLEPREFIX] = "$OMIT",
+        [DUMPPREFIX] = "$OMIT",
+    };
+
+    while ((opt = getopt(argc, argv, "b:t:n")) != -1) {
+        switch (opt) {
+        case 'b':
+            backup_bytes = atol(optarg);
+            break;
+        case 't':
+            backup_turns = atol(optarg);
+            break;
+        case 'n':
+            dry_run = 1;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (optind >= argc || backup_bytes < 0 || backup_turns < 0)
+        usage(argv[0]);
+
+    nh_lib_init(&compact_windowprocs, paths);
+
+    for (i = optind; i < argc; i++)
+        if (compact_file(argv[i], backup_bytes, backup_turns, dry_run) > 1)
+            errors++;
+
+    nh_lib_exit();
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
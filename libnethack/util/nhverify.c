@@ -0,0 +1,487 @@
+/* vim:set cin ft=c sw=4 sts=4 ts=8 et ai cino=Ls\:0t0(0 : -*- mode:c;fill-column:80;tab-width:8;c-basic-offset:4;indent-tabs-mode:nil;c-file-style:"k&r" -*-*/
+/* Last modified by agent, 2026-10-17 */
+/* Copyright (c) NetHack Fourk DevTeam, 2026. */
+/* NetHack may be freely redistributed.  See license for details. */
+
+/* Checks that save files still load, via nh_verify_savegame; intended for use
+   on a server after upgrading the game engine. Usage:
+
+       nhverify [-j jobs] [-r saves] file.nhgame|directory...
+
+   Each file (or each .nhgame file in each directory) is loaded in replay mode,
+   so nothing is written to it, and the engine checks that it saves the loaded
+   game the same way the file does. With -r, the given number of save lines
+   before the last are checked too (default 0).
+
+   Each file is checked in its own process, so that a crash only affects that
+   file; up to "jobs" files (default: one per CPU) are checked at once. For
+   each file, the result, the time taken and the peak memory usage are
+   reported. Games that are being played are skipped. */
+
+#ifdef AIMAKE_BUILDOS_MSWin32
+# error !AIMAKE_FAIL_SILENTLY! This utility uses POSIX process handling.
+#endif
+
+#include "nethack.h"
+#include "menulist.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Results from a checking process to the main process. Each is sent with a
+   single write() (and is under PIPE_BUF in size), so can be read in one go once
+   the process has exited. The process measures its own peak memory usage, as
+   there's no portable way to get that for a particular child. */
+enum verify_status {
+    VS_OK,
+    VS_MISMATCH,
+    VS_FAILED,
+    VS_SKIPPED,
+};
+struct verify_result {
+    enum verify_status status;
+    struct nh_verify_info vi;
+    long maxrss;                /* KiB */
+    char message[1024];
+};
+
+struct verify_job {
+    const char *filename;
+    pid_t pid;
+    int fd;                     /* read end of the result pipe */
+    struct timespec start;
+};
+
+static struct verify_result result;
+
+/* Messages from the engine are only interesting if the load fails, so they're
+   collected to be reported then. */
+static void
+add_message(const char *str)
+{
+    size_t len = strlen(result.message);
+
+    if (len && len + 2 < sizeof result.message)
+        strcpy(result.message + len++, " ");
+    snprintf(result.message + len, sizeof result.message - len, "%s", str);
+    len = strlen(result.message);
+    while (len && result.message[len - 1] == '\n')
+        result.message[--len] = '\0';
+}
+
+static void
+send_result(void)
+{
+    struct rusage ru;
+
+    if (getrusage(RUSAGE_SELF, &ru) == 0)
+        result.maxrss = ru.ru_maxrss;
+    if (write(STDOUT_FILENO, &result, sizeof result) != sizeof result)
+        _exit(EXIT_FAILURE);
+}
+
+static void
+verify_raw_print(const char *str)
+{
+    add_message(str);
+}
+
+static void
+verify_display_menu(struct nh_menulist *ml, const char *title, int how,
+                    int placement_hint, void *callbackarg,
+                    void (*callback)(const int *, int, void *))
+{
+    int i, selected = 2;
+
+    /* The only menu that should appear is the one that log_recover_core shows
+       if the game can't be loaded. Report the reasons, and choose "Exit to the
+       menu". */
+    for (i = 0; i < ml->icount; i++)
+        if (!strncmp(ml->items[i].caption, "Error: ", 7) ||
+            !strncmp(ml->items[i].caption, "Location: ", 10))
+            add_message(ml->items[i].caption);
+
+    dealloc_menulist(ml);
+    if (title && !strcmp(title, "Viewing interrupted..."))
+        callback(&selected, 1, callbackarg);
+    else
+        callback(NULL, 0, callbackarg);
+}
+
+static void
+verify_display_objects(struct nh_objlist *ml, const char *title, int how,
+                       int placement_hint, void *callbackarg,
+                       void (*callback)(const struct nh_objresult *, int,
+                                        void *))
+{
+    dealloc_objmenulist(ml);
+    callback(NULL, 0, callbackarg);
+}
+
+static void
+verify_list_items(struct nh_objlist *itemlist, nh_bool invent)
+{
+    dealloc_objmenulist(itemlist);
+}
+
+static void
+verify_request_command(nh_bool debug, nh_bool completed, nh_bool interrupted,
+                       void *callbackarg,
+                       void (*callback)(const struct nh_cmd_and_arg *, void *))
+{
+    /* Loading a game never asks for a command; if we get here, something's
+       badly wrong, and this process can just give up. */
+    add_message("The game asked for a command while loading");
+    result.status = VS_FAILED;
+    send_result();
+    _exit(EXIT_FAILURE);
+}
+
+static struct nh_query_key_result
+verify_query_key(const char *query, enum nh_query_key_flags flags,
+                 nh_bool count_allowed)
+{
+    return (struct nh_query_key_result){.key = '\033', .count = -1};
+}
+
+static struct nh_getpos_result
+verify_getpos(int origx, int origy, nh_bool force, const char *goal)
+{
+    return (struct nh_getpos_result){.howclosed = NHCR_CLIENT_CANCEL,
+                                     .x = origx, .y = origy};
+}
+
+static enum nh_direction
+verify_getdir(const char *query, nh_bool restricted)
+{
+    return DIR_NONE;
+}
+
+static char
+verify_yn_function(const char *query, const char *rset, char defchoice)
+{
+    return defchoice;
+}
+
+static void
+verify_getlin(const char *query, void *callbackarg,
+              void (*callback)(const char *, void *))
+{
+    callback("\033", callbackarg);
+}
+
+static void
+verify_outrip(struct nh_menulist *ml, nh_bool tombstone, const char *name,
+              int gold, const char *killbuf, int end_how, int year)
+{
+    dealloc_menulist(ml);
+}
+
+static void verify_no_op_void(void) {}
+static void verify_no_op_int(int i) {}
+static void verify_pause(enum nh_pause_reason reason) {}
+static void verify_display_buffer(const char *buf, nh_bool trymove) {}
+static void verify_update_status(struct nh_player_info *pi) {}
+static void verify_print_message(enum msg_channel msgc, const char *msg) {}
+static void verify_update_screen(struct nh_dbuf_entry dbuf[ROWNO][COLNO],
+                                 int ux, int uy) {}
+
+static const struct nh_window_procs verify_windowprocs = {
+    .win_pause = verify_pause,
+    .win_display_buffer = verify_display_buffer,
+    .win_update_status = verify_update_status,
+    .win_print_message = verify_print_message,
+    .win_request_command = verify_request_command,
+    .win_display_menu = verify_display_menu,
+    .win_display_objects = verify_display_objects,
+    .win_list_items = verify_list_items,
+    .win_update_screen = verify_update_screen,
+    .win_raw_print = verify_raw_print,
+    .win_query_key = verify_query_key,
+    .win_getpos = verify_getpos,
+    .win_getdir = verify_getdir,
+    .win_yn_function = verify_yn_function,
+    .win_getlin = verify_getlin,
+    .win_delay = verify_no_op_void,
+    .win_load_progress = verify_no_op_int,
+    .win_level_changed = verify_no_op_int,
+    .win_outrip = verify_outrip,
+    .win_server_cancel = verify_no_op_void,
+};
+
+/* Runs in a checking process, with stdout connected to the result pipe. */
+static void
+verify_file(const char *filename, int recent_saves)
+{
+    int fd = open(filename, O_RDONLY);
+
+    if (fd < 0) {
+        add_message(strerror(errno));
+        result.status = VS_FAILED;
+        return;
+    }
+
+    switch (nh_get_savegame_status(fd, NULL)) {
+    case LS_INVALID:
+        add_message("Not a NetHack Fourk save file");
+        result.status = VS_FAILED;
+        break;
+    case LS_CRASHED:
+        add_message("The game crashed and needs recovering");
+        result.status = VS_FAILED;
+        break;
+    case LS_IN_PROGRESS:
+        add_message("The game is being played");
+        result.status = VS_SKIPPED;
+        break;
+    case LS_SAVED:
+    case LS_DONE:
+        *result.message = '\0';
+        if (!nh_verify_savegame(fd, recent_saves, &result.vi))
+            result.status = VS_FAILED;
+        else if (result.vi.saves_mismatched)
+            result.status = VS_MISMATCH;
+        else
+            result.status = VS_OK;
+        break;
+    }
+
+    close(fd);
+}
+
+static void
+report(const struct verify_job *job, const struct verify_result *r)
+{
+    struct timespec end;
+    double seconds;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = (end.tv_sec - job->start.tv_sec) +
+        (end.tv_nsec - job->start.tv_nsec) / 1e9;
+
+    printf("%s: ", job->filename);
+    switch (r->status) {
+    case VS_OK:
+        printf("OK, turn %d, %d saves checked", r->vi.turn,
+               r->vi.saves_checked);
+        break;
+    case VS_MISMATCH:
+        printf("MISMATCH in %d of %d saves, first on turn %d (%s)",
+               r->vi.saves_mismatched, r->vi.saves_checked,
+               r->vi.first_mismatch_turn, r->vi.mismatch_reason);
+        break;
+    case VS_FAILED:
+        printf("FAILED (%s)", *r->message ? r->message : "no reason given");
+        break;
+    case VS_SKIPPED:
+        printf("skipped (%s)", r->message);
+        break;
+    }
+    printf(", %.2f s", seconds);
+    if (r->maxrss)
+        printf(", %ld KiB", r->maxrss);
+    printf("\n");
+    fflush(stdout);
+}
+
+/* Waits for one of the checking processes to finish, and reports on it.
+   Returns TRUE if the file checked out OK (or was skipped). */
+static nh_bool
+reap(struct verify_job *jobs, int njobs)
+{
+    struct verify_result r;
+    int status, i;
+    pid_t pid;
+
+    do
+        pid = waitpid(-1, &status, 0);
+    while (pid < 0 && errno == EINTR);
+    if (pid < 0) {
+        perror("waitpid");
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < njobs; i++)
+        if (jobs[i].pid == pid)
+            break;
+    if (i == njobs)
+        return TRUE;    /* not one of ours */
+
+    if (read(jobs[i].fd, &r, sizeof r) != sizeof r) {
+        memset(&r, 0, sizeof r);
+        r.status = VS_FAILED;
+        if (WIFSIGNALED(status))
+            snprintf(r.message, sizeof r.message, "killed by signal %d",
+                     WTERMSIG(status));
+        else
+            snprintf(r.message, sizeof r.message, "exited with status %d",
+                     WEXITSTATUS(status));
+    }
+    close(jobs[i].fd);
+    jobs[i].pid = 0;
+
+    report(&jobs[i], &r);
+    return r.status == VS_OK || r.status == VS_SKIPPED;
+}
+
+static void
+add_file(const char ***files, int *nfiles, const char *filename)
+{
+    *files = realloc(*files, (*nfiles + 1) * sizeof **files);
+    if (!*files) {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    (*files)[(*nfiles)++] = filename;
+}
+
+static int
+compare_filenames(const void *a, const void *b)
+{
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+static void
+add_path(const char ***files, int *nfiles, const char *path)
+{
+    struct stat st;
+    struct dirent *de;
+    DIR *dir;
+    int first = *nfiles;
+
+    if (stat(path, &st) < 0 || !S_ISDIR(st.st_mode)) {
+        add_file(files, nfiles, path);
+        return;
+    }
+
+    dir = opendir(path);
+    if (!dir) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    while ((de = readdir(dir))) {
+        size_t len = strlen(de->d_name);
+        char *filename;
+
+        if (len <= 7 || strcmp(de->d_name + len - 7, ".nhgame"))
+            continue;
+
+        filename = malloc(strlen(path) + len + 2);
+        sprintf(filename, "%s/%s", path, de->d_name);
+        add_file(files, nfiles, filename);
+    }
+    closedir(dir);
+
+    qsort(*files + first, *nfiles - first, sizeof **files, compare_filenames);
+}
+
+static void
+usage(const char *argv0)
+{
+    fprintf(stderr, "Usage: %s [-j jobs] [-r saves] "
+            "file.nhgame|directory...\n", argv0);
+    exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char **argv)
+{
+    const char **files = NULL;
+    struct verify_job *jobs;
+    int nfiles = 0, njobs = 0, recent_saves = 0, running = 0, failures = 0;
+    int opt, i, j;
+    const char *paths[PREFIX_COUNT] = {
+        [BONESPREFIX] = "$OMIT",        /* no game is played, so no */
+        [DATAPREFIX] = "",              /* other files are needed */
+        [SCOREPREFIX] = "",
+        [LOCKPREFIX] = "",
+        [TROUBLEPREFIX] = "$OMIT",
+        [DUMPPREFIX] = "$OMIT",
+    };
+
+    while ((opt = getopt(argc, argv, "j:r:")) != -1) {
+        switch (opt) {
+        case 'j':
+            njobs = atoi(optarg);
+            break;
+        case 'r':
+            recent_saves = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (optind >= argc || njobs < 0 || recent_saves < 0)
+        usage(argv[0]);
+
+    if (!njobs)
+        njobs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (njobs < 1)
+        njobs = 1;
+
+    for (i = optind; i < argc; i++)
+        add_path(&files, &nfiles, argv[i]);
+
+    jobs = calloc(njobs, sizeof *jobs);
+    nh_lib_init(&verify_windowprocs, paths);
+
+    for (i = 0; i < nfiles; i++) {
+        int pipefd[2];
+        pid_t pid;
+
+        if (running == njobs) {
+            if (!reap(jobs, njobs))
+                failures++;
+            running--;
+        }
+
+        for (j = 0; jobs[j].pid; j++)
+            ;
+
+        fflush(stdout);
+        if (pipe(pipefd) < 0) {
+            perror("pipe");
+            return EXIT_FAILURE;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &jobs[j].start);
+        pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return EXIT_FAILURE;
+        }
+
+        if (pid == 0) {
+            close(pipefd[0]);
+            dup2(pipefd[1], STDOUT_FILENO);
+            close(pipefd[1]);
+
+            verify_file(files[i], recent_saves);
+            send_result();
+            _exit(EXIT_SUCCESS);
+        }
+
+        close(pipefd[1]);
+        jobs[j].filename = files[i];
+        jobs[j].pid = pid;
+        jobs[j].fd = pipefd[0];
+        running++;
+    }
+
+    while (running--)
+        if (!reap(jobs, njobs))
+            failures++;
+
+    nh_lib_exit();
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -41,6 +41,15 @@ extern const_char_p_const_p EXPORT(nh_get_copyright_banner) (void);
 /* log.c */
 extern enum nh_log_status EXPORT(nh_get_savegame_status) (
     int fd, struct nh_game_info *si);
+extern nh_bool EXPORT(nh_compact_savegame) (
+    int infd, int outfd, long backup_bytes, long backup_turns,
+    struct nh_compact_info *ci);
+extern nh_bool EXPORT(nh_verify_savegame) (
+    int fd, int recent_saves, struct nh_verify_info *vi);
+extern nh_bool EXPORT(nh_analysis_open) (int fd);
+extern nh_bool EXPORT(nh_analysis_sample) (
+    long target, enum nh_sample_units units, struct nh_game_snapshot *snap);
+extern void EXPORT(nh_analysis_close) (void);
 
 /* cmd.c */
 extern nh_cmd_desc_p EXPORT(nh_get_commands) (int *count);
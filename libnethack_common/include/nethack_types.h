@@ -622,6 +622,40 @@ struct nh_player_info {
     nh_bool can_enhance;
 };
 
+/* results of nh_compact_savegame; sizes are in bytes */
+struct nh_compact_info {
+    long save_lines;            /* save backup and save diff lines */
+    long backups_before;
+    long backups_after;
+    long size_before;
+    long size_after;
+};
+
+/* results of nh_verify_savegame */
+struct nh_verify_info {
+    int saves_checked;          /* binary saves loaded */
+    int saves_mismatched;       /* that didn't save back the same way */
+    int turn;                   /* of the last save in the file */
+    int first_mismatch_turn;
+    char mismatch_reason[COLNO];
+};
+
+/* where nh_analysis_sample should move to in the game */
+enum nh_sample_units {
+    SU_TURNS,                   /* the last save on or before a turn */
+    SU_BYTES,                   /* the last save on or before a log offset */
+    SU_EOF,                     /* the last save in the log */
+};
+
+/* results of nh_analysis_sample */
+struct nh_game_snapshot {
+    struct nh_player_info pi;   /* as on the status line; pi.moves is the turn */
+    long offset;                /* log offset of the save that was loaded */
+    char dungeon_name[PL_NSIZ];
+    int dlevel, depth, max_depth;
+    int invent_count;
+    struct nh_objitem *invent;  /* valid until the next API call */
+};
 
 /* info about saved games as provided by nh_get_savegame_status */
 struct nh_game_info {